@@ -2,11 +2,63 @@
 
 
 #include "FlowControlUtility.h"
-#include "StructDefine.h"
 #include <GameFramework/Actor.h>
 #include <TimerManager.h>
 #include <kismet/KismetSystemLibrary.h>
 #include <Containers/UnrealString.h>
+#include <HAL/IConsoleManager.h>
+#include <UObject/ObjectKey.h>
+
+static TAutoConsoleVariable<float> CVarFrameBudgetMs(
+	TEXT("MapTest.FrameBudgetMs"),
+	8.0f,
+	TEXT("Milliseconds per frame the terrain and hex grid workflows may use, <= 0 for fixed count slices and timer rates."));
+
+static TAutoConsoleVariable<float> CVarFrameBudgetCheckMs(
+	TEXT("MapTest.FrameBudgetCheckMs"),
+	0.25f,
+	TEXT("About how often a workflow loop reads the clock, chunk sizes adapt to this from measured iteration cost."));
+
+static TAutoConsoleVariable<int32> CVarFrameBudgetMaxChunk(
+	TEXT("MapTest.FrameBudgetMaxChunk"),
+	65536,
+	TEXT("Most loop iterations between two clock reads."));
+
+//Budget of the current frame, game thread only
+static uint64 BudgetFrame = MAX_uint64;
+static double BudgetUsed = 0.0;
+static double RunStartTime = 0.0;
+static bool* RunNextStage = nullptr;
+static const FTimerDynamicDelegate* RunDelegate = nullptr;
+
+//Pending run of every owner workflow, game thread only, an entry is removed when its run fires or is cancelled
+static TMap<TObjectKey<AActor>, FTimerHandle> PendingRuns;
+
+//Handle of the pending run of Owner, entries of destroyed owners are dropped first, their runs never fire
+static FTimerHandle& FindOrAddPendingRun(AActor* Owner)
+{
+	for (auto It = PendingRuns.CreateIterator(); It; ++It)
+	{
+		if (It->Key.ResolveObjectPtr() == nullptr) {
+			It.RemoveCurrent();
+		}
+	}
+	return PendingRuns.FindOrAdd(Owner);
+}
+
+//Workflow of the innermost FUnslicedScope on this thread
+static thread_local const FTimerDynamicDelegate* UnslicedDelegate = nullptr;
+
+FlowControlUtility::FUnslicedScope::FUnslicedScope(const FTimerDynamicDelegate& TimerDelegate)
+	: Previous(UnslicedDelegate)
+{
+	UnslicedDelegate = &TimerDelegate;
+}
+
+FlowControlUtility::FUnslicedScope::~FUnslicedScope()
+{
+	UnslicedDelegate = Previous;
+}
 
 FlowControlUtility::FlowControlUtility()
 {
@@ -18,31 +70,148 @@ FlowControlUtility::~FlowControlUtility()
 
 void FlowControlUtility::InitLoopData(FStructLoopData& InOut_Data)
 {
-	InOut_Data.IndexSaved.Empty();
-	for (int32 i = 0; i < InOut_Data.LoopDepthLimit; i++)
-	{
-		InOut_Data.IndexSaved.Add(0);
-	}
-	InOut_Data.HasInitialized = false;
 	InOut_Data.Count = 0;
+	InOut_Data.CheckInterval = 1;
+	InOut_Data.SliceStartTime = 0.0;
 }
 
-void FlowControlUtility::SaveLoopData(AActor* Owner, FStructLoopData& InOut_Data, int32 Count, const TArray<int32>& Indices,
-	const FTimerDynamicDelegate TimerDelegate, bool& Out_Success)
+int32 FlowControlUtility::NextChunkEnd(AActor* Owner, FStructLoopData& InOut_Data, int32 Num, int32 SliceItems,
+	const FTimerDynamicDelegate& TimerDelegate)
 {
-	if (Count > InOut_Data.LoopCountLimit) {
-		for (int32 i = 0; i < Indices.Num() && i < InOut_Data.LoopDepthLimit; i++)
-		{
-			InOut_Data.IndexSaved[i] = Indices[i];
+	int32 Remaining = Num - InOut_Data.Count;
+	if (IsUnsliced(TimerDelegate)) {
+		return Num;
+	}
+	if (!IsFrameBudgetEnabled()) {
+		//One chunk of LoopCountLimit per slice
+		int32 Limit = FMath::Max(InOut_Data.LoopCountLimit, 1);
+		if (SliceItems >= Limit) {
+			ScheduleTimer(Owner, TimerDelegate, InOut_Data.Rate);
+			return INDEX_NONE;
 		}
-		FTimerHandle TimerHandle;
-		Owner->GetWorldTimerManager().SetTimer(TimerHandle, TimerDelegate, InOut_Data.Rate, false);
-		Out_Success = true;
+		return InOut_Data.Count + FMath::Min(Remaining, Limit - SliceItems);
+	}
+
+	//The first chunk always runs, so every slice moves the loop on
+	if (SliceItems == 0) {
+		InOut_Data.SliceStartTime = FPlatformTime::Seconds();
 	}
 	else {
-		InOut_Data.Count++;
-		Out_Success = false;
+		//Read the clock about every FrameBudgetCheckMs, from the cost measured in this slice
+		double Cost = (FPlatformTime::Seconds() - InOut_Data.SliceStartTime) / SliceItems;
+		double CheckSeconds = CVarFrameBudgetCheckMs.GetValueOnGameThread() / 1000.0;
+		InOut_Data.CheckInterval = FMath::Clamp<int32>(Cost > 0.0 ? int32(FMath::Min(CheckSeconds / Cost, double(MAX_int32))) : MAX_int32,
+			1, FMath::Max(1, CVarFrameBudgetMaxChunk.GetValueOnGameThread()));
+		if (IsFrameBudgetExceeded()) {
+			ScheduleNextFrame(Owner, TimerDelegate);
+			return INDEX_NONE;
+		}
+	}
+	return InOut_Data.Count + FMath::Min(Remaining, InOut_Data.CheckInterval);
+}
+
+void FlowControlUtility::ScheduleNextStage(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate, float Rate)
+{
+	if (IsUnsliced(TimerDelegate)) {
+		return;
+	}
+	if (!IsFrameBudgetEnabled()) {
+		ScheduleTimer(Owner, TimerDelegate, Rate);
+		return;
+	}
+	//Inside RunWorkflow the loop there picks it up, no recursion into the stage
+	if (RunNextStage != nullptr && *RunDelegate == TimerDelegate && !IsFrameBudgetExceeded()) {
+		*RunNextStage = true;
+		return;
+	}
+	ScheduleNextFrame(Owner, TimerDelegate);
+}
+
+void FlowControlUtility::ScheduleNextPoll(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate, float Rate)
+{
+	if (IsUnsliced(TimerDelegate)) {
+		return;
+	}
+	if (!IsFrameBudgetEnabled()) {
+		ScheduleTimer(Owner, TimerDelegate, Rate);
+		return;
+	}
+	ScheduleNextFrame(Owner, TimerDelegate);
+}
+
+void FlowControlUtility::CancelScheduled(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate)
+{
+	FTimerHandle TimerHandle;
+	if (PendingRuns.RemoveAndCopyValue(Owner, TimerHandle)) {
+		Owner->GetWorldTimerManager().ClearTimer(TimerHandle);
+	}
+	if (RunNextStage != nullptr && *RunDelegate == TimerDelegate) {
+		*RunNextStage = false;
+	}
+}
+
+bool FlowControlUtility::IsFrameBudgetEnabled()
+{
+	return CVarFrameBudgetMs.GetValueOnGameThread() > 0.f;
+}
 
+bool FlowControlUtility::IsFrameBudgetExceeded()
+{
+	if (BudgetFrame != GFrameCounter) {
+		return false;
+	}
+	double Used = BudgetUsed;
+	if (RunNextStage != nullptr) {
+		Used += FPlatformTime::Seconds() - RunStartTime;
 	}
+	return Used * 1000.0 >= CVarFrameBudgetMs.GetValueOnGameThread();
 }
 
+bool FlowControlUtility::IsUnsliced(const FTimerDynamicDelegate& TimerDelegate)
+{
+	return UnslicedDelegate != nullptr && *UnslicedDelegate == TimerDelegate;
+}
+
+void FlowControlUtility::ScheduleTimer(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate, float Rate)
+{
+	//The same handle, a timer still pending is replaced
+	TObjectKey<AActor> OwnerKey(Owner);
+	Owner->GetWorldTimerManager().SetTimer(FindOrAddPendingRun(Owner), FTimerDelegate::CreateWeakLambda(Owner, [OwnerKey, TimerDelegate]() {
+		PendingRuns.Remove(OwnerKey);
+		TimerDelegate.ExecuteIfBound();
+	}), Rate, false);
+}
+
+void FlowControlUtility::ScheduleNextFrame(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate)
+{
+	FTimerManager& TimerManager = Owner->GetWorldTimerManager();
+	FTimerHandle& TimerHandle = FindOrAddPendingRun(Owner);
+	TimerManager.ClearTimer(TimerHandle);
+	TObjectKey<AActor> OwnerKey(Owner);
+	TimerHandle = TimerManager.SetTimerForNextTick(FTimerDelegate::CreateWeakLambda(Owner, [OwnerKey, TimerDelegate]() {
+		PendingRuns.Remove(OwnerKey);
+		RunWorkflow(TimerDelegate);
+	}));
+}
+
+void FlowControlUtility::RunWorkflow(const FTimerDynamicDelegate& TimerDelegate)
+{
+	if (BudgetFrame != GFrameCounter) {
+		BudgetFrame = GFrameCounter;
+		BudgetUsed = 0.0;
+	}
+
+	//Workflows of all actors share one budget, a run is never nested in another
+	bool NextStage = true;
+	RunNextStage = &NextStage;
+	RunDelegate = &TimerDelegate;
+	RunStartTime = FPlatformTime::Seconds();
+	while (NextStage)
+	{
+		NextStage = false;
+		TimerDelegate.ExecuteIfBound();
+	}
+	BudgetUsed += FPlatformTime::Seconds() - RunStartTime;
+	RunNextStage = nullptr;
+	RunDelegate = nullptr;
+}
@@ -2,20 +2,148 @@
 
 #pragma once
 
+#include "StructDefine.h"
+#include "WorkflowProfiler.h"
+
 #include "CoreMinimal.h"
 
 /**
- * 
+ * Time slicing for the actor workflows.
+ * A stage loop is resumable, its position lives in FStructLoopData::Count and the body runs in chunks between yield checks.
+ * With MapTest.FrameBudgetMs > 0, loops yield once the workflows used the budget of this frame and resume next frame,
+ * a finished stage starts the next one in the same frame while budget is left.
+ * With MapTest.FrameBudgetMs <= 0, loops yield every LoopCountLimit iterations and resume after Rate seconds.
+ * Inside an FUnslicedScope, stages of a WorkflowGraph, loops of that workflow never yield and it is never scheduled.
+ * An owner has one workflow with at most one pending run, scheduling again replaces it.
  */
 class MAPTESTCPP_API FlowControlUtility
 {
 
+public:
+	//Per thread, the owner of the scope runs the whole stage and picks the next one
+	struct FUnslicedScope
+	{
+		FUnslicedScope(const FTimerDynamicDelegate& TimerDelegate);
+		~FUnslicedScope();
+
+	private:
+		const FTimerDynamicDelegate* Previous;
+	};
+
 public:
 	FlowControlUtility();
 	~FlowControlUtility();
 
-	static void InitLoopData(struct FStructLoopData& InOut_Data);
-	static void SaveLoopData(AActor* Owner, struct FStructLoopData& InOut_Data, int32 Count, const TArray<int32>& Indices,
-		const FTimerDynamicDelegate TimerDelegate, bool& Out_Success);
+	//Back to the start of the loop
+	static void InitLoopData(FStructLoopData& InOut_Data);
+
+	//Body(Begin, End) for the chunks of [Count, Num), Count is 0 only before the first slice.
+	//True when the loop is done, false when it yielded and the workflow runs it again later.
+	template<typename BodyType>
+	static bool RunChunks(AActor* Owner, FStructLoopData& InOut_Data, int32 Num, const FTimerDynamicDelegate& TimerDelegate,
+		BodyType&& Body)
+	{
+		int32 SliceItems = 0;
+		while (InOut_Data.Count < Num)
+		{
+			int32 End = NextChunkEnd(Owner, InOut_Data, Num, SliceItems, TimerDelegate);
+			if (End == INDEX_NONE) {
+				return false;
+			}
+			Body(InOut_Data.Count, End);
+			SliceItems += End - InOut_Data.Count;
+			WorkflowProfiler::CountItems(End - InOut_Data.Count);
+			InOut_Data.Count = End;
+		}
+		return true;
+	}
+
+	//Body(Index) for Index in [Count, Num), the same resume rules as RunChunks
+	template<typename BodyType>
+	static bool RunLoop(AActor* Owner, FStructLoopData& InOut_Data, int32 Num, const FTimerDynamicDelegate& TimerDelegate,
+		BodyType&& Body)
+	{
+		return RunChunks(Owner, InOut_Data, Num, TimerDelegate, [&Body](int32 Begin, int32 End) {
+			for (int32 i = Begin; i < End; i++)
+			{
+				Body(i);
+			}
+		});
+	}
+
+	//Row major Body(Row, Column) over Rows x Columns, the same resume rules as RunChunks
+	template<typename BodyType>
+	static bool RunGridLoop(AActor* Owner, FStructLoopData& InOut_Data, int32 Rows, int32 Columns,
+		const FTimerDynamicDelegate& TimerDelegate, BodyType&& Body)
+	{
+		int32 SliceItems = 0;
+		int32 Num = Rows * Columns;
+		while (InOut_Data.Count < Num)
+		{
+			int32 End = NextChunkEnd(Owner, InOut_Data, Num, SliceItems, TimerDelegate);
+			if (End == INDEX_NONE) {
+				return false;
+			}
+			int32 Row = InOut_Data.Count / Columns;
+			int32 Column = InOut_Data.Count - Row * Columns;
+			for (int32 i = InOut_Data.Count; i < End; i++)
+			{
+				Body(Row, Column);
+				if (++Column == Columns) {
+					Column = 0;
+					Row++;
+				}
+			}
+			SliceItems += End - InOut_Data.Count;
+			WorkflowProfiler::CountItems(End - InOut_Data.Count);
+			InOut_Data.Count = End;
+		}
+		return true;
+	}
+
+	//Open ended, Step does one item and returns false once nothing is left, its state lives in the caller's members
+	template<typename StepType>
+	static bool RunSteps(AActor* Owner, FStructLoopData& InOut_Data, const FTimerDynamicDelegate& TimerDelegate, StepType&& Step)
+	{
+		int32 SliceItems = 0;
+		while (true)
+		{
+			int32 End = NextChunkEnd(Owner, InOut_Data, MAX_int32, SliceItems, TimerDelegate);
+			if (End == INDEX_NONE) {
+				return false;
+			}
+			int32 Begin = InOut_Data.Count;
+			bool More = true;
+			while (More && InOut_Data.Count < End)
+			{
+				More = Step();
+				InOut_Data.Count++;
+			}
+			SliceItems += InOut_Data.Count - Begin;
+			WorkflowProfiler::CountItems(InOut_Data.Count - Begin);
+			if (!More) {
+				return true;
+			}
+		}
+	}
+
+	//Run the workflow delegate again for its next stage
+	static void ScheduleNextStage(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate, float Rate);
+	//Run the workflow delegate again to poll something not ready, never in the same frame
+	static void ScheduleNextPoll(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate, float Rate);
+	//Drop the pending run of the workflow, game thread
+	static void CancelScheduled(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate);
+
+	static bool IsFrameBudgetEnabled();
+	static bool IsFrameBudgetExceeded();
+	static bool IsUnsliced(const FTimerDynamicDelegate& TimerDelegate);
+
+private:
+	//End of the next chunk of a loop, or INDEX_NONE when the slice is over and the workflow is scheduled
+	static int32 NextChunkEnd(AActor* Owner, FStructLoopData& InOut_Data, int32 Num, int32 SliceItems,
+		const FTimerDynamicDelegate& TimerDelegate);
+	static void ScheduleTimer(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate, float Rate);
+	static void ScheduleNextFrame(AActor* Owner, const FTimerDynamicDelegate& TimerDelegate);
+	static void RunWorkflow(const FTimerDynamicDelegate& TimerDelegate);
 
 };
@@ -4,17 +4,17 @@
 #include "HexGrid.h"
 #include "FlowControlUtility.h"
 #include "Terrain.h"
+#include "HexGridBakedCache.h"
+#include "MapRegistrySubsystem.h"
 
 #include <Math/UnrealMathUtility.h>
-#include <kismet/KismetStringLibrary.h>
-#include <Kismet/GameplayStatics.h>
 #include <Kismet/KismetMathLibrary.h>
 #include <ProceduralMeshComponent.h>
 #include <Components/InstancedStaticMeshComponent.h>
 #include <TimerManager.h>
+#include <Async/Async.h>
 #include <EnhancedInputComponent.h>
 #include <EnhancedInputSubsystems.h>
-#include <string>
 
 DEFINE_LOG_CATEGORY(HexGrid);
 
@@ -46,11 +46,92 @@ void AHexGrid::BeginPlay()
 	AddInputMappingContext();
 	BindEnchancedInputAction();
 
+	Profiler.Init(GetName(), StaticEnum<Enum_HexGridWorkflowState>());
 	WorkflowState = Enum_HexGridWorkflowState::InitWorkflow;
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->RegisterHexGrid(this);
+		Registry->WhenTerrainStageDone(this, Enum_TerrainWorkflowState::InitWorkflow, [this](ATerrain* InTerrain) {
+			OnTerrainReady(InTerrain);
+		});
+	}
 	CreateHexGridFlow();
 	StartCheckMouseOver();
 }
 
+void AHexGrid::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CancelWorkflow();
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->UnregisterHexGrid(this);
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
+void AHexGrid::Regenerate()
+{
+	CancelWorkflow();
+	ResetWorkflowData();
+	Profiler.Init(GetName(), StaticEnum<Enum_HexGridWorkflowState>());
+	WorkflowState = Enum_HexGridWorkflowState::InitWorkflow;
+
+	//Terrain may be regenerating too, wait for it again
+	Terrain = nullptr;
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->WhenTerrainStageDone(this, Enum_TerrainWorkflowState::InitWorkflow, [this](ATerrain* InTerrain) {
+			OnTerrainReady(InTerrain);
+		});
+	}
+	FlowControlUtility::ScheduleNextPoll(this, WorkflowDelegate, DefaultTimerRate);
+	UE_LOG(HexGrid, Log, TEXT("Regenerate hex grid!"));
+}
+
+void AHexGrid::CancelWorkflow()
+{
+	//Release the graph stages still waiting on the terrain, they are cancelled
+	if (!TerrainReadyEvent.IsCompleted()) {
+		TerrainReadyEvent.Trigger();
+	}
+	if (!TerrainHeightfieldEvent.IsCompleted()) {
+		TerrainHeightfieldEvent.Trigger();
+	}
+	Graph.CancelAndWait();
+	DataLoader.CancelAndWait();
+	FlowControlUtility::CancelScheduled(this, WorkflowDelegate);
+	//The write holds only its own copies, waiting keeps the file whole before a new run or teardown
+	if (SaveBakedCacheTask.IsValid()) {
+		SaveBakedCacheTask.Wait();
+		SaveBakedCacheTask = UE::Tasks::FTask();
+	}
+}
+
+void AHexGrid::ResetWorkflowData()
+{
+	//Tile columns go back to the loader, the next grid is built into the same allocations
+	DataLoader.Recycle(MoveTemp(Tiles), MoveTemp(TileIndices), MoveTemp(Adjacency));
+	Tiles.Reset();
+	TileIndices.Reset();
+	Adjacency.Reset();
+	Corners.Reset();
+
+	MaxWalkingBlockTileIndices.Reset();
+	WalkingBlockLevelsBack.Reset();
+	BuildingBlockLevelsBack.Reset();
+	MaxWalkingBlockTileChunks.Reset();
+	CheckWalkingConnectionReached.Reset();
+	CheckWalkingConnectionFrontier.Empty();
+	WalkingBlockLevelMax = 0;
+	BuildingBlockLevelMax = 0;
+	bBakedCacheHit = false;
+	bWorkflowFailed = false;
+	MouseOverHex = Hex();
+
+	HexInstMesh->ClearInstances();
+	MouseOverInstMesh->ClearInstances();
+	TerrainReadyEvent = UE::Tasks::FTaskEvent(TEXT("HexGridTerrainReady"));
+	TerrainHeightfieldEvent = UE::Tasks::FTaskEvent(TEXT("HexGridTerrainHeightfield"));
+	InitLoopData();
+}
+
 void AHexGrid::BindDelegate()
 {
 	WorkflowDelegate.BindUFunction(Cast<UObject>(this), TEXT("CreateHexGridFlow"));
@@ -142,22 +223,37 @@ void AHexGrid::CheckMouseOver()
 
 void AHexGrid::CreateHexGridFlow()
 {
+	WorkflowProfiler::FSliceScope Slice(Profiler, (int32)WorkflowState);
 	switch (WorkflowState)
 	{
 	case Enum_HexGridWorkflowState::InitWorkflow:
+		if (bRunWorkflowAsGraph) {
+			InitLoopData();
+			StartWorkflowGraph();
+			break;
+		}
 		InitWorkflow();
 		break;
+	case Enum_HexGridWorkflowState::WaitTerrainBounds:
+		WaitTerrainBounds();
+		break;
+	case Enum_HexGridWorkflowState::BuildGrid:
+		WaitLoadDataStep(HexGridDataLoader::EStep::Neighbors, Enum_HexGridWorkflowState::CreateTilesVertices);
+		break;
+	case Enum_HexGridWorkflowState::LoadBinaryData:
+		WaitLoadDataStep(HexGridDataLoader::EStep::Neighbors, Enum_HexGridWorkflowState::CreateTilesVertices);
+		break;
 	case Enum_HexGridWorkflowState::LoadParams:
-		LoadParamsFromFile();
+		WaitLoadDataStep(HexGridDataLoader::EStep::Params, Enum_HexGridWorkflowState::LoadTileIndices);
 		break;
 	case Enum_HexGridWorkflowState::LoadTileIndices:
-		LoadTileIndicesFromFile();
+		WaitLoadDataStep(HexGridDataLoader::EStep::TileIndices, Enum_HexGridWorkflowState::LoadTiles);
 		break;
 	case Enum_HexGridWorkflowState::LoadTiles:
-		LoadTilesFromFile();
+		WaitLoadDataStep(HexGridDataLoader::EStep::Tiles, Enum_HexGridWorkflowState::LoadNeighbors);
 		break;
 	case Enum_HexGridWorkflowState::LoadNeighbors:
-		LoadNeighborsFromFile();
+		WaitLoadDataStep(HexGridDataLoader::EStep::Neighbors, Enum_HexGridWorkflowState::CreateTilesVertices);
 		break;
 	case Enum_HexGridWorkflowState::CreateTilesVertices:
 		CreateTilesVertices();
@@ -165,11 +261,11 @@ void AHexGrid::CreateHexGridFlow()
 	case Enum_HexGridWorkflowState::WaitTerrain:
 		WaitTerrain();
 		break;
-	case Enum_HexGridWorkflowState::SetTilesPosZ:
-		SetTilesPosZ();
+	case Enum_HexGridWorkflowState::LoadBakedCache:
+		LoadBakedCache();
 		break;
-	case Enum_HexGridWorkflowState::CalTilesNormal:
-		CalTilesNormal();
+	case Enum_HexGridWorkflowState::SetTilesGeometry:
+		SetTilesGeometry();
 		break;
 	case Enum_HexGridWorkflowState::SetTilesWalkingBlockLevel:
 		SetTilesWalkingBlockLevel();
@@ -191,12 +287,19 @@ void AHexGrid::CreateHexGridFlow()
 	case Enum_HexGridWorkflowState::SetTilesBuildingBlockLevelEx:
 		SetTilesBuildingBlockLevelEx();
 		break;
+	case Enum_HexGridWorkflowState::SaveBakedCache:
+		SaveBakedCache();
+		break;
 	case Enum_HexGridWorkflowState::DrawMesh:
 		AddTilesInstance();
 		break;
 	case Enum_HexGridWorkflowState::Done:
+		NotifyStageDone();
+		Profiler.Finish();
 		break;
 	case Enum_HexGridWorkflowState::Error:
+		NotifyStageDone();
+		Profiler.Finish();
 		UE_LOG(HexGrid, Warning, TEXT("CreateHexGridFlow Error!"));
 		break;
 	default:
@@ -207,23 +310,16 @@ void AHexGrid::CreateHexGridFlow()
 void AHexGrid::InitWorkflow()
 {
 	InitLoopData();
+	InitStageParams();
+	StartLoadData();
 
-	FTimerHandle TimerHandle;
-	WorkflowState = Enum_HexGridWorkflowState::LoadParams;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
 	UE_LOG(HexGrid, Log, TEXT("Init workflow done!"));
 }
 
 void AHexGrid::InitLoopData()
 {
-	FlowControlUtility::InitLoopData(LoadTileIndicesLoopData);
-	FlowControlUtility::InitLoopData(LoadTilesLoopData);
-	FlowControlUtility::InitLoopData(LoadNeighborsLoopData);
-	LoadNeighborsLoopData.IndexSaved[0] = 1;
-	FlowControlUtility::InitLoopData(CreateTilesVerticesLoopData);
-
-	FlowControlUtility::InitLoopData(SetTilesPosZLoopData);
-	FlowControlUtility::InitLoopData(CalTilesNormalLoopData);
+	FlowControlUtility::InitLoopData(SetTilesGeometryLoopData);
 	FlowControlUtility::InitLoopData(SetTilesWalkingBlockLevelLoopData);
 	FlowControlUtility::InitLoopData(SetTilesWalkingBlockLevelExLoopData);
 	FlowControlUtility::InitLoopData(BreakMaxWalkingBlockTilesToChunkLoopData);
@@ -234,480 +330,476 @@ void AHexGrid::InitLoopData()
 	FlowControlUtility::InitLoopData(AddTilesInstanceLoopData);
 }
 
-bool AHexGrid::GetValidFilePath(const FString& RelPath, FString& FullPath)
+void AHexGrid::InitStageParams()
 {
-	bool flag = false;
-	FullPath = FPaths::ProjectDir().Append(RelPath);
-	if (FPaths::FileExists(FullPath)) {
-		flag = true;
-	}
-	return flag;
+	//Read on the game thread before the stages start, graph stages run on worker threads
+	HexInstMeshUpVec = HexInstMesh->GetUpVector();
+	//Building is never looser than walking, the edited properties stay as they are
+	BuildingAltitudeRatio = FMath::Min(BuildingBlockAltitudeRatio, WalkingBlockAltitudeRatio);
+	BuildingSlopeRatio = FMath::Min(BuildingBlockSlopeRatio, WalkingBlockSlopeRatio);
 }
 
-void AHexGrid::LoadParamsFromFile()
+void AHexGrid::StartWorkflowGraph()
 {
-	FTimerHandle TimerHandle;
-	FString FullPath;
-	if (!GetValidFilePath(ParamsDataPath, FullPath)) {
-		UE_LOG(HexGrid, Warning, TEXT("Params data file %s not exist!"), *ParamsDataPath);
-		WorkflowState = Enum_HexGridWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
+	auto Stage = [this](TFunction<void()> Work) {
+		return [this, Work]() {
+			if (!bWorkflowFailed) {
+				Work();
+			}
+		};
+	};
+	//Terrain passes, all skipped when the baked cache hits
+	auto TerrainStage = [this](TFunction<void()> Work) {
+		return [this, Work]() {
+			if (!bWorkflowFailed && !bBakedCacheHit) {
+				Work();
+			}
+		};
+	};
+	//Graph stages overlap, so each call is timed under its own state rather than the current one
+	using EState = Enum_HexGridWorkflowState;
+	auto Profiled = [this](EState State, void (AHexGrid::*Function)()) {
+		Profiler.Run((int32)State, [this, Function]() { (this->*Function)(); });
+	};
+
+	//Data files load while the terrain inits, only the procedural grid needs terrain bounds.
+	//Walking and building block levels both read only heights and normals, so they overlap.
+	bWorkflowFailed = false;
+	GraphWorkflowState = Enum_HexGridWorkflowState::InitWorkflow;
+	InitStageParams();
+	Graph.Reset();
+	int32 WaitTerrainInit = Graph.AddStage(TEXT("HexGridWaitTerrain"), {}, [this]() {
+		WorkflowProfiler::FSliceScope Slice(Profiler, (int32)EState::WaitTerrain);
+		if (Terrain == nullptr) {
+			SetWorkflowState(Enum_HexGridWorkflowState::Error);
+		}
+	}, true);
+	Graph.AddPrerequisite(WaitTerrainInit,
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, []() {}, UE::Tasks::Prerequisites(TerrainReadyEvent)));
+
+	TArray<int32> LoadDependencies;
+	if (bBuildProcedural) {
+		LoadDependencies.Add(WaitTerrainInit);
+	}
+	//The loader tasks are nested in the load stage, its slice only times starting them
+	FString BinaryPath;
+	EState LoadState = GetLoadDataState(BinaryPath);
+	int32 Load = Graph.AddStage(TEXT("HexGridLoad"), LoadDependencies, Stage([Profiled, LoadState]() {
+		Profiled(LoadState, &AHexGrid::StartGraphLoadData);
+	}));
+	int32 Publish = Graph.AddStage(TEXT("HexGridPublish"), { Load }, Stage([Profiled]() {
+		Profiled(EState::LoadNeighbors, &AHexGrid::FinishGraphLoadData);
+	}));
+	int32 Vertices = Graph.AddStage(TEXT("HexGridVertices"), { Publish }, Stage([Profiled]() {
+		Profiled(EState::CreateTilesVertices, &AHexGrid::CreateTilesVertices);
+	}));
+	int32 BakedCache = Graph.AddStage(TEXT("HexGridLoadBakedCache"), { Vertices, WaitTerrainInit }, Stage([Profiled]() {
+		Profiled(EState::LoadBakedCache, &AHexGrid::LoadBakedCache);
+	}));
+	int32 Geometry = Graph.AddStage(TEXT("HexGridGeometry"), { BakedCache }, TerrainStage([Profiled]() {
+		Profiled(EState::SetTilesGeometry, &AHexGrid::SetTilesGeometry);
+	}));
+	Graph.AddPrerequisite(Geometry,
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, []() {}, UE::Tasks::Prerequisites(TerrainHeightfieldEvent)));
+	int32 Walking = Graph.AddStage(TEXT("HexGridWalkingBlock"), { Geometry }, TerrainStage([Profiled]() {
+		Profiled(EState::SetTilesWalkingBlockLevel, &AHexGrid::SetTilesWalkingBlockLevel);
+		Profiled(EState::SetTilesWalkingBlockLevelEx, &AHexGrid::SetTilesWalkingBlockLevelEx);
+	}));
+	int32 Connection = Graph.AddStage(TEXT("HexGridWalkingConnection"), { Walking }, TerrainStage([Profiled]() {
+		Profiled(EState::InitCheckTerrainWalkingConnection, &AHexGrid::InitCheckTerrainWalkingConnection);
+		Profiled(EState::BreakMaxWalkingBlockTilesToChunk, &AHexGrid::BreakMaxWalkingBlockTilesToChunk);
+		Profiled(EState::CheckChunksWalkingConnection, &AHexGrid::CheckChunksWalkingConnection);
+	}));
+	int32 Island = Graph.AddStage(TEXT("HexGridIsland"), { Connection }, TerrainStage([Profiled]() {
+		Profiled(EState::FindTilesIsland, &AHexGrid::FindTilesIsland);
+	}));
+	int32 Building = Graph.AddStage(TEXT("HexGridBuildingBlock"), { Geometry }, TerrainStage([Profiled]() {
+		Profiled(EState::SetTilesBuildingBlockLevel, &AHexGrid::SetTilesBuildingBlockLevel);
+		Profiled(EState::SetTilesBuildingBlockLevelEx, &AHexGrid::SetTilesBuildingBlockLevelEx);
+	}));
+	Graph.AddStage(TEXT("HexGridSaveBakedCache"), { Island, Building }, TerrainStage([Profiled]() {
+		Profiled(EState::SaveBakedCache, &AHexGrid::SaveBakedCache);
+	}));
+
+	//Instances are added on the game thread, the timer workflow takes over
+	Graph.Launch(WorkflowDelegate, [this]() {
+		WorkflowState = bWorkflowFailed ? Enum_HexGridWorkflowState::Error : Enum_HexGridWorkflowState::DrawMesh;
+		FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+	});
+	UE_LOG(HexGrid, Log, TEXT("Start workflow graph!"));
+}
+
+void AHexGrid::SetWorkflowState(Enum_HexGridWorkflowState State)
+{
+	if (!FlowControlUtility::IsUnsliced(WorkflowDelegate)) {
+		if (State == Enum_HexGridWorkflowState::Error) {
+			bWorkflowFailed = true;
+		}
+		WorkflowState = State;
 		return;
 	}
-
-	DataLoadStream.open(*FullPath, std::ios::in);
-
-	if (!DataLoadStream || !DataLoadStream.is_open()) {
-		UE_LOG(HexGrid, Warning, TEXT("Open file %s failed!"), *FullPath);
-		WorkflowState = Enum_HexGridWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
+	//Graph stages overlap on worker threads, an error is left to the completion and only the furthest state shows
+	if (State == Enum_HexGridWorkflowState::Error) {
+		bWorkflowFailed = true;
 		return;
 	}
-	LoadParams(DataLoadStream);
+	Enum_HexGridWorkflowState Furthest = GraphWorkflowState;
+	while (Furthest < State && !GraphWorkflowState.compare_exchange_weak(Furthest, State))
+	{
+	}
+	AsyncTask(ENamedThreads::GameThread, [WeakThis = TWeakObjectPtr<AHexGrid>(this)]() {
+		if (AHexGrid* This = WeakThis.Get()) {
+			This->PublishGraphWorkflowState();
+		}
+	});
 }
 
-void AHexGrid::LoadParams(std::ifstream& ifs)
+void AHexGrid::PublishGraphWorkflowState()
 {
-	FTimerHandle TimerHandle;
-	std::string line;
-	std::getline(ifs, line);
-	FString fline(line.c_str());
-	if (!ParseParams(fline)) {
-		ifs.close();
-		UE_LOG(HexGrid, Warning, TEXT("Parse Parameters error!"));
-		WorkflowState = Enum_HexGridWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
-		return;
+	//Dropped once the graph is done or cancelled, the completion has set the state then
+	Enum_HexGridWorkflowState State = GraphWorkflowState;
+	if (Graph.IsRunning() && !bWorkflowFailed && State > WorkflowState) {
+		WorkflowState = State;
+		NotifyStageDone();
 	}
-
-	ifs.close();
-	WorkflowState = Enum_HexGridWorkflowState::LoadTileIndices;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
-	UE_LOG(HexGrid, Log, TEXT("Load params done!"));
 }
 
-bool AHexGrid::ParseParams(const FString& line)
+void AHexGrid::StartGraphLoadData()
 {
-	TArray<FString> StrArr;
-	line.ParseIntoArray(StrArr, *PipeDelim, true);
-
-	if (StrArr.Num() != ParamNum) {
-		return false;
+	if (bBuildProcedural) {
+		DataLoader.StartProcedural(TileSize, GridRange, NeighborRange, FVector2D(Terrain->GetWidth(), Terrain->GetHeight()));
+		SetWorkflowState(Enum_HexGridWorkflowState::BuildGrid);
 	}
-
-	TileSize = UKismetStringLibrary::Conv_StringToFloat(StrArr[0]);
-	GridRange = UKismetStringLibrary::Conv_StringToInt(StrArr[1]);
-	NeighborRange = UKismetStringLibrary::Conv_StringToInt(StrArr[2]);
-	return true;
+	else {
+		StartLoadData();
+	}
+	//The stage completes with the loader tasks
+	UE::Tasks::AddNested(DataLoader.GetCompletionTask());
 }
 
-void AHexGrid::LoadTileIndicesFromFile()
+void AHexGrid::FinishGraphLoadData()
 {
-	FTimerHandle TimerHandle;
-	FString FullPath;
-	if (!GetValidFilePath(TileIndicesDataPath, FullPath)) {
-		UE_LOG(HexGrid, Warning, TEXT("TileIndices data file %s not exist!"), *TileIndicesDataPath);
-		WorkflowState = Enum_HexGridWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadTileIndicesLoopData.Rate, false);
+	bool Success = false;
+	DataLoader.IsStepCompleted(HexGridDataLoader::EStep::Neighbors, Success);
+	if (!Success) {
+		UE_LOG(HexGrid, Warning, TEXT("Load data failed!"));
+		SetWorkflowState(Enum_HexGridWorkflowState::Error);
 		return;
 	}
-
-	if (!LoadTileIndicesLoopData.HasInitialized) {
-		LoadTileIndicesLoopData.HasInitialized = true;
-		DataLoadStream.open(*FullPath, std::ios::in);
-	}
-
-	if (!DataLoadStream || !DataLoadStream.is_open()) {
-		UE_LOG(HexGrid, Warning, TEXT("Open file %s failed!"), *FullPath);
-		WorkflowState = Enum_HexGridWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadTileIndicesLoopData.Rate, false);
-		return;
+	if (!bBuildProcedural) {
+		DataLoader.GetParams(TileSize, GridRange, NeighborRange);
 	}
-
-	LoadTileIndices(DataLoadStream);
+	PublishLoadData();
+	SetWorkflowState(Enum_HexGridWorkflowState::CreateTilesVertices);
+	UE_LOG(HexGrid, Log, TEXT("Load data done!"));
 }
 
-void AHexGrid::LoadTileIndices(std::ifstream& ifs)
+bool AHexGrid::GetValidFilePath(const FString& RelPath, FString& FullPath)
 {
-	int32 Count = 0;
-	TArray<int32> Indices = { 0 };
-	bool SaveLoopFlag = false;
-
-	std::string line;
-	while (std::getline(ifs, line))
-	{
-		FString fline(line.c_str());
-		ParseTileIndexLine(fline);
-		Count++;
-
-		FlowControlUtility::SaveLoopData(this, LoadTileIndicesLoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-		if (SaveLoopFlag) {
-			return;
-		}
+	bool flag = false;
+	FullPath = FPaths::ProjectDir().Append(RelPath);
+	if (FPaths::FileExists(FullPath)) {
+		flag = true;
 	}
-
-	ifs.close();
-	FTimerHandle TimerHandle;
-	WorkflowState = Enum_HexGridWorkflowState::LoadTiles;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadTileIndicesLoopData.Rate, false);
-	UE_LOG(HexGrid, Log, TEXT("Load tile indices done!"));
+	return flag;
 }
 
-void AHexGrid::ParseTileIndexLine(const FString& line)
+Enum_HexGridWorkflowState AHexGrid::GetLoadDataState(FString& Out_BinaryPath)
 {
-	TArray<FString> StrArr;
-	FIntPoint key;
-	int32 value;
-	line.ParseIntoArray(StrArr, *PipeDelim, true);
-	ParseIntPoint(StrArr[0], key);
-	ParseInt(StrArr[1], value);
-	TileIndices.Add(key, value);
-
+	if (bBuildProcedural) {
+		return Enum_HexGridWorkflowState::BuildGrid;
+	}
+	if (bUseBinaryData && GetValidFilePath(BinaryDataPath, Out_BinaryPath)) {
+		return Enum_HexGridWorkflowState::LoadBinaryData;
+	}
+	return Enum_HexGridWorkflowState::LoadParams;
 }
 
-void AHexGrid::LoadTilesFromFile()
+void AHexGrid::StartLoadData()
 {
-	FTimerHandle TimerHandle;
 	FString FullPath;
-	if (!GetValidFilePath(TilesDataPath, FullPath)) {
-		UE_LOG(HexGrid, Warning, TEXT("Tiles data file %s not exist!"), *TilesDataPath);
-		WorkflowState = Enum_HexGridWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadTilesLoopData.Rate, false);
+	Enum_HexGridWorkflowState LoadState = GetLoadDataState(FullPath);
+	if (LoadState == Enum_HexGridWorkflowState::BuildGrid) {
+		SetWorkflowState(Enum_HexGridWorkflowState::WaitTerrainBounds);
 		return;
 	}
-
-	if (!LoadTilesLoopData.HasInitialized) {
-		LoadTilesLoopData.HasInitialized = true;
-		DataLoadStream.open(*FullPath, std::ios::in);
-	}
-
-	if (!DataLoadStream || !DataLoadStream.is_open()) {
-		UE_LOG(HexGrid, Warning, TEXT("Open file %s failed!"), *FullPath);
-		WorkflowState = Enum_HexGridWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadTilesLoopData.Rate, false);
+	if (LoadState == Enum_HexGridWorkflowState::LoadBinaryData) {
+		DataLoader.StartBinary(FullPath);
+		SetWorkflowState(Enum_HexGridWorkflowState::LoadBinaryData);
 		return;
 	}
 
-	LoadTiles(DataLoadStream);
-}
-
-void AHexGrid::LoadTiles(std::ifstream& ifs)
-{
-	int32 Count = 0;
-	TArray<int32> Indices = { 0 };
-	bool SaveLoopFlag = false;
-
-	std::string line;
-	while (std::getline(ifs, line))
-	{
-		FString fline(line.c_str());
-		FStructHexTileData Data;
-		ParseTileLine(fline, Data);
-		Tiles.Add(Data);
-		Count++;
-
-		FlowControlUtility::SaveLoopData(this, LoadTilesLoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-		if (SaveLoopFlag) {
-			return;
-		}
+	if (bUseBinaryData) {
+		UE_LOG(HexGrid, Log, TEXT("Binary data file %s not exist, load text data files!"), *BinaryDataPath);
 	}
-
-	ifs.close();
-	FTimerHandle TimerHandle;
-	WorkflowState = Enum_HexGridWorkflowState::LoadNeighbors;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadTilesLoopData.Rate, false);
-	UE_LOG(HexGrid, Log, TEXT("Load tiles done!"));
+	FString ProjectDir = FPaths::ProjectDir();
+	DataLoader.StartText(ProjectDir + ParamsDataPath, ProjectDir + TileIndicesDataPath, ProjectDir + TilesDataPath,
+		ProjectDir + NeighborsDataPathPrefix, ParamNum);
+	SetWorkflowState(Enum_HexGridWorkflowState::LoadParams);
 }
 
-void AHexGrid::ParseTileLine(const FString& line, FStructHexTileData& Data)
+void AHexGrid::WaitTerrainBounds()
 {
-	TArray<FString> StrArr;
-	line.ParseIntoArray(StrArr, *PipeDelim, true);
-	ParseAxialCoord(StrArr[0], Data);
-	ParsePosition2D(StrArr[1], Data);
-}
-
-void AHexGrid::ParseIndex(const FString& ValueStr, const FString& KeyStr)
-{
-	FIntPoint key;
-	int32 value;
-	ParseIntPoint(KeyStr, key);
-	ParseInt(ValueStr, value);
-	TileIndices.Add(key, value);
-}
-
-void AHexGrid::ParseAxialCoord(const FString& Str, FStructHexTileData& Data)
-{
-	ParseIntPoint(Str, Data.AxialCoord);
-}
-
-void AHexGrid::ParsePosition2D(const FString& Str, FStructHexTileData& Data)
-{
-	ParseVector2D(Str, Data.Position2D);
+	//OnTerrainReady runs the workflow again
+	if (Terrain != nullptr) {
+		DataLoader.StartProcedural(TileSize, GridRange, NeighborRange, FVector2D(Terrain->GetWidth(), Terrain->GetHeight()));
+		SetWorkflowState(Enum_HexGridWorkflowState::BuildGrid);
+		FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+		UE_LOG(HexGrid, Log, TEXT("Wait terrain bounds done!"));
+	}
 }
 
-void AHexGrid::LoadNeighborsFromFile()
+void AHexGrid::WaitLoadDataStep(HexGridDataLoader::EStep Step, Enum_HexGridWorkflowState NextState)
 {
-	int32 i = LoadNeighborsLoopData.IndexSaved[0];
-	FTimerHandle TimerHandle;
-
-	for (; i <= NeighborRange; i++)
-	{
-		FString NeighborPath;
-		FString FullPath;
-		CreateNeighborPath(NeighborPath, i);
-
-		if (!GetValidFilePath(NeighborPath, FullPath)) {
-			UE_LOG(HexGrid, Warning, TEXT("Neighbor path file %s not exist!"), *NeighborPath);
-			WorkflowState = Enum_HexGridWorkflowState::Error;
-			GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadNeighborsLoopData.Rate, false);
-			return;
+	bool Success = false;
+	if (DataLoader.IsStepCompleted(Step, Success)) {
+		if (!Success) {
+			UE_LOG(HexGrid, Warning, TEXT("Load data failed at state %d!"), (int32)WorkflowState);
+			SetWorkflowState(Enum_HexGridWorkflowState::Error);
 		}
-
-		if (!LoadNeighborsLoopData.HasInitialized) {
-			LoadNeighborsLoopData.HasInitialized = true;
-			DataLoadStream.open(*FullPath, std::ios::in);
-		}
-
-		if (!DataLoadStream || !DataLoadStream.is_open()) {
-			UE_LOG(HexGrid, Warning, TEXT("Open file %s failed!"), *FullPath);
-			WorkflowState = Enum_HexGridWorkflowState::Error;
-			GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadNeighborsLoopData.Rate, false);
-			return;
-		}
-		if (!LoadNeighbors(DataLoadStream, i)) {
-			return;
+		else {
+			switch (WorkflowState)
+			{
+			case Enum_HexGridWorkflowState::LoadParams:
+				DataLoader.GetParams(TileSize, GridRange, NeighborRange);
+				UE_LOG(HexGrid, Log, TEXT("Load params done!"));
+				break;
+			case Enum_HexGridWorkflowState::LoadTileIndices:
+				UE_LOG(HexGrid, Log, TEXT("Load tile indices done!"));
+				break;
+			case Enum_HexGridWorkflowState::LoadTiles:
+				UE_LOG(HexGrid, Log, TEXT("Load tiles done!"));
+				break;
+			case Enum_HexGridWorkflowState::BuildGrid:
+				PublishLoadData();
+				UE_LOG(HexGrid, Log, TEXT("Build grid done!"));
+				break;
+			case Enum_HexGridWorkflowState::LoadBinaryData:
+				DataLoader.GetParams(TileSize, GridRange, NeighborRange);
+				PublishLoadData();
+				UE_LOG(HexGrid, Log, TEXT("Load binary data done!"));
+				break;
+			case Enum_HexGridWorkflowState::LoadNeighbors:
+				PublishLoadData();
+				UE_LOG(HexGrid, Log, TEXT("Load neighbors done!"));
+				break;
+			default:
+				break;
+			}
+			SetWorkflowState(NextState);
 		}
+		FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+		return;
 	}
-
-	WorkflowState = Enum_HexGridWorkflowState::CreateTilesVertices;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoadNeighborsLoopData.Rate, false);
-	UE_LOG(HexGrid, Log, TEXT("Load neighbors done!"));
+	FlowControlUtility::ScheduleNextPoll(this, WorkflowDelegate, DefaultTimerRate);
 }
 
-void AHexGrid::CreateNeighborPath(FString& NeighborPath, int32 Radius)
+void AHexGrid::PublishLoadData()
 {
-	NeighborPath.Append(NeighborsDataPathPrefix).Append(FString::FromInt(Radius)).Append(FString(TEXT(".data")));
+	DataLoader.Publish(Tiles, TileIndices, Adjacency);
 }
 
-bool AHexGrid::LoadNeighbors(std::ifstream& ifs, int32 Radius)
+template<typename KernelType>
+bool AHexGrid::TilesLoopFunction(TFunction<void()> InitFunc, const KernelType& Kernel, FStructLoopData& LoopData,
+	Enum_HexGridWorkflowState State, bool bGameThread)
 {
-	int32 Count = 0;
-	TArray<int32> Indices = { Radius, 0 };
-	bool SaveLoopFlag = false;
-
-	int32 i = LoadNeighborsLoopData.IndexSaved[1];
-	std::string line;
-	while (std::getline(ifs, line))
-	{
-		FString fline(line.c_str());
-		ParseNeighborsLine(fline, i, Radius);
-		i++;
-		Count++;
-		Indices[1] = i;
-		FlowControlUtility::SaveLoopData(this, LoadNeighborsLoopData, Count * Radius, Indices, WorkflowDelegate, SaveLoopFlag);
-		if (SaveLoopFlag) {
-			return false;
-		}
+	if (InitFunc && LoopData.Count == 0) {
+		InitFunc();
 	}
 
-	ifs.close();
-	FlowControlUtility::InitLoopData(LoadNeighborsLoopData);
-	LoadNeighborsLoopData.IndexSaved[0] = Radius;
-	UE_LOG(HexGrid, Log, TEXT("Load neighbor N%d done!"), Radius);
-	return true;
-}
-
-void AHexGrid::ParseNeighborsLine(const FString& Str, int32 Index, int32 Radius)
-{
-	ParseNeighbors(Str, Index, Radius);
-}
-
-void AHexGrid::ParseNeighbors(const FString& Str, int32 Index, int32 Radius)
-{
-	FStructHexTileNeighbors Neighbors;
-	Neighbors.Radius = Radius;
-	int32 Count = 0;
-	TArray<FString> StrArr;
-	Str.ParseIntoArray(StrArr, *SpaceDelim, true);
-	for (int32 i = 0; i < StrArr.Num(); i++)
-	{
-		FIntPoint Point;
-		ParseIntPoint(StrArr[i], Point);
-		if (TileIndices.Contains(Point)) {
-			Neighbors.Tiles.Add(Point);
-			Count++;
+	//Each slice chunk fans out to the workers, yields stay between chunks
+	bool LoopDone = FlowControlUtility::RunChunks(this, LoopData, Tiles.Num(), WorkflowDelegate, [&Kernel, bGameThread](int32 Begin, int32 End) {
+		if (!bGameThread) {
+			HexGridTileKernel::Run(Begin, End, Kernel);
+			return;
+		}
+		for (int32 i = Begin; i < End; i++)
+		{
+			Kernel(i);
 		}
+	});
+	if (!LoopDone) {
+		return false;
 	}
-	Neighbors.Count = Count;
-	Tiles[Index].Neighbors.Add(Neighbors);
-}
 
-void AHexGrid::ParseIntPoint(const FString& Str, FIntPoint& Point)
-{
-	TArray<FString> StrArr;
-	Str.ParseIntoArray(StrArr, *CommaDelim, true);
-	Point.X = UKismetStringLibrary::Conv_StringToInt(StrArr[0]);
-	Point.Y = UKismetStringLibrary::Conv_StringToInt(StrArr[1]);
+	SetWorkflowState(State);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, LoopData.Rate);
+	return true;
 }
 
-void AHexGrid::ParseVector2D(const FString& Str, FVector2D& Vec2D)
+void AHexGrid::CreateTilesVertices()
 {
-	TArray<FString> StrArr;
-	Str.ParseIntoArray(StrArr, *CommaDelim, true);
-	Vec2D.X = UKismetStringLibrary::Conv_StringToFloat(StrArr[0]);
-	Vec2D.Y = UKismetStringLibrary::Conv_StringToFloat(StrArr[1]);
-}
+	Tiles.InitTerrainColumns();
+	Corners.Build(Tiles, TileIndices, TileSize);
 
-void AHexGrid::ParseVector(const FString& Str, FVector& Vec)
-{
-	TArray<FString> StrArr;
-	Str.ParseIntoArray(StrArr, *CommaDelim, true);
-	Vec.X = UKismetStringLibrary::Conv_StringToFloat(StrArr[0]);
-	Vec.Y = UKismetStringLibrary::Conv_StringToFloat(StrArr[1]);
-	Vec.Z = UKismetStringLibrary::Conv_StringToFloat(StrArr[2]);
+	SetWorkflowState(Enum_HexGridWorkflowState::WaitTerrain);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+	UE_LOG(HexGrid, Log, TEXT("Create tiles vertices done! Corners=%d Tiles=%d"), Corners.Num(), Tiles.Num());
 }
 
-void AHexGrid::ParseInt(const FString& Str, int32& value)
+void AHexGrid::WaitTerrain()
 {
-	value = UKismetStringLibrary::Conv_StringToInt(Str);
+	//OnTerrainReady runs the workflow again, the heightfield after it is polled
+	if (Terrain != nullptr && !TerrainHeightfieldEvent.IsCompleted()) {
+		FlowControlUtility::ScheduleNextPoll(this, WorkflowDelegate, DefaultTimerRate);
+	}
+	else if (Terrain != nullptr) {
+		SetWorkflowState(Enum_HexGridWorkflowState::LoadBakedCache);
+		FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+		UE_LOG(HexGrid, Log, TEXT("Wait terrain noise done!"));
+	}
 }
 
-bool AHexGrid::TilesLoopFunction(TFunction<void()> InitFunc, TFunction<void(int32 LoopIndex)> LoopFunc,
-	FStructLoopData& LoopData, Enum_HexGridWorkflowState State)
+void AHexGrid::OnTerrainReady(ATerrain* InTerrain)
 {
-	int32 Count = 0;
-	TArray<int32> Indices = { 0 };
-	bool SaveLoopFlag = false;
-
-	if (InitFunc && !LoopData.HasInitialized) {
-		LoopData.HasInitialized = true;
-		InitFunc();
+	Terrain = InTerrain;
+	if (!TerrainReadyEvent.IsCompleted()) {
+		TerrainReadyEvent.Trigger();
 	}
-
-	int32 i = LoopData.IndexSaved[0];
-	for (; i < Tiles.Num(); i++)
-	{
-		Indices[0] = i;
-		FlowControlUtility::SaveLoopData(this, LoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-		if (SaveLoopFlag) {
-			return false;
+	//Passed on from a task, a cancelled run has already triggered this event and replaced it
+	UE::Tasks::Launch(UE_SOURCE_LOCATION, [HeightfieldEvent = TerrainHeightfieldEvent]() mutable {
+		if (!HeightfieldEvent.IsCompleted()) {
+			HeightfieldEvent.Trigger();
 		}
-		LoopFunc(i);
-		Count++;
+	}, UE::Tasks::Prerequisites(Terrain->GetHeightfieldReadyEvent()));
+	//The graph waits on the events, the states it publishes are not waits of the timer workflow
+	if (!Graph.IsRunning() && (WorkflowState == Enum_HexGridWorkflowState::WaitTerrainBounds
+		|| WorkflowState == Enum_HexGridWorkflowState::WaitTerrain)) {
+		FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
 	}
-
-	FTimerHandle TimerHandle;
-	WorkflowState = State;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, LoopData.Rate, false);
-	return true;
 }
 
-void AHexGrid::CreateTilesVertices()
+void AHexGrid::NotifyStageDone()
 {
-	if (TilesLoopFunction([this]() { InitTileVerticesVertors(); }, [this](int32 i) { CreateTileVertices(i); },
-		CreateTilesVerticesLoopData, Enum_HexGridWorkflowState::WaitTerrain)) {
-		UE_LOG(HexGrid, Log, TEXT("Parse tiles vertices done!"));
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->NotifyHexGridStageDone(this, WorkflowState);
 	}
 }
 
-void AHexGrid::InitTileVerticesVertors()
+void AHexGrid::LoadBakedCache()
 {
-	FVector Vec(1.0, 0.0, 0.0);
-	FVector ZAxis(0.0, 0.0, 1.0);
-	for (int32 i = 0; i <= 5; i++)
-	{
-		FVector TileVector = Vec.RotateAngleAxis(i * 60, ZAxis) * TileSize;
-		TileVerticesVectors.Add(TileVector);
+	SetWorkflowState(Enum_HexGridWorkflowState::SetTilesGeometry);
+	bBakedCacheHit = false;
+	if (bUseBakedCache) {
+		BakedCacheKey = MakeBakedCacheKey();
+		if (HexGridBakedCache::Load(FPaths::ProjectSavedDir() / BakedCachePath, BakedCacheKey, Tiles, Corners)) {
+			WalkingBlockLevelMax = NeighborRange * 2 + 1;
+			BuildingBlockLevelMax = NeighborRange * 2 + 1;
+			bBakedCacheHit = true;
+			SetWorkflowState(Enum_HexGridWorkflowState::DrawMesh);
+		}
 	}
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+	UE_LOG(HexGrid, Log, TEXT("Load baked cache done, %s!"),
+		bBakedCacheHit ? TEXT("hit") : TEXT("miss"));
 }
 
-void AHexGrid::CreateTileVertices(int32 Index)
+void AHexGrid::SaveBakedCache()
 {
-	FVector Center(Tiles[Index].Position2D.X, Tiles[Index].Position2D.Y, 0);
-	for (int32 i = 0; i <= 5; i++) {
-		FVector Vertex = Center + TileVerticesVectors[i];
-		Tiles[Index].VerticesPostion2D.Add(FVector2D(Vertex.X, Vertex.Y));
+	if (bUseBakedCache) {
+		//Write a copy on a worker thread, the game thread keeps drawing
+		TSharedPtr<HexGridTileStore> TilesCopy = MakeShared<HexGridTileStore>(Tiles);
+		TSharedPtr<HexGridCornerLattice> CornersCopy = MakeShared<HexGridCornerLattice>(Corners);
+		FString FullPath = FPaths::ProjectSavedDir() / BakedCachePath;
+		uint64 Key = BakedCacheKey;
+		//One writer per cache file, a new save runs after the last one instead of blocking this stage
+		SaveBakedCacheTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [FullPath, Key, TilesCopy, CornersCopy]() {
+			HexGridBakedCache::Save(FullPath, Key, *TilesCopy, *CornersCopy);
+		}, UE::Tasks::Prerequisites(SaveBakedCacheTask));
 	}
+
+	SetWorkflowState(Enum_HexGridWorkflowState::DrawMesh);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+	UE_LOG(HexGrid, Log, TEXT("Save baked cache started!"));
 }
 
-void AHexGrid::WaitTerrain()
+uint64 AHexGrid::MakeBakedCacheKey()
 {
-	FTimerHandle TimerHandle;
-	TArray<AActor*> Out_Actors;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), ATerrain::StaticClass(), Out_Actors);
-	if (Out_Actors.Num() == 1) {
-		Terrain = (ATerrain*)Out_Actors[0];
-		if (Terrain->IsWorkFlowStepDone(Enum_TerrainWorkflowState::InitWorkflow)) {
-			WorkflowState = Enum_HexGridWorkflowState::SetTilesPosZ;
-			GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
-			UE_LOG(HexGrid, Log, TEXT("Wait terrain noise done!"));
-			return;
-		}
-	}
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
-	return;
+	FXxHash64Builder Builder;
+	HexGridBakedCache::HashGrid(Builder, Tiles, Adjacency);
+	Terrain->HashAltitudeParams(Builder);
+	HexGridBakedCache::HashValue(Builder, TileSize);
+	HexGridBakedCache::HashValue(Builder, NeighborRange);
+	HexGridBakedCache::HashValue(Builder, WalkingBlockAltitudeRatio);
+	HexGridBakedCache::HashValue(Builder, WalkingBlockSlopeRatio);
+	HexGridBakedCache::HashValue(Builder, BuildingAltitudeRatio);
+	HexGridBakedCache::HashValue(Builder, BuildingSlopeRatio);
+	HexGridBakedCache::HashValue(Builder, HexInstMeshUpVec);
+	return Builder.Finalize().Hash;
 }
 
-void AHexGrid::SetTilesPosZ()
+void AHexGrid::SetTilesGeometry()
 {
-	if (TilesLoopFunction(nullptr, [this](int32 i) { SetTilePosZ(i); },
-		SetTilesPosZLoopData, Enum_HexGridWorkflowState::CalTilesNormal)) {
-		UE_LOG(HexGrid, Log, TEXT("Set tiles pos z done!"));
+	//[0, TileNum) samples the heights, [TileNum, 2 * TileNum) the normals, which read corners of neighbors.
+	//Chunks run in order, so all heights are set before the first normal.
+	int32 TileNum = Tiles.Num();
+	if (SetTilesGeometryLoopData.Count == 0) {
+		InitSetTilesGeometry();
 	}
-}
 
-void AHexGrid::SetTilePosZ(int32 Index)
-{
-	SetTileCenterPosZ(Tiles[Index]);
-	SetTileVerticesPosZ(Tiles[Index]);
-}
+	bool LoopDone = FlowControlUtility::RunChunks(this, SetTilesGeometryLoopData, TileNum * 2, WorkflowDelegate,
+		[this, TileNum](int32 Begin, int32 End) {
+			if (Begin < TileNum) {
+				HexGridTileKernel::RunRanges(Begin, FMath::Min(End, TileNum), [this](int32 RangeBegin, int32 RangeEnd) {
+					SetTilesPosZ(RangeBegin, RangeEnd);
+				});
+			}
+			if (End > TileNum) {
+				HexGridTileKernel::Run(FMath::Max(Begin, TileNum) - TileNum, End - TileNum, [this](int32 i) { CalTileNormal(i); });
+			}
+		});
+	if (!LoopDone) {
+		return;
+	}
 
-void AHexGrid::SetTileCenterPosZ(FStructHexTileData& Data)
-{
-	Data.PositionZ = Terrain->GetAltitudeByPos2D(Data.Position2D, this);
+	SetWorkflowState(Enum_HexGridWorkflowState::SetTilesWalkingBlockLevel);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, SetTilesGeometryLoopData.Rate);
+	UE_LOG(HexGrid, Log, TEXT("Set tiles geometry done!"));
 }
 
-void AHexGrid::SetTileVerticesPosZ(FStructHexTileData& Data)
+void AHexGrid::InitSetTilesGeometry()
 {
-	float Sum = 0.0;
-	for (int32 i = 0; i <= 5; i++) {
-		float z = Terrain->GetAltitudeByPos2D(Data.VerticesPostion2D[i], this);
-		Data.VerticesPositionZ.Add(z);
-		Sum += z;
-	}
-	Data.AvgPositionZ = Sum / 6.0;
+	HexGridTileKernel::RunRanges(Corners.GetBorderCornerStart(), Corners.Num(), [this](int32 RangeBegin, int32 RangeEnd) {
+		SetCornersPosZ(RangeBegin, RangeEnd);
+	});
 }
 
-void AHexGrid::CalTilesNormal()
+void AHexGrid::SetTilesPosZ(int32 Begin, int32 End)
 {
-	if (TilesLoopFunction([this]() { InitCalTilesNormal(); }, [this](int32 i) { CalTileNormal(i); },
-		CalTilesNormalLoopData, Enum_HexGridWorkflowState::SetTilesWalkingBlockLevel)) {
-		UE_LOG(HexGrid, Log, TEXT("Calculate tiles normal done!"));
-	}
+	//Heights of the terrain mesh surface.
+	//Tile i owns corners 2i and 2i + 1, so a tile range owns a contiguous corner range
+	Terrain->GetAltitudesByPos2D(Tiles.Positions2D.GetData() + Begin, End - Begin, Tiles.PositionsZ.GetData() + Begin);
+	SetCornersPosZ(Begin * 2, End * 2);
 }
 
-void AHexGrid::InitCalTilesNormal()
+void AHexGrid::SetCornersPosZ(int32 Begin, int32 End)
 {
-	HexInstMeshUpVec = HexInstMesh->GetUpVector();
+	Terrain->GetAltitudesByPos2D(Corners.Positions2D.GetData() + Begin, End - Begin, Corners.PositionsZ.GetData() + Begin);
 }
 
 void AHexGrid::CalTileNormal(int32 Index)
 {
-	FStructHexTileData& Data = Tiles[Index];
+	//Corners of all tiles are sampled by now
+	FVector Vertices[HexGridCornerLattice::TileCornerNum];
+	float Sum = 0.0;
+	for (int32 i = 0; i < HexGridCornerLattice::TileCornerNum; i++) {
+		Vertices[i] = Corners.GetCornerPosition(Corners.GetTileCorner(Index, i));
+		Sum += Vertices[i].Z;
+	}
+	Tiles.AvgPositionsZ[Index] = Sum / 6.0;
 
 	FVector TileNormal(0, 0, 0);
 	for (int32 i = 0; i < 2; i++) {
-		FVector v0(Data.VerticesPostion2D[i].X, Data.VerticesPostion2D[i].Y, Data.VerticesPositionZ[i]);
-		FVector v1(Data.VerticesPostion2D[2 + i].X, Data.VerticesPostion2D[2 + i].Y, Data.VerticesPositionZ[2 + i]);
-		FVector v2(Data.VerticesPostion2D[4 + i].X, Data.VerticesPostion2D[4 + i].Y, Data.VerticesPositionZ[4 + i]);
+		const FVector& v0 = Vertices[i];
+		const FVector& v1 = Vertices[2 + i];
+		const FVector& v2 = Vertices[4 + i];
 		TileNormal += FVector::CrossProduct(v2 - v0, v2 - v1);
 	}
 	TileNormal.Normalize();
-	Data.Normal = TileNormal;
+	Tiles.Normals[Index] = TileNormal;
 
 	float DotProduct = FVector::DotProduct(HexInstMeshUpVec, TileNormal);
-	Data.AngleToUp = acosf(DotProduct);
+	Tiles.AnglesToUp[Index] = acosf(DotProduct);
 
 }
 
@@ -724,48 +816,41 @@ void AHexGrid::InitSetTilesWalkingBlockLevel()
 	WalkingBlockLevelMax = NeighborRange + 1;
 }
 
-bool AHexGrid::SetTileWalkingBlock(FStructHexTileData& Data, FStructHexTileData& CheckData, int32 BlockLevel)
+bool AHexGrid::IsTileWalkingBlock(int32 CheckIndex)
 {
-	if (!IsInMapRange(CheckData) 
-		|| CheckData.AvgPositionZ > WalkingBlockAltitudeRatio * Terrain->GetTileAltitudeMultiplier()
-		|| CheckData.AvgPositionZ < Terrain->GetWaterBase()
-		|| CheckData.AngleToUp > (PI * WalkingBlockSlopeRatio / 2.0)) {
-		Data.TerrainWalkingBlockLevel = BlockLevel;
-		return true;
-	}
-	return false;
+	return !IsInMapRange(CheckIndex)
+		|| Tiles.AvgPositionsZ[CheckIndex] > WalkingBlockAltitudeRatio * Terrain->GetTileAltitudeMultiplier()
+		|| Tiles.AvgPositionsZ[CheckIndex] < Terrain->GetWaterBase()
+		|| Tiles.AnglesToUp[CheckIndex] > (PI * WalkingBlockSlopeRatio / 2.0);
 }
 
 void AHexGrid::SetTileWalkingBlockLevelByNeighbors(int32 Index)
 {
-	FStructHexTileData& Data = Tiles[Index];
-	if (SetTileWalkingBlock(Data, Data, 0)) {
+	if (IsTileWalkingBlock(Index)) {
+		Tiles.WalkingBlockLevels[Index] = 0;
 		return;
 	}
 
-	for (int32 i = 0; i < Data.Neighbors.Num(); i++)
+	for (int32 Radius = 1; Radius <= NeighborRange; Radius++)
 	{
-		if (SetTileWalkingBlockLevelByNeighbor(Data, i)) {
+		if (SetTileWalkingBlockLevelByNeighbor(Index, Radius)) {
 			return;
 		}
 	}
-	Data.TerrainWalkingBlockLevel = WalkingBlockLevelMax;
+	Tiles.WalkingBlockLevels[Index] = WalkingBlockLevelMax;
 }
 
-bool AHexGrid::SetTileWalkingBlockLevelByNeighbor(FStructHexTileData& Data, int32 Index)
+bool AHexGrid::SetTileWalkingBlockLevelByNeighbor(int32 Index, int32 Radius)
 {
-	FStructHexTileNeighbors Neighbors = Data.Neighbors[Index];
-	int32 TileIndex;
-	for (int32 i = 0; i < Neighbors.Tiles.Num(); i++)
+	if (Adjacency.IsRingClipped(Index, Radius)) {
+		Tiles.WalkingBlockLevels[Index] = Radius;
+		return true;
+	}
+	for (int32 NeighborIndex : Adjacency.GetRing(Index, Radius))
 	{
-		FIntPoint key = Neighbors.Tiles[i];
-		if (!TileIndices.Contains(key)) {
-			continue;
-		}
-		
-		TileIndex = TileIndices[key];
-		if (SetTileWalkingBlock(Data, Tiles[TileIndex], Neighbors.Radius))
+		if (IsTileWalkingBlock(NeighborIndex))
 		{
+			Tiles.WalkingBlockLevels[Index] = Radius;
 			return true;
 		}
 	}
@@ -776,6 +861,7 @@ void AHexGrid::SetTilesWalkingBlockLevelEx()
 {
 	if (TilesLoopFunction([this]() { InitSetTilesWalkingBlockLevelEx(); }, [this](int32 i) { SetTileWalkingBlockLevelByNeighborsEx(i); },
 		SetTilesWalkingBlockLevelExLoopData, Enum_HexGridWorkflowState::InitCheckTerrainWalkingConnection)) {
+		CollectMaxWalkingBlockTiles();
 		UE_LOG(HexGrid, Log, TEXT("Set tiles walking block level extension done!"));
 	}
 }
@@ -783,26 +869,36 @@ void AHexGrid::SetTilesWalkingBlockLevelEx()
 void AHexGrid::InitSetTilesWalkingBlockLevelEx()
 {
 	WalkingBlockLevelMax = NeighborRange * 2 + 1;
+	WalkingBlockLevelsBack.Freeze(Tiles.WalkingBlockLevels);
 }
 
 void AHexGrid::SetTileWalkingBlockLevelByNeighborsEx(int32 Index)
 {
-	FStructHexTileData& Data = Tiles[Index];
+	const TArray<uint8>& Levels = WalkingBlockLevelsBack.Read();
 
-	if (Data.TerrainWalkingBlockLevel == (NeighborRange + 1)) {
-		FStructHexTileNeighbors OutSideNeighbors = Data.Neighbors[Data.Neighbors.Num() - 1];
+	if (Levels[Index] == (NeighborRange + 1)) {
 		int32 BlockLvMin = WalkingBlockLevelMax;
-		int32 CurrentBlockLv = Data.TerrainWalkingBlockLevel;
-		for (int32 i = 0; i < OutSideNeighbors.Count; i++)
+		int32 CurrentBlockLv = Levels[Index];
+		for (int32 NeighborIndex : Adjacency.GetRing(Index, NeighborRange))
 		{
-			CurrentBlockLv = NeighborRange + Tiles[TileIndices[OutSideNeighbors.Tiles[i]]].TerrainWalkingBlockLevel;
+			CurrentBlockLv = NeighborRange + Levels[NeighborIndex];
 			if (CurrentBlockLv < BlockLvMin) {
 				BlockLvMin = CurrentBlockLv;
 			}
 		}
-		Data.TerrainWalkingBlockLevel = BlockLvMin;
-		if (Data.TerrainWalkingBlockLevel == WalkingBlockLevelMax) {
-			MaxWalkingBlockTileIndices.Add(Index);
+		Tiles.WalkingBlockLevels[Index] = BlockLvMin;
+	}
+}
+
+void AHexGrid::CollectMaxWalkingBlockTiles()
+{
+	//Kernels never touch the set, it is filled once in tile order
+	MaxWalkingBlockTileIndices.Reset();
+	const TArray<uint8>& Levels = Tiles.WalkingBlockLevels;
+	for (int32 i = 0; i < Levels.Num(); i++)
+	{
+		if (Levels[i] == WalkingBlockLevelMax) {
+			MaxWalkingBlockTileIndices.Add(i);
 		}
 	}
 }
@@ -818,7 +914,7 @@ void AHexGrid::CheckTerrainWalkingConnectionWorkflow()
 	{
 	case Enum_HexGridWorkflowState::InitCheckTerrainWalkingConnection:
 		InitCheckTerrainWalkingConnection();
-		WorkflowState = Enum_HexGridWorkflowState::BreakMaxWalkingBlockTilesToChunk;
+		SetWorkflowState(Enum_HexGridWorkflowState::BreakMaxWalkingBlockTilesToChunk);
 	case Enum_HexGridWorkflowState::BreakMaxWalkingBlockTilesToChunk:
 		BreakMaxWalkingBlockTilesToChunk();
 		break;
@@ -832,73 +928,62 @@ void AHexGrid::CheckTerrainWalkingConnectionWorkflow()
 
 void AHexGrid::InitCheckTerrainWalkingConnection()
 {
-	MaxWalkingBlockTileChunks.Empty();
+	MaxWalkingBlockTileChunks.Reset();
+	CheckWalkingConnectionReached.Reset();
+	CheckWalkingConnectionFrontier.Empty();
 }
 
 void AHexGrid::BreakMaxWalkingBlockTilesToChunk()
 {
-	int32 Count = 0;
-	TArray<int32> Indices = {};
-	bool SaveLoopFlag = false;
-
-	while (!MaxWalkingBlockTileIndices.IsEmpty()) 
-	{
+	//One step visits a frontier tile or closes the chunk, the search state lives in members between slices
+	bool LoopDone = FlowControlUtility::RunSteps(this, BreakMaxWalkingBlockTilesToChunkLoopData, WorkflowDelegate, [this]() {
 		if (CheckWalkingConnectionFrontier.IsEmpty()) {
-			CheckWalkingConnectionReached.Empty();
-			TArray<int32> arr = MaxWalkingBlockTileIndices.Array();
-			CheckWalkingConnectionFrontier.Enqueue(arr[0]);
-			MaxWalkingBlockTileIndices.Remove(arr[0]);
-
-			CheckWalkingConnectionReached.Add(arr[0]);
-		}
-		
-		while (!CheckWalkingConnectionFrontier.IsEmpty())
-		{
-			FlowControlUtility::SaveLoopData(this, BreakMaxWalkingBlockTilesToChunkLoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-			if (SaveLoopFlag) {
-				return;
+			if (!CheckWalkingConnectionReached.IsEmpty()) {
+				MaxWalkingBlockTileChunks.Add(CheckWalkingConnectionReached);
+				CheckWalkingConnectionReached.Reset();
 			}
-
-			int32 current;
-			CheckWalkingConnectionFrontier.Dequeue(current);
-
-			FStructHexTileNeighbors Neighbors = Tiles[current].Neighbors[0];
-			for (int32 i = 0; i < Neighbors.Tiles.Num(); i++) {
-				FIntPoint key = Neighbors.Tiles[i];
-				if (!TileIndices.Contains(key)) {
-					continue;
-				}
-				if (!CheckWalkingConnectionReached.Contains(TileIndices[key])
-					&& MaxWalkingBlockTileIndices.Contains(TileIndices[key])) {
-					CheckWalkingConnectionFrontier.Enqueue(TileIndices[key]);
-					CheckWalkingConnectionReached.Add(TileIndices[key]);
-					MaxWalkingBlockTileIndices.Remove(TileIndices[key]);
-				}
+			if (MaxWalkingBlockTileIndices.IsEmpty()) {
+				return false;
 			}
+			int32 First = *MaxWalkingBlockTileIndices.CreateConstIterator();
+			CheckWalkingConnectionFrontier.Enqueue(First);
+			MaxWalkingBlockTileIndices.Remove(First);
+			CheckWalkingConnectionReached.Add(First);
+			return true;
+		}
 
-			Count++;
+		int32 current;
+		CheckWalkingConnectionFrontier.Dequeue(current);
+
+		for (int32 NeighborIndex : Adjacency.GetRing(current, 1)) {
+			if (!CheckWalkingConnectionReached.Contains(NeighborIndex)
+				&& MaxWalkingBlockTileIndices.Contains(NeighborIndex)) {
+				CheckWalkingConnectionFrontier.Enqueue(NeighborIndex);
+				CheckWalkingConnectionReached.Add(NeighborIndex);
+				MaxWalkingBlockTileIndices.Remove(NeighborIndex);
+			}
 		}
-		MaxWalkingBlockTileChunks.Add(CheckWalkingConnectionReached);
+		return true;
+	});
+	if (!LoopDone) {
+		return;
 	}
 
-	FTimerHandle TimerHandle;
-	WorkflowState = Enum_HexGridWorkflowState::CheckChunksWalkingConnection;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, BreakMaxWalkingBlockTilesToChunkLoopData.Rate, false);
+	SetWorkflowState(Enum_HexGridWorkflowState::CheckChunksWalkingConnection);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, BreakMaxWalkingBlockTilesToChunkLoopData.Rate);
 	UE_LOG(HexGrid, Log, TEXT("MaxWalkingBlockTileChunks Num=%d"), MaxWalkingBlockTileChunks.Num());
 	UE_LOG(HexGrid, Log, TEXT("Break Max Walking Block Tiles To Chunk done!"));
 }
 
 void AHexGrid::CheckChunksWalkingConnection()
 {
-	FTimerHandle TimerHandle;
-
 	MaxWalkingBlockTileChunks.Sort([](const TSet<int32>& A, const TSet<int32>& B) {
 		return A.Num() > B.Num();
 	});
 	if (MaxWalkingBlockTileChunks.IsEmpty()) {
 		UE_LOG(HexGrid, Warning, TEXT("MaxWalkingBlockTileChunks is empty!"));
-		WorkflowState = Enum_HexGridWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
+		SetWorkflowState(Enum_HexGridWorkflowState::Error);
+		FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
 		return;
 	}
 	TSet<int32> objChunk = MaxWalkingBlockTileChunks[0];
@@ -911,8 +996,8 @@ void AHexGrid::CheckChunksWalkingConnection()
 		objChunk.Append(MaxWalkingBlockTileChunks[i]);
 	}
 	
-	WorkflowState = Enum_HexGridWorkflowState::FindTilesIsland;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
+	SetWorkflowState(Enum_HexGridWorkflowState::FindTilesIsland);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
 	UE_LOG(HexGrid, Log, TEXT("Check Chunks Walking Connection done!"));
 	UE_LOG(HexGrid, Log, TEXT("Check Terrain Walking Connection pass!"));
 }
@@ -933,16 +1018,11 @@ bool AHexGrid::FindTwoChunksWalkingConnection(TSet<int32>& ChunkStart, TSet<int3
 		if (ChunkObj.Contains(current)) {
 			return true;
 		}
-		FStructHexTileNeighbors Neighbors = Tiles[current].Neighbors[0];
-		for (int32 i = 0; i < Neighbors.Tiles.Num(); i++) {
-			FIntPoint key = Neighbors.Tiles[i];
-			if (!TileIndices.Contains(key)) {
-				continue;
-			}
-			if (!reached.Contains(TileIndices[key]) 
-				&& Tiles[TileIndices[key]].TerrainWalkingBlockLevel >= 3) {
-				frontier.Enqueue(TileIndices[key]);
-				reached.Add(TileIndices[key]);
+		for (int32 NeighborIndex : Adjacency.GetRing(current, 1)) {
+			if (!reached.Contains(NeighborIndex) 
+				&& Tiles.WalkingBlockLevels[NeighborIndex] >= 3) {
+				frontier.Enqueue(NeighborIndex);
+				reached.Add(NeighborIndex);
 			}
 		}
 	}
@@ -954,7 +1034,7 @@ void AHexGrid::CheckTerrainWalkingConnectionNotPass(int32 ChunkIndex)
 	TSet<int32> Cks = MaxWalkingBlockTileChunks[ChunkIndex];
 	TArray<int32> CksArray = Cks.Array();
 	for (int32 i : CksArray) {
-		Tiles[i].TerrainWalkingConnection = false;
+		Tiles.WalkingConnections[i] = false;
 	}
 }
 
@@ -968,39 +1048,34 @@ void AHexGrid::FindTilesIsland()
 
 void AHexGrid::FindTileIsLand(int32 Index)
 {
-	FStructHexTileData& Data = Tiles[Index];
-	if (Data.TerrainWalkingBlockLevel == WalkingBlockLevelMax) {
-		if (Data.TerrainWalkingConnection) {
-			Data.TerrainIsLand = false;
+	int32 Level = Tiles.WalkingBlockLevels[Index];
+	if (Level == WalkingBlockLevelMax) {
+		if (Tiles.WalkingConnections[Index]) {
+			Tiles.IsLand[Index] = false;
 		}
 		else {
-			Data.TerrainIsLand = true;
+			Tiles.IsLand[Index] = true;
 		}
 		
 	}
-	else if (Data.TerrainWalkingBlockLevel < WalkingBlockLevelMax && Data.TerrainWalkingBlockLevel >= 3) {
-		Data.TerrainIsLand = !Find_LBLM_By_LBL3(Index);
+	else if (Level < WalkingBlockLevelMax && Level >= 3) {
+		Tiles.IsLand[Index] = !Find_LBLM_By_LBL3(Index);
 	}
-	else if (Data.TerrainWalkingBlockLevel < 3 && Data.TerrainWalkingBlockLevel >= 1) {
-		for (int32 i = Data.TerrainWalkingBlockLevel; i > 0; i--) {
-			FStructHexTileNeighbors Neighbors = Data.Neighbors[2 - i];
-			for (int32 j = 0; j < Neighbors.Tiles.Num(); j++) {
-				FIntPoint key = Neighbors.Tiles[j];
-				if (!TileIndices.Contains(key)) {
-					continue;
-				}
-				if (Tiles[TileIndices[key]].TerrainWalkingBlockLevel == 3) {
-					if (Find_LBLM_By_LBL3(TileIndices[key])) {
-						Data.TerrainIsLand = false;
+	else if (Level < 3 && Level >= 1) {
+		for (int32 i = Level; i > 0; i--) {
+			for (int32 NeighborIndex : Adjacency.GetRing(Index, 3 - i)) {
+				if (Tiles.WalkingBlockLevels[NeighborIndex] == 3) {
+					if (Find_LBLM_By_LBL3(NeighborIndex)) {
+						Tiles.IsLand[Index] = false;
 						return;
 					}
 				}
 			}
 		}
-		Data.TerrainIsLand = true;
+		Tiles.IsLand[Index] = true;
 	}
 	else {
-		Data.TerrainIsLand = true;
+		Tiles.IsLand[Index] = true;
 	}
 }
 
@@ -1016,8 +1091,8 @@ bool AHexGrid::Find_LBLM_By_LBL3(int32 Index)
 	{
 		int32 current;
 		frontier.Dequeue(current);
-		if (Tiles[current].TerrainWalkingBlockLevel == WalkingBlockLevelMax) {
-			if (Tiles[current].TerrainWalkingConnection) {
+		if (Tiles.WalkingBlockLevels[current] == WalkingBlockLevelMax) {
+			if (Tiles.WalkingConnections[current]) {
 				return true;
 			}
 			else {
@@ -1026,15 +1101,10 @@ bool AHexGrid::Find_LBLM_By_LBL3(int32 Index)
 			
 		}
 
-		FStructHexTileNeighbors Neighbors = Tiles[current].Neighbors[0];
-		for (int32 i = 0; i < Neighbors.Tiles.Num(); i++) {
-			FIntPoint key = Neighbors.Tiles[i];
-			if (!TileIndices.Contains(key)) {
-				continue;
-			}
-			if (!reached.Contains(TileIndices[key]) && Tiles[TileIndices[key]].TerrainWalkingBlockLevel >=3) {
-				frontier.Enqueue(TileIndices[key]);
-				reached.Add(TileIndices[key]);
+		for (int32 NeighborIndex : Adjacency.GetRing(current, 1)) {
+			if (!reached.Contains(NeighborIndex) && Tiles.WalkingBlockLevels[NeighborIndex] >=3) {
+				frontier.Enqueue(NeighborIndex);
+				reached.Add(NeighborIndex);
 			}
 		}
 	}
@@ -1052,63 +1122,53 @@ void AHexGrid::SetTilesBuildingBlockLevel()
 void AHexGrid::InitSetTilesBuildingBlockLevel()
 {
 	BuildingBlockLevelMax = NeighborRange + 1;
-	BuildingBlockAltitudeRatio = BuildingBlockAltitudeRatio > WalkingBlockAltitudeRatio ? WalkingBlockAltitudeRatio : BuildingBlockAltitudeRatio;
-	BuildingBlockSlopeRatio = BuildingBlockSlopeRatio > WalkingBlockSlopeRatio ? WalkingBlockSlopeRatio : BuildingBlockSlopeRatio;
 }
 
-bool AHexGrid::SetTileBuildingBlock(FStructHexTileData& Data, FStructHexTileData& CheckData, int32 BuildingBlockLevel)
+bool AHexGrid::IsTileBuildingBlock(int32 CheckIndex)
 {
-	if (!IsInMapRange(CheckData) 
-		|| CheckData.AvgPositionZ > BuildingBlockAltitudeRatio * Terrain->GetTileAltitudeMultiplier()
-		|| CheckData.AvgPositionZ < Terrain->GetWaterBase()
-		|| CheckData.AngleToUp >(PI * BuildingBlockSlopeRatio / 2.0)) {
-		Data.TerrainBuildingBlockLevel = BuildingBlockLevel;
-		return true;
-	}
-	return false;
+	return !IsInMapRange(CheckIndex)
+		|| Tiles.AvgPositionsZ[CheckIndex] > BuildingAltitudeRatio * Terrain->GetTileAltitudeMultiplier()
+		|| Tiles.AvgPositionsZ[CheckIndex] < Terrain->GetWaterBase()
+		|| Tiles.AnglesToUp[CheckIndex] > (PI * BuildingSlopeRatio / 2.0);
 }
 
 void AHexGrid::SetTileBuildingBlockLevelByNeighbors(int32 Index)
 {
-	FStructHexTileData& Data = Tiles[Index];
-	if (SetTileBuildingBlock(Data, Data, 0)) {
+	if (IsTileBuildingBlock(Index)) {
+		Tiles.BuildingBlockLevels[Index] = 0;
 		return;
 	}
 
-	for (int32 i = 0; i < Data.Neighbors.Num(); i++)
+	for (int32 Radius = 1; Radius <= NeighborRange; Radius++)
 	{
-		if (SetTileBuildingBlockLevelByNeighbor(Data, i)) {
+		if (SetTileBuildingBlockLevelByNeighbor(Index, Radius)) {
 			return;
 		}
 	}
-	Data.TerrainBuildingBlockLevel = BuildingBlockLevelMax;
+	Tiles.BuildingBlockLevels[Index] = BuildingBlockLevelMax;
 }
 
-bool AHexGrid::SetTileBuildingBlockLevelByNeighbor(FStructHexTileData& Data, int32 Index)
+bool AHexGrid::SetTileBuildingBlockLevelByNeighbor(int32 Index, int32 Radius)
 {
-	FStructHexTileNeighbors Neighbors = Data.Neighbors[Index];
-	int32 TileIndex;
-	for (int32 i = 0; i < Neighbors.Tiles.Num(); i++)
+	if (Adjacency.IsRingClipped(Index, Radius)) {
+		Tiles.BuildingBlockLevels[Index] = Radius;
+		return true;
+	}
+	for (int32 NeighborIndex : Adjacency.GetRing(Index, Radius))
 	{
-		FIntPoint key = Neighbors.Tiles[i];
-		if (!TileIndices.Contains(key)) {
-			continue;
-		}
-
-		TileIndex = TileIndices[key];
-		if (SetTileBuildingBlock(Data, Tiles[TileIndex], Neighbors.Radius))
+		if (IsTileBuildingBlock(NeighborIndex))
 		{
+			Tiles.BuildingBlockLevels[Index] = Radius;
 			return true;
 		}
 	}
-
 	return false;
 }
 
 void AHexGrid::SetTilesBuildingBlockLevelEx()
 {
 	if (TilesLoopFunction([this]() { InitSetTilesBuildingBlockExLevel(); }, [this](int32 i) { SetTileBuildingBlockLevelByNeighborsEx(i); },
-		SetTilesBuildingBlockLevelExLoopData, Enum_HexGridWorkflowState::DrawMesh)) {
+		SetTilesBuildingBlockLevelExLoopData, Enum_HexGridWorkflowState::SaveBakedCache)) {
 		UE_LOG(HexGrid, Log, TEXT("Set tiles Building Block level extension done!"));
 	}
 }
@@ -1116,23 +1176,23 @@ void AHexGrid::SetTilesBuildingBlockLevelEx()
 void AHexGrid::InitSetTilesBuildingBlockExLevel()
 {
 	BuildingBlockLevelMax = NeighborRange * 2 + 1;
+	BuildingBlockLevelsBack.Freeze(Tiles.BuildingBlockLevels);
 }
 
 void AHexGrid::SetTileBuildingBlockLevelByNeighborsEx(int32 Index)
 {
-	FStructHexTileData& Data = Tiles[Index];
-	if (Data.TerrainBuildingBlockLevel == (NeighborRange + 1)) {
-		FStructHexTileNeighbors OutSideNeighbors = Data.Neighbors[Data.Neighbors.Num() - 1];
+	const TArray<uint8>& Levels = BuildingBlockLevelsBack.Read();
+	if (Levels[Index] == (NeighborRange + 1)) {
 		int32 BuildingBlockLvMin = BuildingBlockLevelMax;
-		int32 CurrentBuildingBlockLv = Data.TerrainBuildingBlockLevel;
-		for (int32 i = 0; i < OutSideNeighbors.Count; i++)
+		int32 CurrentBuildingBlockLv = Levels[Index];
+		for (int32 NeighborIndex : Adjacency.GetRing(Index, NeighborRange))
 		{
-			CurrentBuildingBlockLv = NeighborRange + Tiles[TileIndices[OutSideNeighbors.Tiles[i]]].TerrainBuildingBlockLevel;
+			CurrentBuildingBlockLv = NeighborRange + Levels[NeighborIndex];
 			if (CurrentBuildingBlockLv < BuildingBlockLvMin) {
 				BuildingBlockLvMin = CurrentBuildingBlockLv;
 			}
 		}
-		Data.TerrainBuildingBlockLevel = BuildingBlockLvMin;
+		Tiles.BuildingBlockLevels[Index] = BuildingBlockLvMin;
 	}
 }
 
@@ -1140,15 +1200,15 @@ void AHexGrid::AddTilesInstance()
 {
 	if (!bShowGrid) {
 		InitAddTilesInstance();
-		FTimerHandle TimerHandle;
-		WorkflowState = Enum_HexGridWorkflowState::Done;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
+		SetWorkflowState(Enum_HexGridWorkflowState::Done);
+		FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
 		UE_LOG(HexGrid, Log, TEXT("Don't show grid!"));
 		return;
 	}
 
+	//Instances are added to a component, game thread only
 	if (TilesLoopFunction([this]() { InitAddTilesInstance(); }, [this](int32 i) { AddTileInstanceByWalkingBlock(i); },
-		AddTilesInstanceLoopData, Enum_HexGridWorkflowState::Done)) {
+		AddTilesInstanceLoopData, Enum_HexGridWorkflowState::Done, true)) {
 		UE_LOG(HexGrid, Log, TEXT("Add tiles instance done!"));
 	}
 }
@@ -1170,14 +1230,14 @@ int32 AHexGrid::AddISM(int32 Index, UInstancedStaticMeshComponent* ISM, float ZO
 		return -1;
 	}
 
-	FStructHexTileData tile = Tiles[Index];
-	FVector HexLoc(tile.Position2D.X, tile.Position2D.Y, tile.AvgPositionZ + ZOffset);
+	const FVector2D& Position2D = Tiles.Positions2D[Index];
+	FVector HexLoc(Position2D.X, Position2D.Y, Tiles.AvgPositionsZ[Index] + ZOffset);
 	FVector HexScale(HexInstanceScale);
 
-	FVector RotationAxis = FVector::CrossProduct(HexInstMeshUpVec, tile.Normal);
+	FVector RotationAxis = FVector::CrossProduct(HexInstMeshUpVec, Tiles.Normals[Index]);
 	RotationAxis.Normalize();
 
-	FQuat Quat = FQuat(RotationAxis, tile.AngleToUp);
+	FQuat Quat = FQuat(RotationAxis, Tiles.AnglesToUp[Index]);
 	FQuat NewQuat = Quat * HexInstMeshRot.Quaternion();
 
 	FTransform HexTransform(NewQuat.Rotator(), HexLoc, HexScale);
@@ -1188,9 +1248,8 @@ int32 AHexGrid::AddISM(int32 Index, UInstancedStaticMeshComponent* ISM, float ZO
 
 void AHexGrid::AddTileInstanceByWalkingBlock(int32 Index)
 {
-	FStructHexTileData tile = Tiles[Index];
-	if (tile.TerrainWalkingBlockLevel > 0 
-		&& !tile.TerrainIsLand
+	if (Tiles.WalkingBlockLevels[Index] > 0 
+		&& !Tiles.IsLand[Index]
 		&& IsInMapRange(Index))
 	{
 		int32 InstanceIndex = AddTileInstance(Index);
@@ -1204,16 +1263,16 @@ void AHexGrid::AddTileInstanceDataByWalkingBlock(int32 TileIndex, int32 Instance
 {
 	float H = 0.0;
 	if (GridShowMode == Enum_BlockMode::WalkingBlock) {
-		if (!Tiles[TileIndex].TerrainIsLand) {
-			H = 120.0f / float(WalkingBlockLevelMax) * float(Tiles[TileIndex].TerrainWalkingBlockLevel);
+		if (!Tiles.IsLand[TileIndex]) {
+			H = 120.0f / float(WalkingBlockLevelMax) * float(Tiles.WalkingBlockLevels[TileIndex]);
 		}
 		else {
 			H = 240.0;
 		}
 	}
 	else if (GridShowMode == Enum_BlockMode::BuildingBlock) {
-		if (!Tiles[TileIndex].TerrainIsLand) {
-			H = 120.0f / float(BuildingBlockLevelMax) * float(Tiles[TileIndex].TerrainBuildingBlockLevel);
+		if (!Tiles.IsLand[TileIndex]) {
+			H = 120.0f / float(BuildingBlockLevelMax) * float(Tiles.BuildingBlockLevels[TileIndex]);
 		}
 		else {
 			H = 240.0;
@@ -1228,13 +1287,9 @@ void AHexGrid::AddTileInstanceDataByWalkingBlock(int32 TileIndex, int32 Instance
 
 bool AHexGrid::IsInMapRange(int32 Index)
 {
-	return IsInMapRange(Tiles[Index]);
-}
-
-bool AHexGrid::IsInMapRange(const FStructHexTileData& Tile)
-{
-	return (FMath::Abs<float>(Tile.Position2D.X) < Terrain->GetWidth() / 2
-		&& FMath::Abs<float>(Tile.Position2D.Y) < Terrain->GetHeight() / 2);
+	const FVector2D& Position2D = Tiles.Positions2D[Index];
+	return (FMath::Abs<float>(Position2D.X) < Terrain->GetWidth() / 2
+		&& FMath::Abs<float>(Position2D.Y) < Terrain->GetHeight() / 2);
 }
 
 // Called every frame
@@ -1243,6 +1298,56 @@ void AHexGrid::Tick(float DeltaTime)
 	//Super::Tick(DeltaTime);
 }
 
+void AHexGrid::InitHeadless()
+{
+	Profiler.Init(GetName(), StaticEnum<Enum_HexGridWorkflowState>());
+	InitStageParams();
+}
+
+bool AHexGrid::RunHeadless(ATerrain* InTerrain)
+{
+	using EState = Enum_HexGridWorkflowState;
+	FlowControlUtility::FUnslicedScope UnslicedScope(WorkflowDelegate);
+	Terrain = InTerrain;
+	bUseBakedCache = false;
+	bWorkflowFailed = false;
+	InitLoopData();
+
+	//Loading waits for the loader tasks here, so its slice covers the whole load
+	FString BinaryPath;
+	Profiler.Run((int32)GetLoadDataState(BinaryPath), [this]() {
+		StartGraphLoadData();
+		DataLoader.GetCompletionTask().Wait();
+	});
+	Profiler.Run((int32)EState::LoadNeighbors, [this]() { FinishGraphLoadData(); });
+	if (bWorkflowFailed) {
+		WorkflowState = Enum_HexGridWorkflowState::Error;
+		return false;
+	}
+
+	Profiler.Run((int32)EState::CreateTilesVertices, [this]() { CreateTilesVertices(); });
+	Profiler.Run((int32)EState::SetTilesGeometry, [this]() { SetTilesGeometry(); });
+	Profiler.Run((int32)EState::SetTilesWalkingBlockLevel, [this]() { SetTilesWalkingBlockLevel(); });
+	Profiler.Run((int32)EState::SetTilesWalkingBlockLevelEx, [this]() { SetTilesWalkingBlockLevelEx(); });
+	Profiler.Run((int32)EState::InitCheckTerrainWalkingConnection, [this]() { InitCheckTerrainWalkingConnection(); });
+	Profiler.Run((int32)EState::BreakMaxWalkingBlockTilesToChunk, [this]() { BreakMaxWalkingBlockTilesToChunk(); });
+	Profiler.Run((int32)EState::CheckChunksWalkingConnection, [this]() { CheckChunksWalkingConnection(); });
+	if (bWorkflowFailed) {
+		WorkflowState = Enum_HexGridWorkflowState::Error;
+		return false;
+	}
+	Profiler.Run((int32)EState::FindTilesIsland, [this]() { FindTilesIsland(); });
+	Profiler.Run((int32)EState::SetTilesBuildingBlockLevel, [this]() { SetTilesBuildingBlockLevel(); });
+	Profiler.Run((int32)EState::SetTilesBuildingBlockLevelEx, [this]() { SetTilesBuildingBlockLevelEx(); });
+	WorkflowState = Enum_HexGridWorkflowState::Done;
+	return true;
+}
+
+bool AHexGrid::SaveTileData(const FString& FullPath)
+{
+	return HexGridBakedCache::Save(FullPath, MakeBakedCacheKey(), Tiles, Corners);
+}
+
 void AHexGrid::MouseOverGrid(const FVector2D& MousePos)
 {
 	if (!IsWorkFlowDone() || Terrain == nullptr || !Terrain->IsWorkFlowDone()) {
@@ -1255,65 +1360,57 @@ void AHexGrid::MouseOverGrid(const FVector2D& MousePos)
 	AddMouseOverTilesInstance();
 }
 
-Hex AHexGrid::PosToHex(const FVector2D& Point, float Size)
+void AHexGrid::AddMouseOverTilesInstance()
 {
-	float q = (2.0 / 3.0 * Point.X) / Size;
-	float r = (-1.0 / 3.0 * Point.X + FMath::Sqrt(3.0) / 3.0 * Point.Y) / Size;
-
-	float qfz = FMath::RoundFromZero(q);
-	float rfz = FMath::RoundFromZero(r);
-	float qtz = FMath::RoundToZero(q);
-	float rtz = FMath::RoundToZero(r);
-
-	Hex hex1(FVector2D(qfz, rfz));
-	Hex hex2(FVector2D(qfz, rtz));
-	Hex hex3(FVector2D(qtz, rfz));
-	Hex hex4(FVector2D(qtz, rtz));
-
-	int32 index1 = TileIndices[hex1.ToIntPoint()];
-	int32 index2 = TileIndices[hex2.ToIntPoint()];
-	int32 index3 = TileIndices[hex3.ToIntPoint()];
-	int32 index4 = TileIndices[hex4.ToIntPoint()];
-
-	FVector2D center1 = Tiles[index1].Position2D;
-	FVector2D center2 = Tiles[index2].Position2D;
-	FVector2D center3 = Tiles[index3].Position2D;
-	FVector2D center4 = Tiles[index4].Position2D;
-
-	float dist1 = FVector2D::Distance(Point, center1);
-	float dist2 = FVector2D::Distance(Point, center2);
-	float dist3 = FVector2D::Distance(Point, center3);
-	float dist4 = FVector2D::Distance(Point, center4);
-
-	Hex OutHex;
-	if (dist1 < dist2 && dist1 < dist3 && dist1 < dist4) {
-		OutHex.SetHex(hex1);
-	}
-	else if (dist2 < dist3 && dist2 < dist4) {
-		OutHex.SetHex(hex2);
+	//Tiles out of map range are not created
+	int32 Index = TileIndices.Find(MouseOverHex.ToIntPoint());
+	if (Index == INDEX_NONE) {
+		return;
 	}
-	else if (dist3 < dist4) {
-		OutHex.SetHex(hex3);
+	int32 InstanceIndex = AddISM(Index, MouseOverInstMesh, MouseOverInstMeshOffsetZ);
+
+	MouseOverShowRadius = MouseOverShowRadius < NeighborRange ? MouseOverShowRadius : NeighborRange;
+	for (int32 i = 0; i < MouseOverShowRadius; i++)
+	{
+		for (int32 NeighborIndex : Adjacency.GetRing(Index, i + 1))
+		{
+			InstanceIndex = AddISM(NeighborIndex, MouseOverInstMesh, MouseOverInstMeshOffsetZ);
+		}
 	}
-	else {
-		OutHex.SetHex(hex4);
+}
+
+void AHexGrid::GetTileData(int32 TileIndex, FStructHexTileData& Out_Data)
+{
+	if (Tiles.IsValidIndex(TileIndex)) {
+		Tiles.GetTileData(TileIndex, Out_Data);
+		if (TileIndex < Corners.GetTileNum()) {
+			Corners.GetTileVertices(TileIndex, Out_Data.VerticesPostion2D, Out_Data.VerticesPositionZ);
+		}
 	}
-	return OutHex;
 }
 
-void AHexGrid::AddMouseOverTilesInstance()
+bool AHexGrid::FindTileIndex(const FIntPoint& AxialCoord, int32& Out_Index)
 {
-	int32 Index = TileIndices[MouseOverHex.ToIntPoint()];
-	int32 InstanceIndex = AddISM(Index, MouseOverInstMesh, MouseOverInstMeshOffsetZ);
+	Out_Index = TileIndices.Find(AxialCoord);
+	return Out_Index != INDEX_NONE;
+}
 
-	MouseOverShowRadius = MouseOverShowRadius < NeighborRange ? MouseOverShowRadius : NeighborRange;
-	for (int32 i = 0; i < MouseOverShowRadius; i++)
+void AHexGrid::GetTileNeighbors(int32 TileIndex, TArray<FStructHexTileNeighbors>& Out_Neighbors)
+{
+	Out_Neighbors.Empty();
+	if (!Tiles.IsValidIndex(TileIndex) || TileIndex >= Adjacency.GetTileNum()) {
+		return;
+	}
+	Out_Neighbors.SetNum(Adjacency.GetNeighborRange());
+	for (int32 r = 0; r < Out_Neighbors.Num(); r++)
 	{
-		TArray<FIntPoint> RingTiles = Tiles[Index].Neighbors[i].Tiles;
-		for (int32 j = 0; j < RingTiles.Num(); j++)
+		FStructHexTileNeighbors& Neighbors = Out_Neighbors[r];
+		Neighbors.Radius = r + 1;
+		for (int32 NeighborIndex : Adjacency.GetRing(TileIndex, Neighbors.Radius))
 		{
-			InstanceIndex = AddISM(TileIndices[RingTiles[j]], MouseOverInstMesh, MouseOverInstMeshOffsetZ);
+			Neighbors.Tiles.Add(Tiles.AxialCoords[NeighborIndex]);
 		}
+		Neighbors.Count = Neighbors.Tiles.Num();
 	}
 }
 
@@ -4,12 +4,16 @@
 
 #include "StructDefine.h"
 #include "Hex.h"
+#include "HexGridDataLoader.h"
+#include "HexGridCornerLattice.h"
+#include "HexGridTileKernel.h"
+#include "WorkflowGraph.h"
+#include "WorkflowProfiler.h"
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 
-#include <iostream>
-#include <fstream>
+#include <atomic>
 
 #include "HexGrid.generated.h"
 
@@ -21,14 +25,17 @@ UENUM(BlueprintType)
 enum class Enum_HexGridWorkflowState : uint8
 {
 	InitWorkflow,
+	WaitTerrainBounds,
+	BuildGrid,
+	LoadBinaryData,
 	LoadParams,
 	LoadTileIndices,
 	LoadTiles,
 	LoadNeighbors,
 	CreateTilesVertices,
 	WaitTerrain,
-	SetTilesPosZ,
-	CalTilesNormal,
+	LoadBakedCache,
+	SetTilesGeometry,
 	SetTilesWalkingBlockLevel,
 	SetTilesWalkingBlockLevelEx,
 	InitCheckTerrainWalkingConnection,
@@ -37,6 +44,7 @@ enum class Enum_HexGridWorkflowState : uint8
 	FindTilesIsland,
 	SetTilesBuildingBlockLevel,
 	SetTilesBuildingBlockLevelEx,
+	SaveBakedCache,
 	DrawMesh,
 	Done,
 	Error
@@ -56,12 +64,6 @@ class MAPTESTCPP_API AHexGrid : public AActor
 	GENERATED_BODY()
 	
 private:
-	//Delimiter
-	FString PipeDelim = FString(TEXT("|"));
-	FString CommaDelim = FString(TEXT(","));
-	FString SpaceDelim = FString(TEXT(" "));
-	//FString ColonDelim = FString(TEXT(":"));
-
 	//Delegate
 	FTimerDynamicDelegate WorkflowDelegate;
 	FTimerDynamicDelegate CheckMouseOverDelegate;
@@ -69,11 +71,44 @@ private:
 	//Timer handle
 	FTimerHandle CheckTimerHandle;
 
-	//ifstream for data load
-	std::ifstream DataLoadStream;
+	//Workflow stages as a task graph
+	WorkflowGraph Graph;
+
+	//Per stage timings of the workflow
+	WorkflowProfiler Profiler;
+
+	//Set by any stage that fails, graph stages never write WorkflowState
+	std::atomic<bool> bWorkflowFailed = false;
+	//Furthest state the graph stages reached, copied into WorkflowState on the game thread
+	std::atomic<Enum_HexGridWorkflowState> GraphWorkflowState = Enum_HexGridWorkflowState::InitWorkflow;
+
+	//Data files loader
+	HexGridDataLoader DataLoader;
+
+	//Tiles as columns by tile index
+	HexGridTileStore Tiles;
+
+	//Tile vertices shared by neighbor tiles
+	HexGridCornerLattice Corners;
+
+	//Set by the map registry once the terrain init is done
+	UE::Tasks::FTaskEvent TerrainReadyEvent{ TEXT("HexGridTerrainReady") };
+	//Set once the terrain heightfield the heights are read from is filled
+	UE::Tasks::FTaskEvent TerrainHeightfieldEvent{ TEXT("HexGridTerrainHeightfield") };
+
+	//Baked cache
+	uint64 BakedCacheKey = 0;
+	bool bBakedCacheHit = false;
+	UE::Tasks::FTask SaveBakedCacheTask;
+
+	//Axial coord to tile index
+	HexGridIndex TileIndices;
+
+	//Neighbor rings of every tile by tile index
+	HexGridAdjacency Adjacency;
 
 	//Terrain
-	ATerrain* Terrain;
+	ATerrain* Terrain = nullptr;
 
 	//Mouse over
 	Hex MouseOverHex;
@@ -81,9 +116,9 @@ private:
 	//Block data
 	int32 WalkingBlockLevelMax = 0;
 	TSet<int32> MaxWalkingBlockTileIndices;
-
-	//Create tiles vertices tmp data
-	TArray<FVector> TileVerticesVectors;
+	//Levels before the extension passes, walking and building run at once on the graph
+	HexGridTileDoubleBuffer<uint8> WalkingBlockLevelsBack;
+	HexGridTileDoubleBuffer<uint8> BuildingBlockLevelsBack;
 
 	//Hex ISM mesh
 	float HexInstanceScale = 1.0;
@@ -91,6 +126,9 @@ private:
 
 	//BuildingBlock data
 	int32 BuildingBlockLevelMax = 0;
+	//Ratios the building passes use, derived on the game thread before they start
+	float BuildingAltitudeRatio = 0.f;
+	float BuildingSlopeRatio = 0.f;
 
 	//Check Terrain connection data
 	TSet<int32> CheckWalkingConnectionReached;
@@ -116,6 +154,10 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Timer")
 	float CheckTimerRate = 0.02f;
 
+	//Run loading and the tile passes as a task graph on worker threads, drawing stays on the timer workflow
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Workflow")
+	bool bRunWorkflowAsGraph = true;
+
 	//Path
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Path")
 	FString ParamsDataPath = FString(TEXT("Data/Params.data"));
@@ -125,20 +167,20 @@ protected:
 	FString TilesDataPath = FString(TEXT("Data/Tiles.data"));
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Path")
 	FString NeighborsDataPathPrefix = FString(TEXT("Data/N"));
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Path")
+	FString BinaryDataPath = FString(TEXT("Data/HexGrid.bin"));
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Path")
+	bool bUseBinaryData = true;
+	//Relative to Saved dir
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Path")
+	FString BakedCachePath = FString(TEXT("HexGrid/BakedGrid.bin"));
+	//Skip the terrain passes when grid data, terrain and block params are unchanged since the last run
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Path")
+	bool bUseBakedCache = true;
 
 	//Loop BP
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData LoadTileIndicesLoopData;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData LoadTilesLoopData;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData LoadNeighborsLoopData;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData CreateTilesVerticesLoopData;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData SetTilesPosZLoopData;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData CalTilesNormalLoopData;
+	FStructLoopData SetTilesGeometryLoopData;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
 	FStructLoopData SetTilesWalkingBlockLevelLoopData;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
@@ -154,12 +196,6 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
 	FStructLoopData AddTilesInstanceLoopData;
 
-	//Load from data file
-	UPROPERTY(BlueprintReadOnly)
-	TArray<FStructHexTileData> Tiles;
-	UPROPERTY(BlueprintReadOnly)
-	TMap<FIntPoint, int32> TileIndices;
-
 	UPROPERTY(BlueprintReadOnly)
 	TArray<FVector> MouseOverVertices;
 	UPROPERTY(BlueprintReadOnly)
@@ -180,13 +216,17 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Params")
 	int32 ParamNum = 3;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Custom|Params")
-	float TileSize = 0.0f;
+	//Build tiles and neighbors from TileSize, GridRange and NeighborRange, clipped by terrain, no data files
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Params")
+	bool bBuildProcedural = true;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Custom|Params")
-	int32 GridRange = 10;
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Custom|Params", meta = (ClampMin = "0.0"))
+	float TileSize = 100.0f;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Custom|Params")
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Custom|Params", meta = (ClampMin = "0"))
+	int32 GridRange = 100;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Custom|Params", meta = (ClampMin = "2", ClampMax = "100"))
 	int32 NeighborRange = 5;
 
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Custom|Params")
@@ -233,6 +273,7 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 private:
 	//Timer delegate
@@ -259,75 +300,64 @@ private:
 	//Init workflow
 	void InitWorkflow();
 	void InitLoopData();
+	void InitStageParams();
+
+	//Task graph workflow
+	void StartWorkflowGraph();
+	//Stages set the next state through this, inside the graph it is published to the game thread
+	void SetWorkflowState(Enum_HexGridWorkflowState State);
+	void PublishGraphWorkflowState();
+	void StartGraphLoadData();
+	void FinishGraphLoadData();
 
 	//Read file func
 	bool GetValidFilePath(const FString& RelPath, FString& FullPath);
 
-	//Load param
-	void LoadParamsFromFile();
-	void LoadParams(std::ifstream& ifs);
-	bool ParseParams(const FString& line);
-
-	//Load tiles indices data
-	void LoadTileIndicesFromFile();
-	void LoadTileIndices(std::ifstream& ifs);
-	void ParseTileIndexLine(const FString& line);
-
-	//Load tiles data
-	void LoadTilesFromFile();
-	void LoadTiles(std::ifstream& ifs);
-	void ParseTileLine(const FString& line, FStructHexTileData& Data);
-	void ParseIndex(const FString& ValueStr, const FString& KeyStr);
-	void ParseAxialCoord(const FString& Str, FStructHexTileData& Data);
-	void ParsePosition2D(const FString& Str, FStructHexTileData& Data);
-	
-	//Load NeighborData
-	void LoadNeighborsFromFile();
-	void CreateNeighborPath(FString& NeighborPath, int32 Radius);
-	bool LoadNeighbors(std::ifstream& ifs, int32 Radius);
-	void ParseNeighborsLine(const FString& Str, int32 Index, int32 Radius);
-	void ParseNeighbors(const FString& Str, int32 Index, int32 Radius);
-
-	//Parse string to other data type
-	void ParseIntPoint(const FString& Str, FIntPoint& Point);
-	void ParseVector2D(const FString& Str, FVector2D& Vec2D);
-	void ParseVector(const FString& Str, FVector& Vec);
-	void ParseInt(const FString& Str, int32& value);
-
-	//Loop Function for all workflow of tiles loop
-	bool TilesLoopFunction(TFunction<void()> InitFunc, TFunction<void(int32 LoopIndex)> LoopFunc, 
-		FStructLoopData& LoopData, Enum_HexGridWorkflowState State);
-
-	//Parse tiles vertices
-	void CreateTilesVertices();
-	void InitTileVerticesVertors();
-	void CreateTileVertices(int32 Index);
+	//Load data files or build grid on worker threads
+	//State the load runs under, BuildGrid, LoadBinaryData when the file exists with its path, else LoadParams for text
+	Enum_HexGridWorkflowState GetLoadDataState(FString& Out_BinaryPath);
+	void StartLoadData();
+	void WaitTerrainBounds();
+	void WaitLoadDataStep(HexGridDataLoader::EStep Step, Enum_HexGridWorkflowState NextState);
+	void PublishLoadData();
 
-	//Wait terrain noise
-	void WaitTerrain();
+	//Loop Function for all workflow of tiles loop, Kernel(TileIndex) runs on worker threads unless bGameThread
+	template<typename KernelType>
+	bool TilesLoopFunction(TFunction<void()> InitFunc, const KernelType& Kernel, FStructLoopData& LoopData,
+		Enum_HexGridWorkflowState State, bool bGameThread = false);
 
-	//Set tiles PosZ
-	void SetTilesPosZ();
-	void SetTilePosZ(int32 Index);
-	void SetTileCenterPosZ(FStructHexTileData& Data);
-	void SetTileVerticesPosZ(FStructHexTileData& Data);
+	//Build shared tiles vertices
+	void CreateTilesVertices();
 
-	//Calculate Normal
-	void CalTilesNormal();
-	void InitCalTilesNormal();
+	//Wait terrain init, then its heightfield
+	void WaitTerrain();
+	void OnTerrainReady(ATerrain* InTerrain);
+	void NotifyStageDone();
+
+	//Baked cache
+	void LoadBakedCache();
+	void SaveBakedCache();
+	uint64 MakeBakedCacheKey();
+
+	//Set tiles heights and normals in one stage
+	void SetTilesGeometry();
+	void InitSetTilesGeometry();
+	void SetTilesPosZ(int32 Begin, int32 End);
+	void SetCornersPosZ(int32 Begin, int32 End);
 	void CalTileNormal(int32 Index);
 
 	//Set walking block level
 	void SetTilesWalkingBlockLevel();
 	void InitSetTilesWalkingBlockLevel();
-	bool SetTileWalkingBlock(FStructHexTileData& Data, FStructHexTileData& CheckData, int32 BlockLevel);
+	bool IsTileWalkingBlock(int32 CheckIndex);
 	void SetTileWalkingBlockLevelByNeighbors(int32 Index);
-	bool SetTileWalkingBlockLevelByNeighbor(FStructHexTileData& Data, int32 Index);
+	bool SetTileWalkingBlockLevelByNeighbor(int32 Index, int32 Radius);
 
 	//Set walking block level extension
 	void SetTilesWalkingBlockLevelEx();
 	void InitSetTilesWalkingBlockLevelEx();
 	void SetTileWalkingBlockLevelByNeighborsEx(int32 Index);
+	void CollectMaxWalkingBlockTiles();
 
 	//Check Terrain walking connection
 	void CheckTerrainWalkingConnection();
@@ -346,9 +376,9 @@ private:
 	//Set Building Block level
 	void SetTilesBuildingBlockLevel();
 	void InitSetTilesBuildingBlockLevel();
-	bool SetTileBuildingBlock(FStructHexTileData& Data, FStructHexTileData& CheckData, int32 BuildingBlockLevel);
+	bool IsTileBuildingBlock(int32 CheckIndex);
 	void SetTileBuildingBlockLevelByNeighbors(int32 Index);
-	bool SetTileBuildingBlockLevelByNeighbor(FStructHexTileData& Data, int32 Index);
+	bool SetTileBuildingBlockLevelByNeighbor(int32 Index, int32 Radius);
 
 	//Set Building Block level extension
 	void SetTilesBuildingBlockLevelEx();
@@ -365,25 +395,71 @@ private:
 	void AddTileInstanceDataByWalkingBlock(int32 TileIndex, int32 InstanceIndex);
 
 	bool IsInMapRange(int32 Index);
-	bool IsInMapRange(const FStructHexTileData& Tile);
+
+	void CancelWorkflow();
+	void ResetWorkflowData();
 
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
+	//Whole grid pipeline on the calling thread without drawing or baked cache, Terrain after InitHeadless.
+	//InitHeadless on the game thread first, RunHeadless inside a task.
+	void InitHeadless();
+	bool RunHeadless(ATerrain* InTerrain);
+
+	//Tile results in the baked cache layout, the grid itself comes from the params
+	bool SaveTileData(const FString& FullPath);
+
+	//Cancel the workflow and build again with the current params and terrain, buffers keep their allocations
+	UFUNCTION(BlueprintCallable)
+	void Regenerate();
+
 	//Mouse over grid
 	UFUNCTION(BlueprintCallable)
 		void MouseOverGrid(const FVector2D& MousePos);
 
+	//Copy of one tile from the columns, left untouched for an invalid index
+	UFUNCTION(BlueprintCallable)
+	void GetTileData(int32 TileIndex, FStructHexTileData& Out_Data);
+
+	UFUNCTION(BlueprintCallable)
+	FORCEINLINE int32 GetTileNum()
+	{
+		return Tiles.Num();
+	}
+
+	//False when the coord is not a tile
+	UFUNCTION(BlueprintCallable)
+	bool FindTileIndex(const FIntPoint& AxialCoord, int32& Out_Index);
+
+	//Neighbor rings of a tile as axial coords, built on demand from the adjacency
+	UFUNCTION(BlueprintCallable)
+	void GetTileNeighbors(int32 TileIndex, TArray<FStructHexTileNeighbors>& Out_Neighbors);
+
 	UFUNCTION(BlueprintCallable)
 	FORCEINLINE bool IsWorkFlowDone()
 	{
 		return WorkflowState == Enum_HexGridWorkflowState::Done;
 	}
 
+	FORCEINLINE bool IsWorkFlowOverStage(Enum_HexGridWorkflowState State)
+	{
+		return WorkflowState > State;
+	}
+
+	FORCEINLINE const WorkflowProfiler& GetProfiler() const
+	{
+		return Profiler;
+	}
+
+	FORCEINLINE bool IsWorkFlowError()
+	{
+		return WorkflowState == Enum_HexGridWorkflowState::Error;
+	}
+
 private:
 	//Mouse over
-	Hex PosToHex(const FVector2D& Point, float Size);
 	void AddMouseOverTilesInstance();
 	void RemoveMouseOverTilesInstance();
 
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridAdjacency.h"
+
+HexGridAdjacency::HexGridAdjacency()
+{
+}
+
+HexGridAdjacency::~HexGridAdjacency()
+{
+}
+
+bool HexGridAdjacency::Adopt(int32 InTileNum, int32 InNeighborRange, TArray<int32>&& InRingOffsets,
+	TArray<int32>&& InRingTiles)
+{
+	int32 RingNum = InTileNum * InNeighborRange;
+	if (InRingOffsets.Num() != RingNum + 1 || InRingOffsets[0] != 0 || InRingOffsets[RingNum] != InRingTiles.Num()) {
+		return false;
+	}
+	for (int32 k = 0; k < RingNum; k++)
+	{
+		if (InRingOffsets[k] > InRingOffsets[k + 1]) {
+			return false;
+		}
+	}
+	for (int32 NeighborIndex : InRingTiles)
+	{
+		if (NeighborIndex < 0 || NeighborIndex >= InTileNum) {
+			return false;
+		}
+	}
+
+	TileNum = InTileNum;
+	NeighborRange = InNeighborRange;
+	RingOffsets = MoveTemp(InRingOffsets);
+	RingTiles = MoveTemp(InRingTiles);
+	RingClipped.SetNumZeroed(RingNum);
+	return true;
+}
+
+void HexGridAdjacency::Reset()
+{
+	TileNum = 0;
+	NeighborRange = 0;
+	RingOffsets.Reset();
+	RingTiles.Reset();
+	RingClipped.Reset();
+}
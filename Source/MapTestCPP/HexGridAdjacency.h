@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/ParallelFor.h"
+
+/**
+ * Neighbor rings of every tile as tile indices in one compressed sparse row store.
+ * Ring of tile i at radius r is RingTiles[RingOffsets[k], RingOffsets[k + 1]) with k = i * NeighborRange + r - 1.
+ */
+class MAPTESTCPP_API HexGridAdjacency
+{
+public:
+	//Block levels are uint8 up to NeighborRange * 2 + 1 and the island search reads rings 1 and 2
+	static constexpr int32 MinNeighborRange = 2;
+	static constexpr int32 MaxNeighborRange = 100;
+
+private:
+	int32 TileNum = 0;
+	int32 NeighborRange = 0;
+	TArray<int32> RingOffsets;
+	TArray<int32> RingTiles;
+
+	//One flag per ring, set when some ring tiles are in grid range but clipped by map range
+	TArray<uint8> RingClipped;
+
+public:
+	HexGridAdjacency();
+	~HexGridAdjacency();
+	HexGridAdjacency(const HexGridAdjacency&) = default;
+	HexGridAdjacency(HexGridAdjacency&&) = default;
+	HexGridAdjacency& operator=(const HexGridAdjacency&) = default;
+	HexGridAdjacency& operator=(HexGridAdjacency&&) = default;
+
+	//RingFunc(TileIndex, Radius, Visitor) calls Visitor(NeighborIndex) for every ring tile, INDEX_NONE for a clipped one.
+	//It is called twice per ring from worker threads, once to count and once to fill.
+	template<typename RingFuncType>
+	void Build(int32 InTileNum, int32 InNeighborRange, RingFuncType&& RingFunc)
+	{
+		TileNum = InTileNum;
+		NeighborRange = InNeighborRange;
+		int32 RingNum = TileNum * NeighborRange;
+		RingOffsets.SetNumZeroed(RingNum + 1);
+		RingClipped.SetNumZeroed(RingNum);
+
+		ParallelFor(TileNum, [this, &RingFunc](int32 i) {
+			for (int32 Radius = 1; Radius <= NeighborRange; Radius++)
+			{
+				int32 Count = 0;
+				bool Clipped = false;
+				RingFunc(i, Radius, [&Count, &Clipped](int32 NeighborIndex) {
+					if (NeighborIndex == INDEX_NONE) {
+						Clipped = true;
+					}
+					else {
+						Count++;
+					}
+				});
+				int32 Ring = GetRingIndex(i, Radius);
+				RingOffsets[Ring + 1] = Count;
+				RingClipped[Ring] = Clipped;
+			}
+		});
+		for (int32 k = 0; k < RingNum; k++)
+		{
+			RingOffsets[k + 1] += RingOffsets[k];
+		}
+
+		RingTiles.SetNumUninitialized(RingOffsets[RingNum]);
+		ParallelFor(TileNum, [this, &RingFunc](int32 i) {
+			for (int32 Radius = 1; Radius <= NeighborRange; Radius++)
+			{
+				int32 Cursor = RingOffsets[GetRingIndex(i, Radius)];
+				RingFunc(i, Radius, [this, &Cursor](int32 NeighborIndex) {
+					if (NeighborIndex != INDEX_NONE) {
+						RingTiles[Cursor++] = NeighborIndex;
+					}
+				});
+			}
+		});
+	}
+
+	FORCEINLINE static bool IsValidNeighborRange(int32 InNeighborRange)
+	{
+		return InNeighborRange >= MinNeighborRange && InNeighborRange <= MaxNeighborRange;
+	}
+
+	//Take prebuilt arrays, e.g. from the binary dataset
+	bool Adopt(int32 InTileNum, int32 InNeighborRange, TArray<int32>&& InRingOffsets, TArray<int32>&& InRingTiles);
+	void Reset();
+
+	FORCEINLINE TArrayView<const int32> GetRing(int32 TileIndex, int32 Radius) const
+	{
+		int32 Ring = GetRingIndex(TileIndex, Radius);
+		return TArrayView<const int32>(RingTiles.GetData() + RingOffsets[Ring], RingOffsets[Ring + 1] - RingOffsets[Ring]);
+	}
+
+	FORCEINLINE bool IsRingClipped(int32 TileIndex, int32 Radius) const
+	{
+		return RingClipped[GetRingIndex(TileIndex, Radius)] != 0;
+	}
+
+	FORCEINLINE int32 GetNeighborRange() const
+	{
+		return NeighborRange;
+	}
+
+	FORCEINLINE int32 GetTileNum() const
+	{
+		return TileNum;
+	}
+
+	FORCEINLINE const TArray<int32>& GetRingOffsets() const
+	{
+		return RingOffsets;
+	}
+
+	FORCEINLINE const TArray<int32>& GetRingTiles() const
+	{
+		return RingTiles;
+	}
+
+private:
+	FORCEINLINE int32 GetRingIndex(int32 TileIndex, int32 Radius) const
+	{
+		return TileIndex * NeighborRange + Radius - 1;
+	}
+
+};
@@ -0,0 +1,138 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridBakedCache.h"
+
+#include <HAL/FileManager.h>
+
+//'HXGB'
+const uint32 HexGridBakedCache::Magic = 0x42475848;
+//Bump when a terrain pass changes its results
+const uint32 HexGridBakedCache::Version = 2;
+
+HexGridBakedCache::HexGridBakedCache()
+{
+}
+
+HexGridBakedCache::~HexGridBakedCache()
+{
+}
+
+void HexGridBakedCache::HashGrid(FXxHash64Builder& Builder, const HexGridTileStore& Tiles, const HexGridAdjacency& Adjacency)
+{
+	HashValue(Builder, Version);
+	HashValue(Builder, Tiles.Num());
+	Builder.Update(Tiles.AxialCoords.GetData(), Tiles.AxialCoords.Num() * sizeof(FIntPoint));
+	Builder.Update(Tiles.Positions2D.GetData(), Tiles.Positions2D.Num() * sizeof(FVector2D));
+	HashValue(Builder, Adjacency.GetNeighborRange());
+	Builder.Update(Adjacency.GetRingOffsets().GetData(), Adjacency.GetRingOffsets().Num() * sizeof(int32));
+	Builder.Update(Adjacency.GetRingTiles().GetData(), Adjacency.GetRingTiles().Num() * sizeof(int32));
+}
+
+template<typename ElementType>
+static bool ReadColumn(FArchive& Reader, TArray<ElementType>& Column, int32 Num)
+{
+	if (Column.Num() != Num) {
+		return false;
+	}
+	Reader.Serialize(Column.GetData(), (int64)Num * sizeof(ElementType));
+	return !Reader.IsError();
+}
+
+template<typename ElementType>
+static bool WriteColumn(FArchive& Writer, const TArray<ElementType>& Column, int32 Num)
+{
+	if (Column.Num() != Num) {
+		return false;
+	}
+	//FArchive only takes mutable data, a writer does not touch it
+	Writer.Serialize(const_cast<ElementType*>(Column.GetData()), (int64)Num * sizeof(ElementType));
+	return !Writer.IsError();
+}
+
+bool HexGridBakedCache::Load(const FString& FullPath, uint64 Key, HexGridTileStore& Out_Tiles, HexGridCornerLattice& Out_Corners)
+{
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*FullPath));
+	if (!Reader.IsValid()) {
+		UE_LOG(HexGridData, Log, TEXT("No baked cache %s."), *FullPath);
+		return false;
+	}
+
+	FHexGridBakedHeader Header;
+	if (Reader->TotalSize() < (int64)sizeof(FHexGridBakedHeader)) {
+		UE_LOG(HexGridData, Warning, TEXT("Baked cache %s is too small!"), *FullPath);
+		return false;
+	}
+	Reader->Serialize(&Header, sizeof(FHexGridBakedHeader));
+	if (Header.Magic != Magic || Header.Version != Version || Header.Key != Key) {
+		UE_LOG(HexGridData, Log, TEXT("Baked cache %s is stale."), *FullPath);
+		return false;
+	}
+	if (Header.TileCount != Out_Tiles.Num() || Header.CornerCount != Out_Corners.Num()) {
+		UE_LOG(HexGridData, Warning, TEXT("Baked cache %s does not match the grid!"), *FullPath);
+		return false;
+	}
+
+	int32 TileNum = Header.TileCount;
+	Out_Tiles.InitTerrainColumns();
+	bool Success = ReadColumn(*Reader, Out_Tiles.PositionsZ, TileNum)
+		&& ReadColumn(*Reader, Out_Tiles.AvgPositionsZ, TileNum)
+		&& ReadColumn(*Reader, Out_Tiles.Normals, TileNum)
+		&& ReadColumn(*Reader, Out_Tiles.AnglesToUp, TileNum)
+		&& ReadColumn(*Reader, Out_Tiles.WalkingBlockLevels, TileNum)
+		&& ReadColumn(*Reader, Out_Tiles.FlyingBlockLevels, TileNum)
+		&& ReadColumn(*Reader, Out_Tiles.BuildingBlockLevels, TileNum)
+		&& ReadColumn(*Reader, Out_Tiles.IsLand, TileNum)
+		&& ReadColumn(*Reader, Out_Tiles.WalkingConnections, TileNum)
+		&& ReadColumn(*Reader, Out_Corners.PositionsZ, Header.CornerCount);
+	if (!Success) {
+		UE_LOG(HexGridData, Warning, TEXT("Read baked cache %s failed!"), *FullPath);
+		Out_Tiles.InitTerrainColumns();
+		return false;
+	}
+
+	UE_LOG(HexGridData, Log, TEXT("Load baked cache %s done, tiles=%d!"), *FullPath, TileNum);
+	return true;
+}
+
+bool HexGridBakedCache::Save(const FString& FullPath, uint64 Key, const HexGridTileStore& Tiles, const HexGridCornerLattice& Corners)
+{
+	FHexGridBakedHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+	Header.Key = Key;
+	Header.TileCount = Tiles.Num();
+	Header.CornerCount = Corners.Num();
+
+	//Write next to the cache and swap, a crash never leaves a half written cache behind
+	FString TempPath = FullPath + TEXT(".tmp");
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*TempPath));
+	if (!Writer.IsValid()) {
+		UE_LOG(HexGridData, Warning, TEXT("Create baked cache %s failed!"), *TempPath);
+		return false;
+	}
+
+	int32 TileNum = Header.TileCount;
+	Writer->Serialize(&Header, sizeof(FHexGridBakedHeader));
+	bool Success = WriteColumn(*Writer, Tiles.PositionsZ, TileNum)
+		&& WriteColumn(*Writer, Tiles.AvgPositionsZ, TileNum)
+		&& WriteColumn(*Writer, Tiles.Normals, TileNum)
+		&& WriteColumn(*Writer, Tiles.AnglesToUp, TileNum)
+		&& WriteColumn(*Writer, Tiles.WalkingBlockLevels, TileNum)
+		&& WriteColumn(*Writer, Tiles.FlyingBlockLevels, TileNum)
+		&& WriteColumn(*Writer, Tiles.BuildingBlockLevels, TileNum)
+		&& WriteColumn(*Writer, Tiles.IsLand, TileNum)
+		&& WriteColumn(*Writer, Tiles.WalkingConnections, TileNum)
+		&& WriteColumn(*Writer, Corners.PositionsZ, Header.CornerCount);
+	Success = Writer->Close() && Success;
+	Writer.Reset();
+
+	if (!Success || !IFileManager::Get().Move(*FullPath, *TempPath, true, true)) {
+		UE_LOG(HexGridData, Warning, TEXT("Write baked cache %s failed!"), *FullPath);
+		IFileManager::Get().Delete(*TempPath);
+		return false;
+	}
+
+	UE_LOG(HexGridData, Log, TEXT("Save baked cache %s done, tiles=%d!"), *FullPath, TileNum);
+	return true;
+}
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "HexGridTextParser.h"
+#include "HexGridAdjacency.h"
+#include "HexGridTileStore.h"
+#include "HexGridCornerLattice.h"
+
+#include "CoreMinimal.h"
+#include "Hash/xxhash.h"
+
+/*
+ * Baked hex grid cache layout (little endian), every column TileCount entries unless noted:
+ *   FHexGridBakedHeader
+ *   float PositionsZ, float AvgPositionsZ, FVector Normals, float AnglesToUp
+ *   uint8 WalkingBlockLevels, uint8 FlyingBlockLevels, uint8 BuildingBlockLevels, bool IsLand, bool WalkingConnections
+ *   float CornerPositionsZ[CornerCount]
+ */
+struct FHexGridBakedHeader
+{
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	uint64 Key = 0;
+	int32 TileCount = 0;
+	int32 CornerCount = 0;
+};
+
+/**
+ * Per tile results of the terrain passes, keyed by a hash of the grid content and every parameter they read.
+ * Grid columns and corner positions are not stored, they come from the grid data the key is made of.
+ */
+class MAPTESTCPP_API HexGridBakedCache
+{
+public:
+	static const uint32 Magic;
+	static const uint32 Version;
+
+public:
+	HexGridBakedCache();
+	~HexGridBakedCache();
+
+	//Grid content part of the key, tiles and neighbor rings as loaded or built
+	static void HashGrid(FXxHash64Builder& Builder, const HexGridTileStore& Tiles, const HexGridAdjacency& Adjacency);
+
+	template<typename ValueType>
+	static void HashValue(FXxHash64Builder& Builder, const ValueType& Value)
+	{
+		Builder.Update(&Value, sizeof(ValueType));
+	}
+
+	//Grid columns and corner positions must already match the cache, false on any mismatch
+	static bool Load(const FString& FullPath, uint64 Key, HexGridTileStore& Out_Tiles, HexGridCornerLattice& Out_Corners);
+
+	static bool Save(const FString& FullPath, uint64 Key, const HexGridTileStore& Tiles, const HexGridCornerLattice& Corners);
+
+};
@@ -0,0 +1,260 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridBinaryData.h"
+
+#include <HAL/PlatformFileManager.h>
+#include <HAL/FileManager.h>
+#include <HAL/IConsoleManager.h>
+#include <Async/MappedFileHandle.h>
+#include <Misc/FileHelper.h>
+#include <Misc/Paths.h>
+
+//'HXGD'
+const uint32 HexGridBinaryData::Magic = 0x44475848;
+const uint32 HexGridBinaryData::Version = 2;
+
+HexGridBinaryData::HexGridBinaryData()
+{
+}
+
+HexGridBinaryData::~HexGridBinaryData()
+{
+}
+
+bool HexGridBinaryData::Load(const FString& FullPath, float& Out_TileSize, int32& Out_GridRange, int32& Out_NeighborRange,
+	HexGridTileStore& Out_Tiles, HexGridIndex& Out_TileIndices, HexGridAdjacency& Out_Adjacency)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	TUniquePtr<IMappedFileHandle> MappedFile(PlatformFile.OpenMapped(*FullPath));
+	if (!MappedFile.IsValid()) {
+		UE_LOG(HexGridData, Warning, TEXT("Map file %s failed!"), *FullPath);
+		return false;
+	}
+
+	int64 FileSize = MappedFile->GetFileSize();
+	if (FileSize < (int64)sizeof(FHexGridBinaryHeader)) {
+		UE_LOG(HexGridData, Warning, TEXT("File %s is too small!"), *FullPath);
+		return false;
+	}
+
+	TUniquePtr<IMappedFileRegion> MappedRegion(MappedFile->MapRegion(0, FileSize, true));
+	if (!MappedRegion.IsValid()) {
+		UE_LOG(HexGridData, Warning, TEXT("Map region of %s failed!"), *FullPath);
+		return false;
+	}
+	const uint8* Data = MappedRegion->GetMappedPtr();
+
+	FHexGridBinaryHeader Header;
+	FMemory::Memcpy(&Header, Data, sizeof(FHexGridBinaryHeader));
+	if (Header.Magic != Magic || Header.Version != Version) {
+		UE_LOG(HexGridData, Warning, TEXT("File %s has wrong magic or version %u!"), *FullPath, Header.Version);
+		return false;
+	}
+
+	if (!HexGridAdjacency::IsValidNeighborRange(Header.NeighborRange)) {
+		UE_LOG(HexGridData, Warning, TEXT("File %s has NeighborRange %d out of [%d, %d]!"), *FullPath, Header.NeighborRange,
+			HexGridAdjacency::MinNeighborRange, HexGridAdjacency::MaxNeighborRange);
+		return false;
+	}
+
+	int64 TileCount = Header.TileCount;
+	int64 RingCount = TileCount * Header.NeighborRange;
+	int64 TilesEnd = Header.TilesOffset + TileCount * (int64)sizeof(FHexGridBinaryTile);
+	int64 RingOffsetsEnd = Header.NeighborsOffset + (RingCount + 1) * (int64)sizeof(int32);
+	//Sections are read in place, so their offsets must keep the record alignment of the page aligned mapping
+	if (TileCount < 0 || Header.TilesOffset < (int64)sizeof(FHexGridBinaryHeader)
+		|| Header.TilesOffset % alignof(FHexGridBinaryTile) != 0 || Header.NeighborsOffset % alignof(int32) != 0
+		|| TilesEnd > Header.NeighborsOffset || RingOffsetsEnd > FileSize) {
+		UE_LOG(HexGridData, Warning, TEXT("File %s has broken sections!"), *FullPath);
+		return false;
+	}
+
+	const FHexGridBinaryTile* Records = reinterpret_cast<const FHexGridBinaryTile*>(Data + Header.TilesOffset);
+	const int32* RingOffsets = reinterpret_cast<const int32*>(Data + Header.NeighborsOffset);
+	const int32* RingTiles = RingOffsets + RingCount + 1;
+	int64 PointCount = RingOffsets[RingCount];
+	if (PointCount < 0 || RingOffsetsEnd + PointCount * (int64)sizeof(int32) > FileSize) {
+		UE_LOG(HexGridData, Warning, TEXT("File %s has broken neighbor section!"), *FullPath);
+		return false;
+	}
+
+	Out_TileSize = Header.TileSize;
+	Out_GridRange = Header.GridRange;
+	Out_NeighborRange = Header.NeighborRange;
+
+	Out_Tiles.SetNum(Header.TileCount);
+	for (int32 i = 0; i < Header.TileCount; i++)
+	{
+		const FHexGridBinaryTile& Record = Records[i];
+		Out_Tiles.AxialCoords[i] = FIntPoint(Record.Q, Record.R);
+		Out_Tiles.Positions2D[i] = FVector2D(Record.X, Record.Y);
+	}
+	Out_TileIndices.Build(Out_Tiles.AxialCoords);
+
+	//Neighbor section is already the adjacency layout
+	if (!Out_Adjacency.Adopt(Header.TileCount, Header.NeighborRange, TArray<int32>(RingOffsets, int32(RingCount + 1)),
+		TArray<int32>(RingTiles, int32(PointCount)))) {
+		UE_LOG(HexGridData, Warning, TEXT("File %s has broken ring offsets or tiles!"), *FullPath);
+		return false;
+	}
+
+	UE_LOG(HexGridData, Log, TEXT("Load binary data %s done, tiles=%d!"), *FullPath, Header.TileCount);
+	return true;
+}
+
+bool HexGridBinaryData::ConvertFromText(const FString& ParamsPath, const FString& TileIndicesPath, const FString& TilesPath,
+	const FString& NeighborsPathPrefix, const FString& OutPath)
+{
+	FHexGridBinaryHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+
+	//Params
+	TArray<uint8> Buffer;
+	TArray<TPair<int32, int32>> Lines;
+	if (!LoadTextLines(ParamsPath, Buffer, Lines, true) || Lines.IsEmpty()) {
+		UE_LOG(HexGridData, Warning, TEXT("Read params file %s failed!"), *ParamsPath);
+		return false;
+	}
+	if (!HexGridTextParser::ParseParamsLine(HexGridTextParser::LineBegin(Buffer, Lines[0]),
+		HexGridTextParser::LineEnd(Buffer, Lines[0]), Header.TileSize, Header.GridRange, Header.NeighborRange)) {
+		UE_LOG(HexGridData, Warning, TEXT("Parse params file %s failed!"), *ParamsPath);
+		return false;
+	}
+	if (!HexGridAdjacency::IsValidNeighborRange(Header.NeighborRange)) {
+		UE_LOG(HexGridData, Warning, TEXT("Params file %s has NeighborRange %d out of [%d, %d]!"), *ParamsPath,
+			Header.NeighborRange, HexGridAdjacency::MinNeighborRange, HexGridAdjacency::MaxNeighborRange);
+		return false;
+	}
+
+	//Tile indices, only used to filter neighbors which are not in the grid
+	TArray<TPair<FIntPoint, int32>> TileIndexPairs;
+	if (!LoadTextLines(TileIndicesPath, Buffer, Lines, true)) {
+		UE_LOG(HexGridData, Warning, TEXT("Read tile indices file %s failed!"), *TileIndicesPath);
+		return false;
+	}
+	TileIndexPairs.Reserve(Lines.Num());
+	for (const TPair<int32, int32>& Line : Lines)
+	{
+		FIntPoint Key;
+		int32 Value;
+		if (HexGridTextParser::ParseTileIndexLine(HexGridTextParser::LineBegin(Buffer, Line),
+			HexGridTextParser::LineEnd(Buffer, Line), Key, Value)) {
+			TileIndexPairs.Emplace(Key, Value);
+		}
+	}
+	HexGridIndex TileIndices;
+	TileIndices.Build(TileIndexPairs);
+
+	//Tiles
+	TArray<FHexGridBinaryTile> Records;
+	if (!LoadTextLines(TilesPath, Buffer, Lines, true)) {
+		UE_LOG(HexGridData, Warning, TEXT("Read tiles file %s failed!"), *TilesPath);
+		return false;
+	}
+	Records.Reserve(Lines.Num());
+	for (const TPair<int32, int32>& Line : Lines)
+	{
+		FIntPoint Coord;
+		FVector2D Pos;
+		if (!HexGridTextParser::ParseTileLine(HexGridTextParser::LineBegin(Buffer, Line),
+			HexGridTextParser::LineEnd(Buffer, Line), Coord, Pos)) {
+			UE_LOG(HexGridData, Warning, TEXT("Parse tile line %d failed!"), Records.Num());
+			return false;
+		}
+		FHexGridBinaryTile& Record = Records.AddDefaulted_GetRef();
+		Record.Q = Coord.X;
+		Record.R = Coord.Y;
+		Record.X = Pos.X;
+		Record.Y = Pos.Y;
+	}
+	Header.TileCount = Records.Num();
+
+	//Neighbors, one ring of tile indices per tile and radius
+	TArray<TArray<int32>> Rings;
+	Rings.SetNum(Header.TileCount * Header.NeighborRange);
+	for (int32 Radius = 1; Radius <= Header.NeighborRange; Radius++)
+	{
+		FString NeighborPath = NeighborsPathPrefix + FString::FromInt(Radius) + TEXT(".data");
+		if (!LoadTextLines(NeighborPath, Buffer, Lines, false)) {
+			UE_LOG(HexGridData, Warning, TEXT("Read neighbors file %s failed!"), *NeighborPath);
+			return false;
+		}
+		for (int32 i = 0; i < Lines.Num() && i < Header.TileCount; i++)
+		{
+			TArray<int32>& Ring = Rings[i * Header.NeighborRange + Radius - 1];
+			HexGridTextParser::ParseNeighborsLine(HexGridTextParser::LineBegin(Buffer, Lines[i]),
+				HexGridTextParser::LineEnd(Buffer, Lines[i]), [&Ring, &TileIndices, &Header](const FIntPoint& Point) {
+					int32 NeighborIndex = TileIndices.Find(Point);
+					if (NeighborIndex >= 0 && NeighborIndex < Header.TileCount) {
+						Ring.Add(NeighborIndex);
+					}
+				});
+		}
+	}
+
+	TArray<int32> RingOffsets;
+	RingOffsets.Reserve(Rings.Num() + 1);
+	int32 PointCount = 0;
+	for (const TArray<int32>& Ring : Rings)
+	{
+		RingOffsets.Add(PointCount);
+		PointCount += Ring.Num();
+	}
+	RingOffsets.Add(PointCount);
+
+	Header.TilesOffset = sizeof(FHexGridBinaryHeader);
+	Header.NeighborsOffset = Header.TilesOffset + (int64)Records.Num() * sizeof(FHexGridBinaryTile);
+
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*OutPath));
+	if (!Writer.IsValid()) {
+		UE_LOG(HexGridData, Warning, TEXT("Create binary file %s failed!"), *OutPath);
+		return false;
+	}
+	Writer->Serialize(&Header, sizeof(FHexGridBinaryHeader));
+	Writer->Serialize(Records.GetData(), Records.Num() * sizeof(FHexGridBinaryTile));
+	Writer->Serialize(RingOffsets.GetData(), RingOffsets.Num() * sizeof(int32));
+	for (TArray<int32>& Ring : Rings)
+	{
+		Writer->Serialize(Ring.GetData(), Ring.Num() * sizeof(int32));
+	}
+	bool Success = Writer->Close();
+
+	UE_LOG(HexGridData, Log, TEXT("Convert to binary data %s done, tiles=%d, neighbors=%d!"), *OutPath,
+		Header.TileCount, PointCount);
+	return Success;
+}
+
+bool HexGridBinaryData::LoadTextLines(const FString& FullPath, TArray<uint8>& Out_Buffer,
+	TArray<TPair<int32, int32>>& Out_Lines, bool bCullEmpty)
+{
+	Out_Buffer.Reset();
+	Out_Lines.Reset();
+	if (!FFileHelper::LoadFileToArray(Out_Buffer, *FullPath)) {
+		return false;
+	}
+	HexGridTextParser::SplitLines(Out_Buffer, Out_Lines, bCullEmpty);
+	return true;
+}
+
+//Console: HexGrid.ConvertTextData [Params] [TileIndices] [Tiles] [NeighborsPrefix] [Out]
+static void ConvertHexGridTextData(const TArray<FString>& Args)
+{
+	TArray<FString> Paths = { TEXT("Data/Params.data"), TEXT("Data/TileIndices.data"), TEXT("Data/Tiles.data"),
+		TEXT("Data/N"), TEXT("Data/HexGrid.bin") };
+	for (int32 i = 0; i < Args.Num() && i < Paths.Num(); i++)
+	{
+		Paths[i] = Args[i];
+	}
+	for (FString& Path : Paths)
+	{
+		Path = FPaths::ProjectDir() / Path;
+	}
+	HexGridBinaryData::ConvertFromText(Paths[0], Paths[1], Paths[2], Paths[3], Paths[4]);
+}
+
+static FAutoConsoleCommand ConvertHexGridTextDataCommand(
+	TEXT("HexGrid.ConvertTextData"),
+	TEXT("Convert the hex grid text data files to the binary dataset. Args: [Params] [TileIndices] [Tiles] [NeighborsPrefix] [Out], relative to project dir."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&ConvertHexGridTextData));
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "StructDefine.h"
+#include "HexGridTextParser.h"
+#include "HexGridAdjacency.h"
+#include "HexGridIndex.h"
+#include "HexGridTileStore.h"
+
+#include "CoreMinimal.h"
+
+/*
+ * Binary hex grid dataset layout (little endian):
+ *   FHexGridBinaryHeader
+ *   FHexGridBinaryTile[TileCount]                     fixed stride tile records
+ *   int32 RingOffsets[TileCount * NeighborRange + 1]  prefix sums, tile major, ring minor
+ *   int32 RingTiles[RingOffsets[Last]]                tile index of every ring neighbor
+ */
+struct FHexGridBinaryHeader
+{
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	float TileSize = 0.f;
+	int32 GridRange = 0;
+	int32 NeighborRange = 0;
+	int32 TileCount = 0;
+	int64 TilesOffset = 0;
+	int64 NeighborsOffset = 0;
+};
+
+struct FHexGridBinaryTile
+{
+	int32 Q = 0;
+	int32 R = 0;
+	double X = 0.0;
+	double Y = 0.0;
+};
+
+/**
+ *
+ */
+class MAPTESTCPP_API HexGridBinaryData
+{
+public:
+	static const uint32 Magic;
+	static const uint32 Version;
+
+public:
+	HexGridBinaryData();
+	~HexGridBinaryData();
+
+	//Map the binary dataset and adopt it into tiles, tile indices and adjacency
+	static bool Load(const FString& FullPath, float& Out_TileSize, int32& Out_GridRange, int32& Out_NeighborRange,
+		HexGridTileStore& Out_Tiles, HexGridIndex& Out_TileIndices, HexGridAdjacency& Out_Adjacency);
+
+	//Convert Params/TileIndices/Tiles/N*.data text files to one binary dataset
+	static bool ConvertFromText(const FString& ParamsPath, const FString& TileIndicesPath, const FString& TilesPath,
+		const FString& NeighborsPathPrefix, const FString& OutPath);
+
+private:
+	static bool LoadTextLines(const FString& FullPath, TArray<uint8>& Out_Buffer, TArray<TPair<int32, int32>>& Out_Lines,
+		bool bCullEmpty);
+
+};
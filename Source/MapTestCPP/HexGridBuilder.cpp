@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridBuilder.h"
+#include "HexGridTextParser.h"
+
+#include <Async/ParallelFor.h>
+
+const FIntPoint HexGridBuilder::Directions[6] = {
+	FIntPoint(1, 0), FIntPoint(1, -1), FIntPoint(0, -1), FIntPoint(-1, 0), FIntPoint(-1, 1), FIntPoint(0, 1)
+};
+
+HexGridBuilder::HexGridBuilder()
+{
+}
+
+HexGridBuilder::~HexGridBuilder()
+{
+}
+
+bool HexGridBuilder::Build(float TileSize, int32 GridRange, int32 NeighborRange, const FVector2D& MapSize,
+	HexGridTileStore& Out_Tiles, HexGridIndex& Out_TileIndices, HexGridAdjacency& Out_Adjacency)
+{
+	if (TileSize <= 0.f || GridRange < 0 || !HexGridAdjacency::IsValidNeighborRange(NeighborRange)) {
+		UE_LOG(HexGridData, Warning, TEXT("Build hex grid with wrong params, TileSize=%f GridRange=%d NeighborRange=%d!"),
+			TileSize, GridRange, NeighborRange);
+		return false;
+	}
+
+	//Count tiles in map range per q column, then fill every column at its prefix offset
+	int32 ColumnNum = GridRange * 2 + 1;
+	TArray<int32> ColumnOffsets;
+	ColumnOffsets.SetNumZeroed(ColumnNum + 1);
+	ParallelFor(ColumnNum, [&](int32 c) {
+		int32 q = c - GridRange;
+		int32 Count = 0;
+		for (int32 r = FMath::Max(-GridRange, -q - GridRange); r <= FMath::Min(GridRange, -q + GridRange); r++)
+		{
+			if (IsInMapRange(AxialToPosition(FIntPoint(q, r), TileSize), MapSize)) {
+				Count++;
+			}
+		}
+		ColumnOffsets[c + 1] = Count;
+	});
+	for (int32 c = 0; c < ColumnNum; c++)
+	{
+		ColumnOffsets[c + 1] += ColumnOffsets[c];
+	}
+
+	Out_Tiles.SetNum(ColumnOffsets[ColumnNum]);
+	ParallelFor(ColumnNum, [&](int32 c) {
+		int32 q = c - GridRange;
+		int32 Index = ColumnOffsets[c];
+		for (int32 r = FMath::Max(-GridRange, -q - GridRange); r <= FMath::Min(GridRange, -q + GridRange); r++)
+		{
+			FIntPoint Axial(q, r);
+			FVector2D Position = AxialToPosition(Axial, TileSize);
+			if (IsInMapRange(Position, MapSize)) {
+				Out_Tiles.AxialCoords[Index] = Axial;
+				Out_Tiles.Positions2D[Index] = Position;
+				Index++;
+			}
+		}
+	});
+
+	Out_TileIndices.Build(Out_Tiles.AxialCoords);
+
+	//Ring points out of grid range are dropped as the data files did, the clipped ones are flagged
+	const FIntPoint Origin(0, 0);
+	Out_Adjacency.Build(Out_Tiles.Num(), NeighborRange, [&Out_Tiles, &Out_TileIndices, &Origin, GridRange](
+		int32 TileIndex, int32 Radius, auto&& Visitor) {
+		ForEachRingPoint(Out_Tiles.AxialCoords[TileIndex], Radius, [&](const FIntPoint& Point) {
+			int32 NeighborIndex = Out_TileIndices.Find(Point);
+			if (NeighborIndex != INDEX_NONE) {
+				Visitor(NeighborIndex);
+			}
+			else if (Distance(Point, Origin) <= GridRange) {
+				Visitor(INDEX_NONE);
+			}
+		});
+	});
+
+	UE_LOG(HexGridData, Log, TEXT("Build hex grid done, tiles=%d, clipped=%d!"), Out_Tiles.Num(),
+		3 * GridRange * (GridRange + 1) + 1 - Out_Tiles.Num());
+	return true;
+}
+
+FVector2D HexGridBuilder::AxialToPosition(const FIntPoint& Axial, float TileSize)
+{
+	return FVector2D(TileSize * 1.5 * Axial.X, TileSize * FMath::Sqrt(3.0) * (Axial.Y + Axial.X * 0.5));
+}
+
+int32 HexGridBuilder::Distance(const FIntPoint& A, const FIntPoint& B)
+{
+	int32 dq = A.X - B.X;
+	int32 dr = A.Y - B.Y;
+	return (FMath::Abs(dq) + FMath::Abs(dr) + FMath::Abs(dq + dr)) / 2;
+}
+
+bool HexGridBuilder::IsInMapRange(const FVector2D& Position, const FVector2D& MapSize)
+{
+	//Same test as AHexGrid::IsInMapRange
+	if (MapSize.X <= 0.0 || MapSize.Y <= 0.0) {
+		return true;
+	}
+	return (FMath::Abs<float>(Position.X) < float(MapSize.X) / 2
+		&& FMath::Abs<float>(Position.Y) < float(MapSize.Y) / 2);
+}
@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "HexGridAdjacency.h"
+#include "HexGridIndex.h"
+#include "HexGridTileStore.h"
+
+#include "CoreMinimal.h"
+
+/**
+ * Builds hex grid tiles, tile indices and neighbor rings from params, the same data the text files hold.
+ * Flat top layout, tile q,r is at (TileSize * 3/2 * q, TileSize * sqrt(3) * (r + q/2)).
+ */
+class MAPTESTCPP_API HexGridBuilder
+{
+public:
+	static const FIntPoint Directions[6];
+
+public:
+	HexGridBuilder();
+	~HexGridBuilder();
+
+	//Build every tile within GridRange, tiles out of MapSize (width, height) centered at origin are never created.
+	//Zero MapSize means no clipping.
+	static bool Build(float TileSize, int32 GridRange, int32 NeighborRange, const FVector2D& MapSize,
+		HexGridTileStore& Out_Tiles, HexGridIndex& Out_TileIndices, HexGridAdjacency& Out_Adjacency);
+
+	static FVector2D AxialToPosition(const FIntPoint& Axial, float TileSize);
+	static int32 Distance(const FIntPoint& A, const FIntPoint& B);
+
+	//Ring points around Center at Radius, same order as N{Radius}.data
+	template<typename VisitorType>
+	static void ForEachRingPoint(const FIntPoint& Center, int32 Radius, VisitorType&& Visitor)
+	{
+		FIntPoint Point = Center + Directions[4] * Radius;
+		for (int32 i = 0; i < 6; i++)
+		{
+			for (int32 j = 0; j < Radius; j++)
+			{
+				Visitor(Point);
+				Point += Directions[i];
+			}
+		}
+	}
+
+private:
+	static bool IsInMapRange(const FVector2D& Position, const FVector2D& MapSize);
+
+};
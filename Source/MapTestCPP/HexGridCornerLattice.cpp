@@ -0,0 +1,101 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridCornerLattice.h"
+#include "HexGridTileStore.h"
+#include "HexGridIndex.h"
+
+#include "Async/ParallelFor.h"
+
+//Owner of each tile corner as axial offset and owned corner, 0 east and 1 north east
+struct FHexCornerOwner
+{
+	FIntPoint Offset;
+	int32 Owned;
+};
+
+static const FHexCornerOwner CornerOwners[HexGridCornerLattice::TileCornerNum] = {
+	{ FIntPoint(0, 0), 0 },
+	{ FIntPoint(0, 0), 1 },
+	{ FIntPoint(-1, 1), 0 },
+	{ FIntPoint(-1, 0), 1 },
+	{ FIntPoint(-1, 0), 0 },
+	{ FIntPoint(0, -1), 1 },
+};
+
+HexGridCornerLattice::HexGridCornerLattice()
+{
+}
+
+HexGridCornerLattice::~HexGridCornerLattice()
+{
+}
+
+void HexGridCornerLattice::Build(const HexGridTileStore& Tiles, const HexGridIndex& TileIndices, float TileSize)
+{
+	Reset();
+	TileNum = Tiles.Num();
+
+	FVector2D CornerVectors[TileCornerNum];
+	for (int32 i = 0; i < TileCornerNum; i++)
+	{
+		float Angle = FMath::DegreesToRadians(i * 60.f);
+		CornerVectors[i] = FVector2D(FMath::Cos(Angle), FMath::Sin(Angle)) * TileSize;
+	}
+
+	Positions2D.SetNumUninitialized(TileNum * 2);
+	TileCorners.SetNumUninitialized(TileNum * TileCornerNum);
+	ParallelFor(TileNum, [this, &Tiles, &TileIndices, &CornerVectors](int32 i) {
+		const FVector2D& Center = Tiles.Positions2D[i];
+		Positions2D[i * 2] = Center + CornerVectors[0];
+		Positions2D[i * 2 + 1] = Center + CornerVectors[1];
+		for (int32 k = 0; k < TileCornerNum; k++)
+		{
+			int32 Owner = TileIndices.Find(Tiles.AxialCoords[i] + CornerOwners[k].Offset);
+			TileCorners[i * TileCornerNum + k] = Owner != INDEX_NONE ? Owner * 2 + CornerOwners[k].Owned : INDEX_NONE;
+		}
+	});
+
+	//Border corners, only a ring of them so a map is fine
+	TMap<FIntVector, int32> BorderCorners;
+	for (int32 i = 0; i < TileNum; i++)
+	{
+		for (int32 k = 0; k < TileCornerNum; k++)
+		{
+			int32& Corner = TileCorners[i * TileCornerNum + k];
+			if (Corner != INDEX_NONE) {
+				continue;
+			}
+			FIntPoint Owner = Tiles.AxialCoords[i] + CornerOwners[k].Offset;
+			FIntVector Key(Owner.X, Owner.Y, CornerOwners[k].Owned);
+			if (const int32* Found = BorderCorners.Find(Key)) {
+				Corner = *Found;
+			}
+			else {
+				Corner = Positions2D.Add(Tiles.Positions2D[i] + CornerVectors[k]);
+				BorderCorners.Add(Key, Corner);
+			}
+		}
+	}
+	PositionsZ.SetNumZeroed(Positions2D.Num());
+}
+
+void HexGridCornerLattice::Reset()
+{
+	TileNum = 0;
+	Positions2D.Reset();
+	PositionsZ.Reset();
+	TileCorners.Reset();
+}
+
+void HexGridCornerLattice::GetTileVertices(int32 TileIndex, TArray<FVector2D>& Out_Positions2D, TArray<float>& Out_PositionsZ) const
+{
+	Out_Positions2D.Reset(TileCornerNum);
+	Out_PositionsZ.Reset(TileCornerNum);
+	for (int32 k = 0; k < TileCornerNum; k++)
+	{
+		int32 Corner = GetTileCorner(TileIndex, k);
+		Out_Positions2D.Add(Positions2D[Corner]);
+		Out_PositionsZ.Add(PositionsZ[Corner]);
+	}
+}
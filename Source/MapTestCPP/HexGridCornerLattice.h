@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class HexGridTileStore;
+class HexGridIndex;
+
+/**
+ * Hex corners shared by neighbor tiles, every corner stored and sampled once.
+ * Tile i owns its east and north east corners at 2 * i and 2 * i + 1, the other four belong to neighbors.
+ * Corners whose owner is not a tile, on the grid border, follow at [2 * TileNum, Num()).
+ */
+class MAPTESTCPP_API HexGridCornerLattice
+{
+public:
+	static const int32 TileCornerNum = 6;
+
+	TArray<FVector2D> Positions2D;
+	TArray<float> PositionsZ;
+
+private:
+	int32 TileNum = 0;
+
+	//TileCornerNum corner indices per tile, counterclockwise from east like the old tile vertices
+	TArray<int32> TileCorners;
+
+public:
+	HexGridCornerLattice();
+	~HexGridCornerLattice();
+	HexGridCornerLattice(const HexGridCornerLattice&) = default;
+	HexGridCornerLattice(HexGridCornerLattice&&) = default;
+	HexGridCornerLattice& operator=(const HexGridCornerLattice&) = default;
+	HexGridCornerLattice& operator=(HexGridCornerLattice&&) = default;
+
+	void Build(const HexGridTileStore& Tiles, const HexGridIndex& TileIndices, float TileSize);
+	void Reset();
+
+	FORCEINLINE int32 Num() const
+	{
+		return Positions2D.Num();
+	}
+
+	FORCEINLINE int32 GetTileNum() const
+	{
+		return TileNum;
+	}
+
+	//First corner not owned by a tile
+	FORCEINLINE int32 GetBorderCornerStart() const
+	{
+		return TileNum * 2;
+	}
+
+	FORCEINLINE int32 GetTileCorner(int32 TileIndex, int32 Corner) const
+	{
+		return TileCorners[TileIndex * TileCornerNum + Corner];
+	}
+
+	FORCEINLINE FVector GetCornerPosition(int32 CornerIndex) const
+	{
+		return FVector(Positions2D[CornerIndex].X, Positions2D[CornerIndex].Y, PositionsZ[CornerIndex]);
+	}
+
+	void GetTileVertices(int32 TileIndex, TArray<FVector2D>& Out_Positions2D, TArray<float>& Out_PositionsZ) const;
+
+};
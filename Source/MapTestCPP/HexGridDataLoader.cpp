@@ -0,0 +1,333 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridDataLoader.h"
+#include "HexGridBinaryData.h"
+#include "HexGridBuilder.h"
+
+#include <Async/ParallelFor.h>
+#include <Misc/FileHelper.h>
+#include <Misc/Paths.h>
+#include <atomic>
+
+HexGridDataLoader::HexGridDataLoader()
+{
+}
+
+HexGridDataLoader::~HexGridDataLoader()
+{
+}
+
+void HexGridDataLoader::StartProcedural(float TileSize, int32 GridRange, int32 NeighborRange, const FVector2D& MapSize)
+{
+	Data = AcquireData();
+	Data->TileSize = TileSize;
+	Data->GridRange = GridRange;
+	Data->NeighborRange = NeighborRange;
+	TSharedPtr<FHexGridLoadedData> LoadData = Data;
+
+	UE::Tasks::TTask<bool> BuildTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [LoadData, MapSize]() {
+		return HexGridBuilder::Build(LoadData->TileSize, LoadData->GridRange, LoadData->NeighborRange, MapSize,
+			LoadData->Tiles, LoadData->TileIndices, LoadData->Adjacency);
+	});
+
+	ParamsTask = BuildTask;
+	TileIndicesTask = BuildTask;
+	TilesTask = BuildTask;
+	NeighborsTask = BuildTask;
+}
+
+void HexGridDataLoader::StartBinary(const FString& FullPath)
+{
+	Data = AcquireData();
+	TSharedPtr<FHexGridLoadedData> LoadData = Data;
+
+	UE::Tasks::TTask<bool> BinaryTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [LoadData, FullPath]() {
+		return HexGridBinaryData::Load(FullPath, LoadData->TileSize, LoadData->GridRange, LoadData->NeighborRange,
+			LoadData->Tiles, LoadData->TileIndices, LoadData->Adjacency);
+	});
+
+	ParamsTask = BinaryTask;
+	TileIndicesTask = BinaryTask;
+	TilesTask = BinaryTask;
+	NeighborsTask = BinaryTask;
+}
+
+void HexGridDataLoader::StartText(const FString& ParamsPath, const FString& TileIndicesPath, const FString& TilesPath,
+	const FString& NeighborsPathPrefix, int32 ParamNum)
+{
+	Data = AcquireData();
+	TSharedPtr<FHexGridLoadedData> LoadData = Data;
+
+	ParamsTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [LoadData, ParamsPath, ParamNum]() {
+		return LoadParams(*LoadData, ParamsPath, ParamNum);
+	});
+	TileIndicesTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [LoadData, TileIndicesPath]() {
+		return LoadTileIndices(*LoadData, TileIndicesPath);
+	});
+	TilesTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [LoadData, TilesPath]() {
+		return LoadTiles(*LoadData, TilesPath);
+	});
+
+	//Ring files need NeighborRange from params, every ring file is read by its own worker
+	UE::Tasks::TTask<bool> RingsTask = UE::Tasks::Launch(UE_SOURCE_LOCATION,
+		[LoadData, NeighborsPathPrefix, Params = ParamsTask]() mutable {
+			return Params.GetResult() && LoadRings(*LoadData, NeighborsPathPrefix);
+		},
+		UE::Tasks::Prerequisites(ParamsTask));
+
+	//Filtering rings needs the complete tile indices
+	NeighborsTask = UE::Tasks::Launch(UE_SOURCE_LOCATION,
+		[LoadData, TileIndices = TileIndicesTask, Tiles = TilesTask, Rings = RingsTask]() mutable {
+			return TileIndices.GetResult() && Tiles.GetResult() && Rings.GetResult() && AssembleNeighbors(*LoadData);
+		},
+		UE::Tasks::Prerequisites(TileIndicesTask, TilesTask, RingsTask));
+}
+
+bool HexGridDataLoader::IsStepCompleted(EStep Step, bool& Out_Success)
+{
+	UE::Tasks::TTask<bool>* Task = nullptr;
+	switch (Step)
+	{
+	case EStep::Params:
+		Task = &ParamsTask;
+		break;
+	case EStep::TileIndices:
+		Task = &TileIndicesTask;
+		break;
+	case EStep::Tiles:
+		Task = &TilesTask;
+		break;
+	case EStep::Neighbors:
+		Task = &NeighborsTask;
+		break;
+	default:
+		break;
+	}
+
+	Out_Success = false;
+	if (Task == nullptr || !Task->IsValid()) {
+		return true;
+	}
+	if (!Task->IsCompleted()) {
+		return false;
+	}
+	Out_Success = Task->GetResult();
+	return true;
+}
+
+void HexGridDataLoader::GetParams(float& Out_TileSize, int32& Out_GridRange, int32& Out_NeighborRange) const
+{
+	if (Data.IsValid()) {
+		Out_TileSize = Data->TileSize;
+		Out_GridRange = Data->GridRange;
+		Out_NeighborRange = Data->NeighborRange;
+	}
+}
+
+void HexGridDataLoader::Publish(HexGridTileStore& Out_Tiles, HexGridIndex& Out_TileIndices,
+	HexGridAdjacency& Out_Adjacency)
+{
+	if (Data.IsValid()) {
+		Out_Tiles = MoveTemp(Data->Tiles);
+		Out_TileIndices = MoveTemp(Data->TileIndices);
+		Out_Adjacency = MoveTemp(Data->Adjacency);
+	}
+	Data.Reset();
+	ParamsTask = UE::Tasks::TTask<bool>();
+	TileIndicesTask = UE::Tasks::TTask<bool>();
+	TilesTask = UE::Tasks::TTask<bool>();
+	NeighborsTask = UE::Tasks::TTask<bool>();
+}
+
+void HexGridDataLoader::Recycle(HexGridTileStore&& In_Tiles, HexGridIndex&& In_TileIndices, HexGridAdjacency&& In_Adjacency)
+{
+	if (!Spare.IsValid()) {
+		Spare = MakeShared<FHexGridLoadedData>();
+	}
+	Spare->Tiles = MoveTemp(In_Tiles);
+	Spare->TileIndices = MoveTemp(In_TileIndices);
+	Spare->Adjacency = MoveTemp(In_Adjacency);
+}
+
+void HexGridDataLoader::CancelAndWait()
+{
+	TArray<UE::Tasks::FTask> Tasks;
+	for (const UE::Tasks::TTask<bool>* Task : { &ParamsTask, &TileIndicesTask, &TilesTask, &NeighborsTask })
+	{
+		if (Task->IsValid()) {
+			Tasks.Add(*Task);
+		}
+	}
+	UE::Tasks::Wait(Tasks);
+
+	//Nothing else holds the data once its tasks are done
+	if (Data.IsValid()) {
+		Spare = MoveTemp(Data);
+	}
+	Data.Reset();
+	ParamsTask = UE::Tasks::TTask<bool>();
+	TileIndicesTask = UE::Tasks::TTask<bool>();
+	TilesTask = UE::Tasks::TTask<bool>();
+	NeighborsTask = UE::Tasks::TTask<bool>();
+}
+
+TSharedPtr<FHexGridLoadedData> HexGridDataLoader::AcquireData()
+{
+	if (!Spare.IsValid()) {
+		return MakeShared<FHexGridLoadedData>();
+	}
+	TSharedPtr<FHexGridLoadedData> Recycled = MoveTemp(Spare);
+	Spare.Reset();
+	Recycled->TileSize = 0.f;
+	Recycled->GridRange = 0;
+	Recycled->NeighborRange = 0;
+	Recycled->Tiles.Reset();
+	Recycled->TileIndices.Reset();
+	Recycled->Adjacency.Reset();
+	for (FHexGridRawRings& Rings : Recycled->RawRings)
+	{
+		Rings.Reset();
+	}
+	return Recycled;
+}
+
+bool HexGridDataLoader::LoadBuffer(const FString& FullPath, TArray<uint8>& Out_Buffer, TArray<TPair<int32, int32>>& Out_Lines,
+	bool bCullEmpty)
+{
+	if (!FPaths::FileExists(FullPath)) {
+		UE_LOG(HexGridData, Warning, TEXT("Data file %s not exist!"), *FullPath);
+		return false;
+	}
+	if (!FFileHelper::LoadFileToArray(Out_Buffer, *FullPath)) {
+		UE_LOG(HexGridData, Warning, TEXT("Open file %s failed!"), *FullPath);
+		return false;
+	}
+	HexGridTextParser::SplitLines(Out_Buffer, Out_Lines, bCullEmpty);
+	return true;
+}
+
+bool HexGridDataLoader::LoadParams(FHexGridLoadedData& LoadData, const FString& FullPath, int32 ParamNum)
+{
+	TArray<uint8> Buffer;
+	TArray<TPair<int32, int32>> Lines;
+	if (!LoadBuffer(FullPath, Buffer, Lines, true)) {
+		return false;
+	}
+	if (Lines.IsEmpty()) {
+		UE_LOG(HexGridData, Warning, TEXT("Parse Parameters error!"));
+		return false;
+	}
+	const ANSICHAR* Begin = HexGridTextParser::LineBegin(Buffer, Lines[0]);
+	const ANSICHAR* End = HexGridTextParser::LineEnd(Buffer, Lines[0]);
+	if (HexGridTextParser::CountFields(Begin, End, '|') != ParamNum
+		|| !HexGridTextParser::ParseParamsLine(Begin, End, LoadData.TileSize, LoadData.GridRange, LoadData.NeighborRange)) {
+		UE_LOG(HexGridData, Warning, TEXT("Parse Parameters error!"));
+		return false;
+	}
+	if (!HexGridAdjacency::IsValidNeighborRange(LoadData.NeighborRange)) {
+		UE_LOG(HexGridData, Warning, TEXT("Parameters NeighborRange %d out of [%d, %d]!"), LoadData.NeighborRange,
+			HexGridAdjacency::MinNeighborRange, HexGridAdjacency::MaxNeighborRange);
+		return false;
+	}
+	return true;
+}
+
+bool HexGridDataLoader::LoadTileIndices(FHexGridLoadedData& LoadData, const FString& FullPath)
+{
+	TArray<uint8> Buffer;
+	TArray<TPair<int32, int32>> Lines;
+	if (!LoadBuffer(FullPath, Buffer, Lines, true)) {
+		return false;
+	}
+	TArray<TPair<FIntPoint, int32>> Pairs;
+	Pairs.Reserve(Lines.Num());
+	for (const TPair<int32, int32>& Line : Lines)
+	{
+		FIntPoint Key;
+		int32 Value;
+		if (HexGridTextParser::ParseTileIndexLine(HexGridTextParser::LineBegin(Buffer, Line),
+			HexGridTextParser::LineEnd(Buffer, Line), Key, Value)) {
+			Pairs.Emplace(Key, Value);
+		}
+	}
+	LoadData.TileIndices.Build(Pairs);
+	return true;
+}
+
+bool HexGridDataLoader::LoadTiles(FHexGridLoadedData& LoadData, const FString& FullPath)
+{
+	TArray<uint8> Buffer;
+	TArray<TPair<int32, int32>> Lines;
+	if (!LoadBuffer(FullPath, Buffer, Lines, true)) {
+		return false;
+	}
+	std::atomic<bool> Success = true;
+	LoadData.Tiles.SetNum(Lines.Num());
+	ParallelFor(Lines.Num(), [&LoadData, &Buffer, &Lines, &Success](int32 i) {
+		if (!HexGridTextParser::ParseTileLine(HexGridTextParser::LineBegin(Buffer, Lines[i]),
+			HexGridTextParser::LineEnd(Buffer, Lines[i]), LoadData.Tiles.AxialCoords[i], LoadData.Tiles.Positions2D[i])) {
+			Success = false;
+		}
+	});
+	if (!Success) {
+		UE_LOG(HexGridData, Warning, TEXT("Parse tiles file %s failed!"), *FullPath);
+	}
+	return Success;
+}
+
+bool HexGridDataLoader::LoadRings(FHexGridLoadedData& LoadData, const FString& FullPathPrefix)
+{
+	std::atomic<bool> Success = true;
+	LoadData.RawRings.SetNum(LoadData.NeighborRange);
+	ParallelFor(LoadData.NeighborRange, [&LoadData, &FullPathPrefix, &Success](int32 r) {
+		int32 Radius = r + 1;
+		FString FullPath = FullPathPrefix + FString::FromInt(Radius) + TEXT(".data");
+		TArray<uint8> Buffer;
+		TArray<TPair<int32, int32>> Lines;
+		//Keep empty lines, line number is the tile index
+		if (!LoadBuffer(FullPath, Buffer, Lines, false)) {
+			Success = false;
+			return;
+		}
+		//All lines go to one point buffer, a file costs a few growths rather than one array per line
+		FHexGridRawRings& Rings = LoadData.RawRings[r];
+		Rings.Reset();
+		Rings.Offsets.SetNumUninitialized(Lines.Num() + 1);
+		for (int32 i = 0; i < Lines.Num(); i++)
+		{
+			Rings.Offsets[i] = Rings.Points.Num();
+			HexGridTextParser::ParseNeighborsLine(HexGridTextParser::LineBegin(Buffer, Lines[i]),
+				HexGridTextParser::LineEnd(Buffer, Lines[i]), [&Rings](const FIntPoint& Point) {
+					Rings.Points.Add(Point);
+				});
+		}
+		Rings.Offsets[Lines.Num()] = Rings.Points.Num();
+		UE_LOG(HexGridData, Log, TEXT("Load neighbor N%d done!"), Radius);
+	});
+	return Success;
+}
+
+bool HexGridDataLoader::AssembleNeighbors(FHexGridLoadedData& LoadData)
+{
+	//Ring points which are not grid tiles are dropped
+	LoadData.Adjacency.Build(LoadData.Tiles.Num(), LoadData.NeighborRange, [&LoadData](int32 TileIndex, int32 Radius,
+		auto&& Visitor) {
+		const FHexGridRawRings& Rings = LoadData.RawRings[Radius - 1];
+		if (TileIndex + 1 >= Rings.Offsets.Num()) {
+			return;
+		}
+		for (int32 p = Rings.Offsets[TileIndex]; p < Rings.Offsets[TileIndex + 1]; p++)
+		{
+			int32 NeighborIndex = LoadData.TileIndices.Find(Rings.Points[p]);
+			if (LoadData.Tiles.IsValidIndex(NeighborIndex)) {
+				Visitor(NeighborIndex);
+			}
+		}
+	});
+	for (FHexGridRawRings& Rings : LoadData.RawRings)
+	{
+		Rings.Reset();
+	}
+	return true;
+}
@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "StructDefine.h"
+#include "HexGridTextParser.h"
+#include "HexGridAdjacency.h"
+#include "HexGridIndex.h"
+#include "HexGridTileStore.h"
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+
+//Ring points of one N{radius} file, line i holds Points[Offsets[i], Offsets[i + 1])
+struct FHexGridRawRings
+{
+	TArray<int32> Offsets;
+	TArray<FIntPoint> Points;
+
+	//Keeps the allocations for the next load
+	void Reset()
+	{
+		Offsets.Reset();
+		Points.Reset();
+	}
+};
+
+struct FHexGridLoadedData
+{
+	float TileSize = 0.f;
+	int32 GridRange = 0;
+	int32 NeighborRange = 0;
+	HexGridTileStore Tiles;
+	HexGridIndex TileIndices;
+	HexGridAdjacency Adjacency;
+
+	//Ring points per radius, before filtering by tile indices, emptied but kept allocated once assembled
+	TArray<FHexGridRawRings> RawRings;
+};
+
+/**
+ * Reads or builds all hex grid data on worker threads, the game thread only polls and publishes.
+ */
+class MAPTESTCPP_API HexGridDataLoader
+{
+public:
+	enum class EStep : uint8
+	{
+		Params,
+		TileIndices,
+		Tiles,
+		Neighbors
+	};
+
+private:
+	TSharedPtr<FHexGridLoadedData> Data;
+
+	//Buffers of an earlier grid the next start fills again
+	TSharedPtr<FHexGridLoadedData> Spare;
+
+	UE::Tasks::TTask<bool> ParamsTask;
+	UE::Tasks::TTask<bool> TileIndicesTask;
+	UE::Tasks::TTask<bool> TilesTask;
+	UE::Tasks::TTask<bool> NeighborsTask;
+
+public:
+	HexGridDataLoader();
+	~HexGridDataLoader();
+
+	//Build everything from params, no data files
+	void StartProcedural(float TileSize, int32 GridRange, int32 NeighborRange, const FVector2D& MapSize);
+
+	//Load everything from one binary dataset
+	void StartBinary(const FString& FullPath);
+
+	//Load Params, TileIndices, Tiles and every N{radius} file concurrently
+	void StartText(const FString& ParamsPath, const FString& TileIndicesPath, const FString& TilesPath,
+		const FString& NeighborsPathPrefix, int32 ParamNum);
+
+	bool IsStepCompleted(EStep Step, bool& Out_Success);
+
+	//Completes with the last step, invalid before a start
+	FORCEINLINE UE::Tasks::FTask GetCompletionTask() const
+	{
+		return NeighborsTask;
+	}
+
+	void GetParams(float& Out_TileSize, int32& Out_GridRange, int32& Out_NeighborRange) const;
+	void Publish(HexGridTileStore& Out_Tiles, HexGridIndex& Out_TileIndices,
+		HexGridAdjacency& Out_Adjacency);
+
+	//Hand a published grid back, the next start reuses its allocations
+	void Recycle(HexGridTileStore&& In_Tiles, HexGridIndex&& In_TileIndices, HexGridAdjacency&& In_Adjacency);
+
+	//Tasks can not stop midway, wait for them and drop their data
+	void CancelAndWait();
+
+private:
+	TSharedPtr<FHexGridLoadedData> AcquireData();
+
+	static bool LoadBuffer(const FString& FullPath, TArray<uint8>& Out_Buffer, TArray<TPair<int32, int32>>& Out_Lines,
+		bool bCullEmpty);
+	static bool LoadParams(FHexGridLoadedData& LoadData, const FString& FullPath, int32 ParamNum);
+	static bool LoadTileIndices(FHexGridLoadedData& LoadData, const FString& FullPath);
+	static bool LoadTiles(FHexGridLoadedData& LoadData, const FString& FullPath);
+	static bool LoadRings(FHexGridLoadedData& LoadData, const FString& FullPathPrefix);
+	static bool AssembleNeighbors(FHexGridLoadedData& LoadData);
+
+};
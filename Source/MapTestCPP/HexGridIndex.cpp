@@ -0,0 +1,147 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridIndex.h"
+#include "HexGridBuilder.h"
+#include "HexGridTextParser.h"
+
+#include <HAL/IConsoleManager.h>
+
+HexGridIndex::HexGridIndex()
+{
+}
+
+HexGridIndex::~HexGridIndex()
+{
+}
+
+void HexGridIndex::Build(const TArray<FIntPoint>& AxialCoords)
+{
+	FIntPoint OffsetMin(MAX_int32, MAX_int32);
+	FIntPoint OffsetMax(MIN_int32, MIN_int32);
+	for (const FIntPoint& Axial : AxialCoords)
+	{
+		FIntPoint Offset = AxialToOffset(Axial);
+		OffsetMin = OffsetMin.ComponentMin(Offset);
+		OffsetMax = OffsetMax.ComponentMax(Offset);
+	}
+	Init(OffsetMin, OffsetMax);
+	for (int32 i = 0; i < AxialCoords.Num(); i++)
+	{
+		Add(AxialCoords[i], i);
+	}
+}
+
+void HexGridIndex::Build(const TArray<TPair<FIntPoint, int32>>& Pairs)
+{
+	FIntPoint OffsetMin(MAX_int32, MAX_int32);
+	FIntPoint OffsetMax(MIN_int32, MIN_int32);
+	for (const TPair<FIntPoint, int32>& Pair : Pairs)
+	{
+		FIntPoint Offset = AxialToOffset(Pair.Key);
+		OffsetMin = OffsetMin.ComponentMin(Offset);
+		OffsetMax = OffsetMax.ComponentMax(Offset);
+	}
+	Init(OffsetMin, OffsetMax);
+	for (const TPair<FIntPoint, int32>& Pair : Pairs)
+	{
+		Add(Pair.Key, Pair.Value);
+	}
+}
+
+void HexGridIndex::Reset()
+{
+	ColumnMin = 0;
+	RowMin = 0;
+	ColumnNum = 0;
+	RowNum = 0;
+	TileNum = 0;
+	Cells.Reset();
+}
+
+void HexGridIndex::Init(const FIntPoint& OffsetMin, const FIntPoint& OffsetMax)
+{
+	Reset();
+	if (OffsetMin.X > OffsetMax.X || OffsetMin.Y > OffsetMax.Y) {
+		return;
+	}
+	ColumnMin = OffsetMin.X;
+	RowMin = OffsetMin.Y;
+	ColumnNum = OffsetMax.X - OffsetMin.X + 1;
+	RowNum = OffsetMax.Y - OffsetMin.Y + 1;
+	Cells.Init(INDEX_NONE, ColumnNum * RowNum);
+}
+
+void HexGridIndex::Add(const FIntPoint& Axial, int32 Index)
+{
+	FIntPoint Offset = AxialToOffset(Axial);
+	int32& Cell = Cells[(Offset.X - ColumnMin) * RowNum + Offset.Y - RowMin];
+	if (Cell == INDEX_NONE) {
+		TileNum++;
+	}
+	Cell = Index;
+}
+
+//Console: HexGrid.BenchmarkTileIndex [GridRange]
+static void BenchmarkHexGridTileIndex(const TArray<FString>& Args)
+{
+	//GridRange 577 is about 1M tiles
+	int32 GridRange = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 577;
+
+	HexGridTileStore Tiles;
+	HexGridIndex DenseIndex;
+	HexGridAdjacency Adjacency;
+	if (!HexGridBuilder::Build(100.f, GridRange, 1, FVector2D::ZeroVector, Tiles, DenseIndex, Adjacency)) {
+		return;
+	}
+
+	double Start = FPlatformTime::Seconds();
+	TMap<FIntPoint, int32> MapIndex;
+	MapIndex.Reserve(Tiles.Num());
+	for (int32 i = 0; i < Tiles.Num(); i++)
+	{
+		MapIndex.Add(Tiles.AxialCoords[i], i);
+	}
+	double MapBuildTime = FPlatformTime::Seconds() - Start;
+
+	Start = FPlatformTime::Seconds();
+	DenseIndex.Build(Tiles.AxialCoords);
+	double DenseBuildTime = FPlatformTime::Seconds() - Start;
+
+	//Every ring 1 neighbor of every tile, the lookup pattern of the block level passes
+	int64 MapSum = 0;
+	Start = FPlatformTime::Seconds();
+	for (const FIntPoint& Axial : Tiles.AxialCoords)
+	{
+		HexGridBuilder::ForEachRingPoint(Axial, 1, [&MapIndex, &MapSum](const FIntPoint& Point) {
+			if (const int32* Index = MapIndex.Find(Point)) {
+				MapSum += *Index;
+			}
+		});
+	}
+	double MapFindTime = FPlatformTime::Seconds() - Start;
+
+	int64 DenseSum = 0;
+	Start = FPlatformTime::Seconds();
+	for (const FIntPoint& Axial : Tiles.AxialCoords)
+	{
+		HexGridBuilder::ForEachRingPoint(Axial, 1, [&DenseIndex, &DenseSum](const FIntPoint& Point) {
+			int32 Index = DenseIndex.Find(Point);
+			if (Index != INDEX_NONE) {
+				DenseSum += Index;
+			}
+		});
+	}
+	double DenseFindTime = FPlatformTime::Seconds() - Start;
+
+	UE_LOG(HexGridData, Log, TEXT("BenchmarkTileIndex tiles=%d lookups=%d"), Tiles.Num(), Tiles.Num() * 6);
+	UE_LOG(HexGridData, Log, TEXT("  Build TMap=%.2fms dense=%.2fms"), MapBuildTime * 1000.0, DenseBuildTime * 1000.0);
+	UE_LOG(HexGridData, Log, TEXT("  Find  TMap=%.2fms dense=%.2fms speedup=%.1fx checksum %s"), MapFindTime * 1000.0,
+		DenseFindTime * 1000.0, MapFindTime / FMath::Max(DenseFindTime, 1e-9),
+		MapSum == DenseSum ? TEXT("match") : TEXT("MISMATCH"));
+}
+
+static FAutoConsoleCommand BenchmarkHexGridTileIndexCommand(
+	TEXT("HexGrid.BenchmarkTileIndex"),
+	TEXT("Compare TMap and dense axial index lookups on a procedural grid. Args: [GridRange], 577 is about 1M tiles."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkHexGridTileIndex));
@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Dense axial coord to tile index lookup.
+ * Cells cover the bounding box of the grid in offset coords (column q, row r + floor(q/2)),
+ * so hexagon and rectangle grids both fill most cells. Holes hold INDEX_NONE.
+ */
+class MAPTESTCPP_API HexGridIndex
+{
+private:
+	int32 ColumnMin = 0;
+	int32 RowMin = 0;
+	int32 ColumnNum = 0;
+	int32 RowNum = 0;
+	int32 TileNum = 0;
+	TArray<int32> Cells;
+
+public:
+	HexGridIndex();
+	~HexGridIndex();
+	HexGridIndex(const HexGridIndex&) = default;
+	HexGridIndex(HexGridIndex&&) = default;
+	HexGridIndex& operator=(const HexGridIndex&) = default;
+	HexGridIndex& operator=(HexGridIndex&&) = default;
+
+	//Index every tile by its array index
+	void Build(const TArray<FIntPoint>& AxialCoords);
+	//Index axial coord and tile index pairs, e.g. from TileIndices.data
+	void Build(const TArray<TPair<FIntPoint, int32>>& Pairs);
+	void Reset();
+
+	FORCEINLINE static FIntPoint AxialToOffset(const FIntPoint& Axial)
+	{
+		return FIntPoint(Axial.X, Axial.Y + (Axial.X - (Axial.X & 1)) / 2);
+	}
+
+	//INDEX_NONE when the coord is not a tile
+	FORCEINLINE int32 Find(const FIntPoint& Axial) const
+	{
+		int32 Column = Axial.X - ColumnMin;
+		int32 Row = Axial.Y + (Axial.X - (Axial.X & 1)) / 2 - RowMin;
+		if ((uint32)Column >= (uint32)ColumnNum || (uint32)Row >= (uint32)RowNum) {
+			return INDEX_NONE;
+		}
+		return Cells[Column * RowNum + Row];
+	}
+
+	FORCEINLINE bool Contains(const FIntPoint& Axial) const
+	{
+		return Find(Axial) != INDEX_NONE;
+	}
+
+	FORCEINLINE int32 Num() const
+	{
+		return TileNum;
+	}
+
+private:
+	void Init(const FIntPoint& OffsetMin, const FIntPoint& OffsetMax);
+	void Add(const FIntPoint& Axial, int32 Index);
+
+};
@@ -0,0 +1,324 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridTextParser.h"
+
+#include <HAL/IConsoleManager.h>
+#include <kismet/KismetStringLibrary.h>
+#include <charconv>
+
+DEFINE_LOG_CATEGORY(HexGridData);
+
+HexGridTextParser::HexGridTextParser()
+{
+}
+
+HexGridTextParser::~HexGridTextParser()
+{
+}
+
+bool HexGridTextParser::NextLine(const ANSICHAR*& Cursor, const ANSICHAR* End, const ANSICHAR*& Out_LineBegin,
+	const ANSICHAR*& Out_LineEnd)
+{
+	if (Cursor >= End) {
+		return false;
+	}
+	Out_LineBegin = Cursor;
+	while (Cursor < End && *Cursor != '\n')
+	{
+		Cursor++;
+	}
+	Out_LineEnd = Cursor;
+	if (Out_LineEnd > Out_LineBegin && *(Out_LineEnd - 1) == '\r') {
+		Out_LineEnd--;
+	}
+	if (Cursor < End) {
+		Cursor++;
+	}
+	return true;
+}
+
+void HexGridTextParser::SplitLines(const TArray<uint8>& Buffer, TArray<TPair<int32, int32>>& Out_Lines, bool bCullEmpty)
+{
+	const ANSICHAR* Base = reinterpret_cast<const ANSICHAR*>(Buffer.GetData());
+	const ANSICHAR* Cursor = Base;
+	const ANSICHAR* End = Base + Buffer.Num();
+	//UTF-8 BOM
+	if (Buffer.Num() >= 3 && Buffer[0] == 0xEF && Buffer[1] == 0xBB && Buffer[2] == 0xBF) {
+		Cursor += 3;
+	}
+
+	const ANSICHAR* LineBegin;
+	const ANSICHAR* LineEnd;
+	while (NextLine(Cursor, End, LineBegin, LineEnd))
+	{
+		if (bCullEmpty && LineBegin == LineEnd) {
+			continue;
+		}
+		Out_Lines.Emplace(int32(LineBegin - Base), int32(LineEnd - Base));
+	}
+}
+
+bool HexGridTextParser::ParseInt(const ANSICHAR*& Cursor, const ANSICHAR* End, int32& Out_Value)
+{
+	SkipBlank(Cursor, End);
+	if (Cursor < End && *Cursor == '+') {
+		Cursor++;
+	}
+	std::from_chars_result Result = std::from_chars(Cursor, End, Out_Value);
+	if (Result.ec != std::errc()) {
+		return false;
+	}
+	Cursor = Result.ptr;
+	return true;
+}
+
+bool HexGridTextParser::ParseDouble(const ANSICHAR*& Cursor, const ANSICHAR* End, double& Out_Value)
+{
+	SkipBlank(Cursor, End);
+	if (Cursor < End && *Cursor == '+') {
+		Cursor++;
+	}
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+	std::from_chars_result Result = std::from_chars(Cursor, End, Out_Value);
+	if (Result.ec != std::errc()) {
+		return false;
+	}
+	Cursor = Result.ptr;
+	return true;
+#else
+	//Standard library without floating point from_chars, plain decimal parse
+	const ANSICHAR* Ptr = Cursor;
+	bool Negative = false;
+	if (Ptr < End && *Ptr == '-') {
+		Negative = true;
+		Ptr++;
+	}
+	double Mantissa = 0.0;
+	int32 Exponent = 0;
+	bool HasDigits = false;
+	for (; Ptr < End && *Ptr >= '0' && *Ptr <= '9'; Ptr++)
+	{
+		Mantissa = Mantissa * 10.0 + (*Ptr - '0');
+		HasDigits = true;
+	}
+	if (Ptr < End && *Ptr == '.') {
+		for (Ptr++; Ptr < End && *Ptr >= '0' && *Ptr <= '9'; Ptr++)
+		{
+			Mantissa = Mantissa * 10.0 + (*Ptr - '0');
+			Exponent--;
+			HasDigits = true;
+		}
+	}
+	if (!HasDigits) {
+		return false;
+	}
+	if (Ptr < End && (*Ptr == 'e' || *Ptr == 'E')) {
+		const ANSICHAR* ExpCursor = Ptr + 1;
+		int32 ExpValue = 0;
+		if (ParseInt(ExpCursor, End, ExpValue)) {
+			Exponent += ExpValue;
+			Ptr = ExpCursor;
+		}
+	}
+	Out_Value = Exponent == 0 ? Mantissa : Mantissa * FMath::Pow(10.0, double(Exponent));
+	Out_Value = Negative ? -Out_Value : Out_Value;
+	Cursor = Ptr;
+	return true;
+#endif
+}
+
+bool HexGridTextParser::SkipDelim(const ANSICHAR*& Cursor, const ANSICHAR* End, ANSICHAR Delim)
+{
+	SkipBlank(Cursor, End);
+	if (Cursor < End && *Cursor == Delim) {
+		Cursor++;
+		return true;
+	}
+	return false;
+}
+
+int32 HexGridTextParser::CountFields(const ANSICHAR* Begin, const ANSICHAR* End, ANSICHAR Delim)
+{
+	int32 Count = 0;
+	bool InField = false;
+	for (const ANSICHAR* Ptr = Begin; Ptr < End; Ptr++)
+	{
+		if (*Ptr == Delim) {
+			InField = false;
+		}
+		else if (!InField) {
+			InField = true;
+			Count++;
+		}
+	}
+	return Count;
+}
+
+bool HexGridTextParser::ParseIntPoint(const ANSICHAR*& Cursor, const ANSICHAR* End, FIntPoint& Out_Point)
+{
+	const ANSICHAR* Ptr = Cursor;
+	if (ParseInt(Ptr, End, Out_Point.X) && SkipDelim(Ptr, End, ',') && ParseInt(Ptr, End, Out_Point.Y)) {
+		Cursor = Ptr;
+		return true;
+	}
+	return false;
+}
+
+bool HexGridTextParser::ParseVector2D(const ANSICHAR*& Cursor, const ANSICHAR* End, FVector2D& Out_Vec2D)
+{
+	const ANSICHAR* Ptr = Cursor;
+	if (ParseDouble(Ptr, End, Out_Vec2D.X) && SkipDelim(Ptr, End, ',') && ParseDouble(Ptr, End, Out_Vec2D.Y)) {
+		Cursor = Ptr;
+		return true;
+	}
+	return false;
+}
+
+bool HexGridTextParser::ParseParamsLine(const ANSICHAR* Begin, const ANSICHAR* End, float& Out_TileSize,
+	int32& Out_GridRange, int32& Out_NeighborRange)
+{
+	const ANSICHAR* Cursor = Begin;
+	double Size = 0.0;
+	if (ParseDouble(Cursor, End, Size) && SkipDelim(Cursor, End, '|')
+		&& ParseInt(Cursor, End, Out_GridRange) && SkipDelim(Cursor, End, '|')
+		&& ParseInt(Cursor, End, Out_NeighborRange)) {
+		Out_TileSize = float(Size);
+		return true;
+	}
+	return false;
+}
+
+bool HexGridTextParser::ParseTileIndexLine(const ANSICHAR* Begin, const ANSICHAR* End, FIntPoint& Out_Key,
+	int32& Out_Value)
+{
+	const ANSICHAR* Cursor = Begin;
+	return ParseIntPoint(Cursor, End, Out_Key) && SkipDelim(Cursor, End, '|') && ParseInt(Cursor, End, Out_Value);
+}
+
+bool HexGridTextParser::ParseTileLine(const ANSICHAR* Begin, const ANSICHAR* End, FIntPoint& Out_AxialCoord,
+	FVector2D& Out_Position2D)
+{
+	const ANSICHAR* Cursor = Begin;
+	return ParseIntPoint(Cursor, End, Out_AxialCoord) && SkipDelim(Cursor, End, '|')
+		&& ParseVector2D(Cursor, End, Out_Position2D);
+}
+
+//Legacy path kept for the benchmark: FString per line, TArray<FString> per split, Kismet conversion per token
+static void LegacyParseIntPoint(const FString& Str, FIntPoint& Point)
+{
+	TArray<FString> StrArr;
+	Str.ParseIntoArray(StrArr, TEXT(","), true);
+	Point.X = UKismetStringLibrary::Conv_StringToInt(StrArr[0]);
+	Point.Y = UKismetStringLibrary::Conv_StringToInt(StrArr[1]);
+}
+
+static void LegacyParseTileLine(const FString& Line, FIntPoint& AxialCoord, FVector2D& Position2D)
+{
+	TArray<FString> StrArr;
+	TArray<FString> VecArr;
+	Line.ParseIntoArray(StrArr, TEXT("|"), true);
+	LegacyParseIntPoint(StrArr[0], AxialCoord);
+	StrArr[1].ParseIntoArray(VecArr, TEXT(","), true);
+	Position2D.X = UKismetStringLibrary::Conv_StringToFloat(VecArr[0]);
+	Position2D.Y = UKismetStringLibrary::Conv_StringToFloat(VecArr[1]);
+}
+
+//Console: HexGrid.BenchmarkTextParser [Lines] [PointsPerLine]
+static void BenchmarkHexGridTextParser(const TArray<FString>& Args)
+{
+	int32 LineNum = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 20000;
+	int32 PointNum = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 30;
+
+	//Synthetic N5 and Tiles files
+	FRandomStream Random(LineNum);
+	FString NeighborsText;
+	FString TilesText;
+	for (int32 i = 0; i < LineNum; i++)
+	{
+		for (int32 j = 0; j < PointNum; j++)
+		{
+			NeighborsText.Appendf(TEXT("%d,%d "), Random.RandRange(-500, 500), Random.RandRange(-500, 500));
+		}
+		NeighborsText.Append(TEXT("\n"));
+		TilesText.Appendf(TEXT("%d,%d|%.4f,%.4f\n"), Random.RandRange(-500, 500), Random.RandRange(-500, 500),
+			Random.FRandRange(-1e5f, 1e5f), Random.FRandRange(-1e5f, 1e5f));
+	}
+	FTCHARToUTF8 NeighborsUtf8(*NeighborsText);
+	FTCHARToUTF8 TilesUtf8(*TilesText);
+	TArray<uint8> NeighborsBuffer((const uint8*)NeighborsUtf8.Get(), NeighborsUtf8.Length());
+	TArray<uint8> TilesBuffer((const uint8*)TilesUtf8.Get(), TilesUtf8.Length());
+
+	TArray<TPair<int32, int32>> NeighborsLines;
+	TArray<TPair<int32, int32>> TilesLines;
+	HexGridTextParser::SplitLines(NeighborsBuffer, NeighborsLines, true);
+	HexGridTextParser::SplitLines(TilesBuffer, TilesLines, true);
+
+	//Legacy, one FString per line as std::getline + FString(line.c_str()) did
+	int64 LegacySum = 0;
+	double Start = FPlatformTime::Seconds();
+	for (const TPair<int32, int32>& Line : NeighborsLines)
+	{
+		FString FLine(Line.Value - Line.Key, HexGridTextParser::LineBegin(NeighborsBuffer, Line));
+		TArray<FString> StrArr;
+		FLine.ParseIntoArray(StrArr, TEXT(" "), true);
+		for (const FString& Str : StrArr)
+		{
+			FIntPoint Point;
+			LegacyParseIntPoint(Str, Point);
+			LegacySum += Point.X + Point.Y;
+		}
+	}
+	double LegacyNeighborsTime = FPlatformTime::Seconds() - Start;
+
+	Start = FPlatformTime::Seconds();
+	double LegacyPosSum = 0.0;
+	for (const TPair<int32, int32>& Line : TilesLines)
+	{
+		FString FLine(Line.Value - Line.Key, HexGridTextParser::LineBegin(TilesBuffer, Line));
+		FIntPoint Coord;
+		FVector2D Pos;
+		LegacyParseTileLine(FLine, Coord, Pos);
+		LegacySum += Coord.X + Coord.Y;
+		LegacyPosSum += Pos.X + Pos.Y;
+	}
+	double LegacyTilesTime = FPlatformTime::Seconds() - Start;
+
+	//Char range parser
+	int64 FastSum = 0;
+	Start = FPlatformTime::Seconds();
+	for (const TPair<int32, int32>& Line : NeighborsLines)
+	{
+		HexGridTextParser::ParseNeighborsLine(HexGridTextParser::LineBegin(NeighborsBuffer, Line),
+			HexGridTextParser::LineEnd(NeighborsBuffer, Line), [&FastSum](const FIntPoint& Point) {
+				FastSum += Point.X + Point.Y;
+			});
+	}
+	double FastNeighborsTime = FPlatformTime::Seconds() - Start;
+
+	Start = FPlatformTime::Seconds();
+	double FastPosSum = 0.0;
+	for (const TPair<int32, int32>& Line : TilesLines)
+	{
+		FIntPoint Coord;
+		FVector2D Pos;
+		HexGridTextParser::ParseTileLine(HexGridTextParser::LineBegin(TilesBuffer, Line),
+			HexGridTextParser::LineEnd(TilesBuffer, Line), Coord, Pos);
+		FastSum += Coord.X + Coord.Y;
+		FastPosSum += Pos.X + Pos.Y;
+	}
+	double FastTilesTime = FPlatformTime::Seconds() - Start;
+
+	UE_LOG(HexGridData, Log, TEXT("BenchmarkTextParser lines=%d points=%d"), LineNum, PointNum);
+	UE_LOG(HexGridData, Log, TEXT("  Neighbors legacy=%.2fms fast=%.2fms speedup=%.1fx"), LegacyNeighborsTime * 1000.0,
+		FastNeighborsTime * 1000.0, LegacyNeighborsTime / FMath::Max(FastNeighborsTime, 1e-9));
+	UE_LOG(HexGridData, Log, TEXT("  Tiles     legacy=%.2fms fast=%.2fms speedup=%.1fx"), LegacyTilesTime * 1000.0,
+		FastTilesTime * 1000.0, LegacyTilesTime / FMath::Max(FastTilesTime, 1e-9));
+	UE_LOG(HexGridData, Log, TEXT("  Checksum int %s, position diff=%g"), LegacySum == FastSum ? TEXT("match") : TEXT("MISMATCH"),
+		FMath::Abs(LegacyPosSum - FastPosSum));
+}
+
+static FAutoConsoleCommand BenchmarkHexGridTextParserCommand(
+	TEXT("HexGrid.BenchmarkTextParser"),
+	TEXT("Compare the legacy FString tile parser with the char range parser. Args: [Lines] [PointsPerLine]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkHexGridTextParser));
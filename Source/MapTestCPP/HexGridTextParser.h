@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(HexGridData, Log, All);
+
+/**
+ * Allocation free parser for the legacy hex grid text format.
+ * Works on raw char ranges of a loaded file, every Parse* advances Cursor past what it consumed.
+ *   Params.data       TileSize|GridRange|NeighborRange
+ *   TileIndices.data  q,r|index
+ *   Tiles.data        q,r|x,y
+ *   N{radius}.data    q,r q,r ... (one line per tile)
+ */
+class MAPTESTCPP_API HexGridTextParser
+{
+public:
+	HexGridTextParser();
+	~HexGridTextParser();
+
+	//Split buffer to lines, without the line break and '\r'
+	static bool NextLine(const ANSICHAR*& Cursor, const ANSICHAR* End, const ANSICHAR*& Out_LineBegin,
+		const ANSICHAR*& Out_LineEnd);
+	static void SplitLines(const TArray<uint8>& Buffer, TArray<TPair<int32, int32>>& Out_Lines, bool bCullEmpty);
+
+	//Tokens
+	static bool ParseInt(const ANSICHAR*& Cursor, const ANSICHAR* End, int32& Out_Value);
+	static bool ParseDouble(const ANSICHAR*& Cursor, const ANSICHAR* End, double& Out_Value);
+	static bool ParseIntPoint(const ANSICHAR*& Cursor, const ANSICHAR* End, FIntPoint& Out_Point);
+	static bool ParseVector2D(const ANSICHAR*& Cursor, const ANSICHAR* End, FVector2D& Out_Vec2D);
+	static bool SkipDelim(const ANSICHAR*& Cursor, const ANSICHAR* End, ANSICHAR Delim);
+	static int32 CountFields(const ANSICHAR* Begin, const ANSICHAR* End, ANSICHAR Delim);
+
+	//Lines
+	static bool ParseParamsLine(const ANSICHAR* Begin, const ANSICHAR* End, float& Out_TileSize, int32& Out_GridRange,
+		int32& Out_NeighborRange);
+	static bool ParseTileIndexLine(const ANSICHAR* Begin, const ANSICHAR* End, FIntPoint& Out_Key, int32& Out_Value);
+	static bool ParseTileLine(const ANSICHAR* Begin, const ANSICHAR* End, FIntPoint& Out_AxialCoord,
+		FVector2D& Out_Position2D);
+
+	//Call Visitor(const FIntPoint&) for every point of a neighbors line, returns point count
+	template<typename VisitorType>
+	static int32 ParseNeighborsLine(const ANSICHAR* Begin, const ANSICHAR* End, VisitorType&& Visitor)
+	{
+		int32 Count = 0;
+		const ANSICHAR* Cursor = Begin;
+		FIntPoint Point;
+		while (ParseIntPoint(Cursor, End, Point))
+		{
+			Visitor(Point);
+			Count++;
+		}
+		return Count;
+	}
+
+	static FORCEINLINE const ANSICHAR* LineBegin(const TArray<uint8>& Buffer, const TPair<int32, int32>& Line)
+	{
+		return reinterpret_cast<const ANSICHAR*>(Buffer.GetData()) + Line.Key;
+	}
+
+	static FORCEINLINE const ANSICHAR* LineEnd(const TArray<uint8>& Buffer, const TPair<int32, int32>& Line)
+	{
+		return reinterpret_cast<const ANSICHAR*>(Buffer.GetData()) + Line.Value;
+	}
+
+private:
+	static FORCEINLINE void SkipBlank(const ANSICHAR*& Cursor, const ANSICHAR* End)
+	{
+		while (Cursor < End && (*Cursor == ' ' || *Cursor == '\t'))
+		{
+			Cursor++;
+		}
+	}
+
+};
@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/ParallelFor.h"
+
+/**
+ * Per tile kernels of the hex grid stages on worker threads, a tile range is split into cache sized chunks.
+ * Kernel(TileIndex) is a functor known at compile time, it writes only the columns of its own tile.
+ * A kernel reading neighbors in a column its stage also writes reads a HexGridTileDoubleBuffer instead,
+ * so the result does not depend on the order tiles run in.
+ */
+class MAPTESTCPP_API HexGridTileKernel
+{
+public:
+	//Tiles per chunk, the few columns a kernel touches stay in cache
+	static constexpr int32 ChunkTiles = 1024;
+
+	template<typename KernelType>
+	static void Run(int32 Begin, int32 End, const KernelType& Kernel)
+	{
+		int32 ChunkNum = FMath::DivideAndRoundUp(End - Begin, ChunkTiles);
+		ParallelFor(ChunkNum, [Begin, End, &Kernel](int32 Chunk) {
+			int32 ChunkBegin = Begin + Chunk * ChunkTiles;
+			int32 ChunkEnd = FMath::Min(ChunkBegin + ChunkTiles, End);
+			for (int32 i = ChunkBegin; i < ChunkEnd; i++)
+			{
+				Kernel(i);
+			}
+		}, ChunkNum == 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+	}
+
+	//Same chunks, RangeKernel(ChunkBegin, ChunkEnd) takes a whole chunk for batched work
+	template<typename RangeKernelType>
+	static void RunRanges(int32 Begin, int32 End, const RangeKernelType& RangeKernel)
+	{
+		int32 ChunkNum = FMath::DivideAndRoundUp(End - Begin, ChunkTiles);
+		ParallelFor(ChunkNum, [Begin, End, &RangeKernel](int32 Chunk) {
+			int32 ChunkBegin = Begin + Chunk * ChunkTiles;
+			RangeKernel(ChunkBegin, FMath::Min(ChunkBegin + ChunkTiles, End));
+		}, ChunkNum == 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+	}
+
+};
+
+/**
+ * Column values from the start of a stage, its kernels read them while they write the column itself.
+ */
+template<typename ElementType>
+class HexGridTileDoubleBuffer
+{
+private:
+	TArray<ElementType> Back;
+
+public:
+	//Stage start, before any kernel writes Front
+	void Freeze(const TArray<ElementType>& Front)
+	{
+		Back = Front;
+	}
+
+	FORCEINLINE const TArray<ElementType>& Read() const
+	{
+		return Back;
+	}
+
+	//Keeps the allocation for the next grid
+	void Reset()
+	{
+		Back.Reset();
+	}
+
+};
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HexGridTileStore.h"
+
+HexGridTileStore::HexGridTileStore()
+{
+}
+
+HexGridTileStore::~HexGridTileStore()
+{
+}
+
+void HexGridTileStore::SetNum(int32 Num)
+{
+	AxialCoords.SetNumZeroed(Num);
+	Positions2D.SetNumZeroed(Num);
+}
+
+void HexGridTileStore::InitTerrainColumns()
+{
+	int32 TileNum = Num();
+	PositionsZ.SetNumZeroed(TileNum);
+	AvgPositionsZ.SetNumZeroed(TileNum);
+	Normals.SetNumZeroed(TileNum);
+	AnglesToUp.SetNumZeroed(TileNum);
+
+	WalkingBlockLevels.SetNumZeroed(TileNum);
+	FlyingBlockLevels.SetNumZeroed(TileNum);
+	BuildingBlockLevels.SetNumZeroed(TileNum);
+	IsLand.Init(false, TileNum);
+	WalkingConnections.Init(true, TileNum);
+}
+
+void HexGridTileStore::Reset()
+{
+	AxialCoords.Reset();
+	Positions2D.Reset();
+	PositionsZ.Reset();
+	AvgPositionsZ.Reset();
+	Normals.Reset();
+	AnglesToUp.Reset();
+	WalkingBlockLevels.Reset();
+	FlyingBlockLevels.Reset();
+	BuildingBlockLevels.Reset();
+	IsLand.Reset();
+	WalkingConnections.Reset();
+}
+
+void HexGridTileStore::GetTileData(int32 Index, FStructHexTileData& Out_Data) const
+{
+	Out_Data.AxialCoord = AxialCoords[Index];
+	Out_Data.Position2D = Positions2D[Index];
+	if (PositionsZ.Num() == Num()) {
+		Out_Data.PositionZ = PositionsZ[Index];
+		Out_Data.AvgPositionZ = AvgPositionsZ[Index];
+		Out_Data.Normal = Normals[Index];
+		Out_Data.AngleToUp = AnglesToUp[Index];
+		Out_Data.TerrainWalkingBlockLevel = WalkingBlockLevels[Index];
+		Out_Data.TerrainFlyingBlockLevel = FlyingBlockLevels[Index];
+		Out_Data.TerrainBuildingBlockLevel = BuildingBlockLevels[Index];
+		Out_Data.TerrainIsLand = IsLand[Index];
+		Out_Data.TerrainWalkingConnection = WalkingConnections[Index];
+	}
+}
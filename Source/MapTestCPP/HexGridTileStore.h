@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "StructDefine.h"
+
+#include "CoreMinimal.h"
+
+/**
+ * Hex grid tiles as columns, one contiguous array per attribute indexed by tile index.
+ * Block levels fit in uint8 (at most NeighborRange * 2 + 1), flags are one byte each.
+ */
+class MAPTESTCPP_API HexGridTileStore
+{
+public:
+	//Grid
+	TArray<FIntPoint> AxialCoords;
+	TArray<FVector2D> Positions2D;
+
+	//Terrain, tile vertices live in HexGridCornerLattice
+	TArray<float> PositionsZ;
+	TArray<float> AvgPositionsZ;
+	TArray<FVector> Normals;
+	TArray<float> AnglesToUp;
+
+	//Block
+	TArray<uint8> WalkingBlockLevels;
+	TArray<uint8> FlyingBlockLevels;
+	TArray<uint8> BuildingBlockLevels;
+	TArray<bool> IsLand;
+	TArray<bool> WalkingConnections;
+
+public:
+	HexGridTileStore();
+	~HexGridTileStore();
+	HexGridTileStore(const HexGridTileStore&) = default;
+	HexGridTileStore(HexGridTileStore&&) = default;
+	HexGridTileStore& operator=(const HexGridTileStore&) = default;
+	HexGridTileStore& operator=(HexGridTileStore&&) = default;
+
+	//Grid columns only, the rest are sized by InitTerrainColumns when terrain data is about to be filled
+	void SetNum(int32 Num);
+	void InitTerrainColumns();
+	//Keeps the allocations for the next grid
+	void Reset();
+
+	FORCEINLINE int32 Num() const
+	{
+		return AxialCoords.Num();
+	}
+
+	FORCEINLINE bool IsValidIndex(int32 Index) const
+	{
+		return AxialCoords.IsValidIndex(Index);
+	}
+
+	//Blueprint view of one tile without vertices
+	void GetTileData(int32 Index, FStructHexTileData& Out_Data) const;
+
+};
@@ -0,0 +1,311 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MapBatchCommandlet.h"
+#include "Terrain.h"
+#include "HexGrid.h"
+
+#include <Async/TaskGraphInterfaces.h>
+#include <Engine/World.h>
+#include <HAL/FileManager.h>
+#include <Misc/FileHelper.h>
+#include <Misc/Paths.h>
+#include <Serialization/MemoryWriter.h>
+#include <Tasks/Task.h>
+
+DEFINE_LOG_CATEGORY(MapBatch);
+
+const uint32 UMapBatchCommandlet::HeightfieldMagic = 0x4D424846; //MBHF
+const uint32 UMapBatchCommandlet::HeightfieldVersion = 1;
+
+UMapBatchCommandlet::UMapBatchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UMapBatchCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamMap;
+	ParseCommandLine(*Params, Tokens, Switches, ParamMap);
+
+	TArray<int32> Seeds;
+	if (const FString* SeedsParam = ParamMap.Find(TEXT("Seeds"))) {
+		TArray<FString> SeedStrings;
+		SeedsParam->ParseIntoArray(SeedStrings, TEXT(","));
+		for (const FString& SeedString : SeedStrings)
+		{
+			Seeds.Add(FCString::Atoi(*SeedString));
+		}
+	}
+	if (Seeds.IsEmpty()) {
+		UE_LOG(MapBatch, Error, TEXT("No seeds, use -Seeds=1,2,3"));
+		return 1;
+	}
+
+	ParamSets.Empty();
+	if (const FString* ParamSetsParam = ParamMap.Find(TEXT("ParamSets"))) {
+		if (!LoadParamSets(FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), *ParamSetsParam))) {
+			return 1;
+		}
+	}
+	if (ParamSets.IsEmpty()) {
+		ParamSets.AddDefaulted_GetRef().Name = TEXT("Default");
+	}
+
+	const FString* OutParam = ParamMap.Find(TEXT("Out"));
+	FString OutDir = OutParam != nullptr ? FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), *OutParam) :
+		FPaths::ConvertRelativePathToFull(FPaths::ProjectSavedDir() / TEXT("MapBatch"));
+
+	TerrainClass = ATerrain::StaticClass();
+	HexGridClass = AHexGrid::StaticClass();
+	if (const FString* ClassParam = ParamMap.Find(TEXT("TerrainClass"))) {
+		TerrainClass = LoadClass<ATerrain>(nullptr, **ClassParam);
+	}
+	if (const FString* ClassParam = ParamMap.Find(TEXT("HexGridClass"))) {
+		HexGridClass = LoadClass<AHexGrid>(nullptr, **ClassParam);
+	}
+	if (TerrainClass == nullptr || HexGridClass == nullptr) {
+		UE_LOG(MapBatch, Error, TEXT("Terrain or HexGrid class not found."));
+		return 1;
+	}
+
+	TArray<FMapBatchJob> Jobs;
+	for (int32 s = 0; s < ParamSets.Num(); s++)
+	{
+		for (int32 Seed : Seeds)
+		{
+			FMapBatchJob& Job = Jobs.AddDefaulted_GetRef();
+			Job.Seed = Seed;
+			Job.ParamSetIndex = s;
+			Job.OutDir = OutDir / FString::Printf(TEXT("%s_%d"), *ParamSets[s].Name, Seed);
+		}
+	}
+
+	BatchWorld = UWorld::CreateWorld(EWorldType::None, false, TEXT("MapBatchWorld"));
+
+	//Every job keeps one worker busy, more at once would only add memory
+	int32 WaveSize = FMath::Max(FTaskGraphInterface::Get().GetNumWorkerThreads(), 1);
+	UE_LOG(MapBatch, Log, TEXT("%d maps, %d at once, output %s"), Jobs.Num(), WaveSize, *OutDir);
+
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 WaveStart = 0; WaveStart < Jobs.Num(); WaveStart += WaveSize)
+	{
+		TArrayView<FMapBatchJob> Wave(Jobs.GetData() + WaveStart, FMath::Min(WaveSize, Jobs.Num() - WaveStart));
+		if (CreateWave(Wave)) {
+			TArray<UE::Tasks::FTask> Tasks;
+			for (FMapBatchJob& Job : Wave)
+			{
+				if (Job.Terrain != nullptr) {
+					Tasks.Add(UE::Tasks::Launch(TEXT("MapBatchJob"), [&Job]() { RunJob(Job); }));
+				}
+			}
+			UE::Tasks::Wait(Tasks);
+		}
+		DestroyWave(Wave);
+		UE_LOG(MapBatch, Log, TEXT("%d / %d maps done."), WaveStart + Wave.Num(), Jobs.Num());
+	}
+
+	BatchWorld->DestroyWorld(false);
+	BatchWorld = nullptr;
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+	WriteStats(OutDir / TEXT("Stats.csv"), Jobs);
+
+	int32 FailedNum = 0;
+	for (const FMapBatchJob& Job : Jobs)
+	{
+		FailedNum += Job.Success ? 0 : 1;
+	}
+	UE_LOG(MapBatch, Log, TEXT("Batch done in %.2fs, %d maps, %d failed."), FPlatformTime::Seconds() - StartTime,
+		Jobs.Num(), FailedNum);
+	return FailedNum == 0 ? 0 : 1;
+}
+
+bool UMapBatchCommandlet::LoadParamSets(const FString& FullPath)
+{
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, *FullPath)) {
+		UE_LOG(MapBatch, Error, TEXT("Param sets %s can not be read."), *FullPath);
+		return false;
+	}
+
+	for (const FString& RawLine : Lines)
+	{
+		FString Line = RawLine.TrimStartAndEnd();
+		if (Line.IsEmpty() || Line.StartsWith(TEXT("#"))) {
+			continue;
+		}
+		TArray<FString> Fields;
+		Line.ParseIntoArrayWS(Fields);
+
+		FMapBatchParamSet& ParamSet = ParamSets.AddDefaulted_GetRef();
+		ParamSet.Name = Fields[0];
+		for (int32 i = 1; i < Fields.Num(); i++)
+		{
+			FString Name;
+			FString Value;
+			if (!Fields[i].Split(TEXT("="), &Name, &Value)) {
+				UE_LOG(MapBatch, Error, TEXT("Param set %s, %s is not Name=Value."), *ParamSet.Name, *Fields[i]);
+				return false;
+			}
+			ParamSet.Values.Add({ Name, Value });
+		}
+	}
+	return true;
+}
+
+bool UMapBatchCommandlet::ApplyParamSet(const FMapBatchParamSet& ParamSet, int32 Seed, ATerrain* Terrain, AHexGrid* HexGrid)
+{
+	//A param set may still pin the seed of one layer
+	ApplySeed(Terrain, Seed);
+
+	for (const TPair<FString, FString>& Value : ParamSet.Values)
+	{
+		FString ObjectName;
+		FString PropertyName;
+		Value.Key.Split(TEXT("."), &ObjectName, &PropertyName);
+		UObject* Object = nullptr;
+		if (ObjectName == TEXT("Terrain")) {
+			Object = Terrain;
+		}
+		else if (ObjectName == TEXT("HexGrid")) {
+			Object = HexGrid;
+		}
+		if (Object == nullptr || !SetProperty(Object, PropertyName, Value.Value)) {
+			UE_LOG(MapBatch, Error, TEXT("Param set %s, can not set %s to %s."), *ParamSet.Name, *Value.Key, *Value.Value);
+			return false;
+		}
+	}
+	return true;
+}
+
+void UMapBatchCommandlet::ApplySeed(ATerrain* Terrain, int32 Seed)
+{
+	for (TFieldIterator<FIntProperty> It(Terrain->GetClass()); It; ++It)
+	{
+		if (It->GetName().EndsWith(TEXT("_NoiseSeed"))) {
+			It->SetPropertyValue_InContainer(Terrain, Seed);
+		}
+	}
+}
+
+bool UMapBatchCommandlet::SetProperty(UObject* Object, const FString& Name, const FString& Value)
+{
+	FProperty* Property = FindFProperty<FProperty>(Object->GetClass(), *Name);
+	if (Property == nullptr) {
+		return false;
+	}
+	return Property->ImportText_Direct(*Value, Property->ContainerPtrToValuePtr<void>(Object), Object, PPF_None) != nullptr;
+}
+
+bool UMapBatchCommandlet::CreateWave(TArrayView<FMapBatchJob> Jobs)
+{
+	check(IsInGameThread());
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.ObjectFlags = RF_Transient;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	bool HasJob = false;
+	for (FMapBatchJob& Job : Jobs)
+	{
+		ATerrain* Terrain = BatchWorld->SpawnActor<ATerrain>(TerrainClass, SpawnParams);
+		AHexGrid* HexGrid = BatchWorld->SpawnActor<AHexGrid>(HexGridClass, SpawnParams);
+		if (Terrain == nullptr || HexGrid == nullptr) {
+			UE_LOG(MapBatch, Error, TEXT("Seed %d, actors can not be spawned."), Job.Seed);
+			continue;
+		}
+		if (!ApplyParamSet(ParamSets[Job.ParamSetIndex], Job.Seed, Terrain, HexGrid)) {
+			Terrain->Destroy();
+			HexGrid->Destroy();
+			continue;
+		}
+		//Noise objects are UObjects, so they are made here and only read by the job
+		Terrain->InitHeadless();
+		HexGrid->InitHeadless();
+		Job.Terrain = Terrain;
+		Job.HexGrid = HexGrid;
+		HasJob = true;
+	}
+	return HasJob;
+}
+
+void UMapBatchCommandlet::DestroyWave(TArrayView<FMapBatchJob> Jobs)
+{
+	for (FMapBatchJob& Job : Jobs)
+	{
+		if (Job.HexGrid != nullptr) {
+			Job.HexGrid->Destroy();
+		}
+		if (Job.Terrain != nullptr) {
+			Job.Terrain->Destroy();
+		}
+		Job.HexGrid = nullptr;
+		Job.Terrain = nullptr;
+	}
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+}
+
+void UMapBatchCommandlet::RunJob(FMapBatchJob& Job)
+{
+	double Time = FPlatformTime::Seconds();
+	Job.Terrain->BuildHeadless();
+	double TerrainDone = FPlatformTime::Seconds();
+	Job.TerrainSeconds = TerrainDone - Time;
+
+	bool Success = Job.HexGrid->RunHeadless(Job.Terrain);
+	double HexGridDone = FPlatformTime::Seconds();
+	Job.HexGridSeconds = HexGridDone - TerrainDone;
+	if (!Success) {
+		UE_LOG(MapBatch, Error, TEXT("Seed %d, hex grid failed."), Job.Seed);
+		return;
+	}
+	Job.TileNum = Job.HexGrid->GetTileNum();
+
+	IFileManager::Get().MakeDirectory(*Job.OutDir, true);
+	Success = WriteHeightfield(Job.OutDir / TEXT("Heightfield.bin"), Job.Terrain);
+	Success = Job.HexGrid->SaveTileData(Job.OutDir / TEXT("Tiles.bin")) && Success;
+	Job.WriteSeconds = FPlatformTime::Seconds() - HexGridDone;
+	if (!Success) {
+		UE_LOG(MapBatch, Error, TEXT("Seed %d, can not write %s."), Job.Seed, *Job.OutDir);
+		return;
+	}
+	Job.Success = true;
+}
+
+bool UMapBatchCommandlet::WriteHeightfield(const FString& FullPath, ATerrain* Terrain)
+{
+	TArray<float> Heights;
+	FMapBatchHeightfieldHeader Header;
+	Terrain->GetHeightfield(Heights, Header.Rows, Header.Columns);
+	Header.Magic = HeightfieldMagic;
+	Header.Version = HeightfieldVersion;
+	Header.Width = Terrain->GetWidth();
+	Header.Height = Terrain->GetHeight();
+
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	Writer << Header.Magic << Header.Version << Header.Rows << Header.Columns << Header.Width << Header.Height;
+	Writer.Serialize(Heights.GetData(), Heights.Num() * sizeof(float));
+	return FFileHelper::SaveArrayToFile(Bytes, *FullPath);
+}
+
+bool UMapBatchCommandlet::WriteStats(const FString& FullPath, const TArray<FMapBatchJob>& Jobs)
+{
+	FString Csv = TEXT("ParamSet,Seed,Success,TerrainSeconds,HexGridSeconds,WriteSeconds,TotalSeconds,Tiles\n");
+	for (const FMapBatchJob& Job : Jobs)
+	{
+		Csv += FString::Printf(TEXT("%s,%d,%d,%.4f,%.4f,%.4f,%.4f,%d\n"), *ParamSets[Job.ParamSetIndex].Name, Job.Seed,
+			Job.Success ? 1 : 0, Job.TerrainSeconds, Job.HexGridSeconds, Job.WriteSeconds,
+			Job.TerrainSeconds + Job.HexGridSeconds + Job.WriteSeconds, Job.TileNum);
+	}
+	if (!FFileHelper::SaveStringToFile(Csv, *FullPath)) {
+		UE_LOG(MapBatch, Error, TEXT("Stats %s can not be written."), *FullPath);
+		return false;
+	}
+	return true;
+}
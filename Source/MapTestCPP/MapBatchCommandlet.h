@@ -0,0 +1,101 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MapBatchCommandlet.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(MapBatch, Log, All);
+
+class ATerrain;
+class AHexGrid;
+
+/*
+ * Heightfield.bin layout (little endian):
+ *   FMapBatchHeightfieldHeader
+ *   float Heights[Rows * Columns]  vertex heights, row major
+ * Tiles.bin is a hex grid baked cache of the map, see HexGridBakedCache.
+ */
+struct FMapBatchHeightfieldHeader
+{
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	int32 Rows = 0;
+	int32 Columns = 0;
+	//Terrain extent in world units
+	float Width = 0.f;
+	float Height = 0.f;
+};
+
+struct FMapBatchParamSet
+{
+	FString Name;
+	//Terrain.Prop or HexGrid.Prop to a value in UE text format
+	TArray<TPair<FString, FString>> Values;
+};
+
+struct FMapBatchJob
+{
+	int32 Seed = 0;
+	int32 ParamSetIndex = 0;
+	ATerrain* Terrain = nullptr;
+	AHexGrid* HexGrid = nullptr;
+	FString OutDir;
+
+	bool Success = false;
+	int32 TileNum = 0;
+	double TerrainSeconds = 0.0;
+	double HexGridSeconds = 0.0;
+	double WriteSeconds = 0.0;
+};
+
+/**
+ * Generates maps with no viewport, every seed with every param set, as many at once as there are worker threads.
+ *   -run=MapBatch -Seeds=1,2,3 [-ParamSets=Batch/Sets.txt] [-Out=Batch] [-TerrainClass=...] [-HexGridClass=...]
+ * A param set file has one set per line, "Name Terrain.NumRows=499 HexGrid.TileSize=200", # starts a comment.
+ * Paths are relative to the project dir. A seed is set on every noise layer of the terrain.
+ * Each map writes Out/Name_Seed/Heightfield.bin and Tiles.bin, Out/Stats.csv gets per map timings.
+ */
+UCLASS()
+class MAPTESTCPP_API UMapBatchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+private:
+	//Never begins play, actors spawned here only run the headless paths
+	UPROPERTY()
+	TObjectPtr<UWorld> BatchWorld;
+
+	TSubclassOf<ATerrain> TerrainClass;
+	TSubclassOf<AHexGrid> HexGridClass;
+	TArray<FMapBatchParamSet> ParamSets;
+
+public:
+	static const uint32 HeightfieldMagic;
+	static const uint32 HeightfieldVersion;
+
+public:
+	UMapBatchCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+	//Seed on every noise layer of the terrain
+	static void ApplySeed(ATerrain* Terrain, int32 Seed);
+	//Property by name from a value in UE text format
+	static bool SetProperty(UObject* Object, const FString& Name, const FString& Value);
+
+private:
+	bool LoadParamSets(const FString& FullPath);
+	bool ApplyParamSet(const FMapBatchParamSet& ParamSet, int32 Seed, ATerrain* Terrain, AHexGrid* HexGrid);
+
+	//Game thread, actors and noise of every job in the wave
+	bool CreateWave(TArrayView<FMapBatchJob> Jobs);
+	void DestroyWave(TArrayView<FMapBatchJob> Jobs);
+	//Any thread
+	static void RunJob(FMapBatchJob& Job);
+	static bool WriteHeightfield(const FString& FullPath, ATerrain* Terrain);
+
+	bool WriteStats(const FString& FullPath, const TArray<FMapBatchJob>& Jobs);
+
+};
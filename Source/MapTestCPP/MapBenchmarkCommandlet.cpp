@@ -0,0 +1,340 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MapBenchmarkCommandlet.h"
+#include "MapBatchCommandlet.h"
+#include "Terrain.h"
+#include "HexGrid.h"
+#include "WorkflowProfiler.h"
+
+#include <Dom/JsonObject.h>
+#include <Engine/World.h>
+#include <Misc/FileHelper.h>
+#include <Misc/Paths.h>
+#include <Policies/PrettyJsonPrintPolicy.h>
+#include <Serialization/JsonReader.h>
+#include <Serialization/JsonSerializer.h>
+#include <Serialization/JsonWriter.h>
+#include <Tasks/Task.h>
+#include <Async/TaskGraphInterfaces.h>
+
+DEFINE_LOG_CATEGORY(MapBenchmark);
+
+//Differences below this are timer noise, never a regression
+static const double MinRegressionMs = 1.0;
+
+UMapBenchmarkCommandlet::UMapBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UMapBenchmarkCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamMap;
+	ParseCommandLine(*Params, Tokens, Switches, ParamMap);
+
+	TArray<int32> Sizes = { 249, 1000 };
+	if (const FString* SizesParam = ParamMap.Find(TEXT("Sizes"))) {
+		TArray<FString> SizeStrings;
+		SizesParam->ParseIntoArray(SizeStrings, TEXT(","));
+		Sizes.Empty();
+		for (const FString& SizeString : SizeStrings)
+		{
+			Sizes.Add(FCString::Atoi(*SizeString));
+		}
+	}
+	if (Switches.Contains(TEXT("Large"))) {
+		Sizes.AddUnique(4000);
+	}
+	const FString* RepeatParam = ParamMap.Find(TEXT("Repeat"));
+	int32 Repeat = RepeatParam != nullptr ? FMath::Max(FCString::Atoi(**RepeatParam), 1) : 3;
+	const FString* SeedParam = ParamMap.Find(TEXT("Seed"));
+	int32 Seed = SeedParam != nullptr ? FCString::Atoi(**SeedParam) : 1337;
+	const FString* ToleranceParam = ParamMap.Find(TEXT("Tolerance"));
+	float Tolerance = ToleranceParam != nullptr ? FCString::Atof(**ToleranceParam) : 0.15f;
+	const FString* OutParam = ParamMap.Find(TEXT("Out"));
+	FString OutPath = OutParam != nullptr ? FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), *OutParam) :
+		FPaths::ConvertRelativePathToFull(FPaths::ProjectSavedDir() / TEXT("MapBenchmark") / TEXT("Report.json"));
+	const FString* BaselineParam = ParamMap.Find(TEXT("Baseline"));
+	FString BaselinePath = BaselineParam != nullptr ? FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), *BaselineParam) : FString();
+	if (BaselineParam != nullptr && !FPaths::FileExists(BaselinePath)) {
+		UE_LOG(MapBenchmark, Error, TEXT("Baseline %s does not exist. Record one on the reference commit with -Out=%s, then pass it as -Baseline."),
+			*BaselinePath, *BaselinePath);
+		return 1;
+	}
+
+	BenchmarkWorld = UWorld::CreateWorld(EWorldType::None, false, TEXT("MapBenchmarkWorld"));
+	Results.Empty();
+	ThreadScalingResults.Empty();
+	bool ThreadScaling = Switches.Contains(TEXT("ThreadScaling"));
+	bool Success = true;
+	for (int32 Size : Sizes)
+	{
+		for (int32 r = 0; r < Repeat && Success; r++)
+		{
+			UE_LOG(MapBenchmark, Log, TEXT("Size %d, run %d / %d"), Size, r + 1, Repeat);
+			Success = RunSize(Size, Seed);
+		}
+		if (ThreadScaling && Success) {
+			Success = RunThreadScaling(Size, Seed, Repeat);
+		}
+	}
+	BenchmarkWorld->DestroyWorld(false);
+	BenchmarkWorld = nullptr;
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	if (!Success) {
+		return 1;
+	}
+
+	for (const FMapBenchmarkResult& Result : Results)
+	{
+		UE_LOG(MapBenchmark, Log, TEXT("  %-48s %10.2f ms %12lld items"), *Result.GetKey(), Result.Milliseconds, Result.Items);
+	}
+	LogThreadScaling();
+	if (!WriteReport(OutPath)) {
+		return 1;
+	}
+
+	if (BaselineParam != nullptr) {
+		int32 Regressions = CompareBaseline(BaselinePath, Tolerance);
+		if (Regressions != 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+bool UMapBenchmarkCommandlet::RunSize(int32 Size, int32 Seed)
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.ObjectFlags = RF_Transient;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	ATerrain* Terrain = BenchmarkWorld->SpawnActor<ATerrain>(ATerrain::StaticClass(), SpawnParams);
+	AHexGrid* HexGrid = BenchmarkWorld->SpawnActor<AHexGrid>(AHexGrid::StaticClass(), SpawnParams);
+	if (Terrain == nullptr || HexGrid == nullptr) {
+		UE_LOG(MapBenchmark, Error, TEXT("Actors can not be spawned."));
+		return false;
+	}
+
+	//Terrain and hex tiles share the default TileSize, rings of at least 1.5 tiles reach the terrain corners.
+	//Tiles outside the terrain are clipped by the builder.
+	FString SizeValue = FString::FromInt(Size);
+	int32 GridRange = FMath::CeilToInt(UE_HALF_SQRT_2 * Size / 1.5f) + 1;
+	bool SetupDone = UMapBatchCommandlet::SetProperty(Terrain, TEXT("NumRows"), SizeValue) &&
+		UMapBatchCommandlet::SetProperty(Terrain, TEXT("NumColumns"), SizeValue) &&
+		UMapBatchCommandlet::SetProperty(Terrain, TEXT("HasWater"), TEXT("True")) &&
+		UMapBatchCommandlet::SetProperty(HexGrid, TEXT("bBuildProcedural"), TEXT("True")) &&
+		UMapBatchCommandlet::SetProperty(HexGrid, TEXT("GridRange"), FString::FromInt(GridRange));
+	if (!SetupDone) {
+		UE_LOG(MapBenchmark, Error, TEXT("Size %d, params can not be set."), Size);
+		return false;
+	}
+	UMapBatchCommandlet::ApplySeed(Terrain, Seed);
+
+	Terrain->InitHeadless();
+	HexGrid->InitHeadless();
+	//Timings of the vector noise path only count when it samples the same terrain as FastNoise,
+	//and the graph ones when the default graph gives the heights of the built-in recipe
+	double RecipeMs = 0.0;
+	double GraphMs = 0.0;
+	if (!Terrain->CheckNoiseBatchParity() || !Terrain->CheckDefaultGraphParity(1e-4f, RecipeMs, GraphMs)) {
+		HexGrid->Destroy();
+		Terrain->Destroy();
+		return false;
+	}
+	int64 VertexNum = int64(Size + 1) * (Size + 1);
+	AddResult(Size, TEXT("AltitudeNoise"), TEXT("Recipe"), RecipeMs, VertexNum);
+	AddResult(Size, TEXT("AltitudeNoise"), TEXT("Graph"), GraphMs, VertexNum);
+	bool Success = false;
+	UE::Tasks::Launch(TEXT("MapBenchmarkRun"), [Terrain, HexGrid, &Success]() {
+		Terrain->BuildHeadless();
+		Success = HexGrid->RunHeadless(Terrain);
+	}).Wait();
+
+	//Gathered normals only count when they match the mesh triangles
+	Success = Success && Terrain->CheckNormalsParity();
+	if (Success) {
+		AddResults(Size, TEXT("Terrain"), Terrain->GetProfiler());
+		AddResults(Size, TEXT("HexGrid"), HexGrid->GetProfiler());
+	}
+	else {
+		UE_LOG(MapBenchmark, Error, TEXT("Size %d, hex grid or terrain normals failed."), Size);
+	}
+
+	HexGrid->Destroy();
+	Terrain->Destroy();
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	return Success;
+}
+
+bool UMapBenchmarkCommandlet::RunThreadScaling(int32 Size, int32 Seed, int32 Repeat)
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.ObjectFlags = RF_Transient;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	ATerrain* Terrain = BenchmarkWorld->SpawnActor<ATerrain>(ATerrain::StaticClass(), SpawnParams);
+	if (Terrain == nullptr) {
+		UE_LOG(MapBenchmark, Error, TEXT("Actors can not be spawned."));
+		return false;
+	}
+	FString SizeValue = FString::FromInt(Size);
+	if (!UMapBatchCommandlet::SetProperty(Terrain, TEXT("NumRows"), SizeValue) ||
+		!UMapBatchCommandlet::SetProperty(Terrain, TEXT("NumColumns"), SizeValue)) {
+		UE_LOG(MapBenchmark, Error, TEXT("Size %d, params can not be set."), Size);
+		Terrain->Destroy();
+		return false;
+	}
+	UMapBatchCommandlet::ApplySeed(Terrain, Seed);
+	Terrain->InitHeadless();
+
+	//Bands are spread over the workers and the waiting thread
+	int32 MaxThreads = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+	TArray<int32> ThreadCounts;
+	for (int32 Threads = 1; Threads < MaxThreads; Threads *= 2)
+	{
+		ThreadCounts.Add(Threads);
+	}
+	ThreadCounts.Add(MaxThreads);
+
+	for (int32 Threads : ThreadCounts)
+	{
+		FMapThreadScalingResult& Result = ThreadScalingResults.AddDefaulted_GetRef();
+		Result.Size = Size;
+		Result.Threads = Threads;
+		for (int32 r = 0; r < Repeat; r++)
+		{
+			double StartTime = FPlatformTime::Seconds();
+			Terrain->CreateVerticesInBands(Threads);
+			Result.Milliseconds = FMath::Min(Result.Milliseconds, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+		}
+	}
+
+	Terrain->Destroy();
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	return true;
+}
+
+void UMapBenchmarkCommandlet::LogThreadScaling() const
+{
+	for (const FMapThreadScalingResult& Result : ThreadScalingResults)
+	{
+		const FMapThreadScalingResult* Single = ThreadScalingResults.FindByPredicate([&](const FMapThreadScalingResult& Each) {
+			return Each.Size == Result.Size && Each.Threads == 1;
+		});
+		double Speedup = Single != nullptr && Result.Milliseconds > 0.0 ? Single->Milliseconds / Result.Milliseconds : 1.0;
+		UE_LOG(MapBenchmark, Log, TEXT("  %d/Terrain/CreateVertices %3d threads %10.2f ms %6.2fx %5.1f%%"), Result.Size,
+			Result.Threads, Result.Milliseconds, Speedup, Speedup / Result.Threads * 100.0);
+	}
+}
+
+void UMapBenchmarkCommandlet::AddResults(int32 Size, const FString& Workflow, const WorkflowProfiler& Profiler)
+{
+	TArray<WorkflowProfiler::FStageStats> Stages;
+	Profiler.CopyStages(Stages);
+	for (const WorkflowProfiler::FStageStats& Stats : Stages)
+	{
+		if (Stats.Slices == 0) {
+			continue;
+		}
+		AddResult(Size, Workflow, Stats.Name, Stats.ActiveSeconds * 1000.0, Stats.Items);
+	}
+}
+
+void UMapBenchmarkCommandlet::AddResult(int32 Size, const FString& Workflow, const FString& Stage, double Milliseconds, int64 Items)
+{
+	FMapBenchmarkResult* Result = Results.FindByPredicate([&](const FMapBenchmarkResult& Each) {
+		return Each.Size == Size && Each.Workflow == Workflow && Each.Stage == Stage;
+	});
+	if (Result == nullptr) {
+		Result = &Results.AddDefaulted_GetRef();
+		Result->Size = Size;
+		Result->Workflow = Workflow;
+		Result->Stage = Stage;
+	}
+	Result->Milliseconds = FMath::Min(Result->Milliseconds, Milliseconds);
+	Result->Items = Items;
+}
+
+bool UMapBenchmarkCommandlet::WriteReport(const FString& FullPath) const
+{
+	FString Json;
+	TSharedRef<TJsonWriter<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>> Writer =
+		TJsonWriterFactory<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>::Create(&Json);
+	Writer->WriteObjectStart();
+	Writer->WriteValue(TEXT("Date"), FDateTime::UtcNow().ToIso8601());
+	Writer->WriteValue(TEXT("Cores"), FPlatformMisc::NumberOfCoresIncludingHyperthreads());
+	Writer->WriteArrayStart(TEXT("Results"));
+	for (const FMapBenchmarkResult& Result : Results)
+	{
+		Writer->WriteObjectStart();
+		Writer->WriteValue(TEXT("Size"), Result.Size);
+		Writer->WriteValue(TEXT("Workflow"), Result.Workflow);
+		Writer->WriteValue(TEXT("Stage"), Result.Stage);
+		Writer->WriteValue(TEXT("Ms"), Result.Milliseconds);
+		Writer->WriteValue(TEXT("Items"), Result.Items);
+		Writer->WriteObjectEnd();
+	}
+	Writer->WriteArrayEnd();
+	Writer->WriteArrayStart(TEXT("ThreadScaling"));
+	for (const FMapThreadScalingResult& Result : ThreadScalingResults)
+	{
+		Writer->WriteObjectStart();
+		Writer->WriteValue(TEXT("Size"), Result.Size);
+		Writer->WriteValue(TEXT("Threads"), Result.Threads);
+		Writer->WriteValue(TEXT("Ms"), Result.Milliseconds);
+		Writer->WriteObjectEnd();
+	}
+	Writer->WriteArrayEnd();
+	Writer->WriteObjectEnd();
+	Writer->Close();
+
+	if (!FFileHelper::SaveStringToFile(Json, *FullPath)) {
+		UE_LOG(MapBenchmark, Error, TEXT("Report %s can not be written."), *FullPath);
+		return false;
+	}
+	UE_LOG(MapBenchmark, Log, TEXT("Report written to %s"), *FullPath);
+	return true;
+}
+
+int32 UMapBenchmarkCommandlet::CompareBaseline(const FString& FullPath, float Tolerance) const
+{
+	FString Json;
+	TSharedPtr<FJsonObject> Root;
+	if (!FFileHelper::LoadFileToString(Json, *FullPath) ||
+		!FJsonSerializer::Deserialize(TJsonReaderFactory<TCHAR>::Create(Json), Root) || !Root.IsValid()) {
+		UE_LOG(MapBenchmark, Error, TEXT("Baseline %s can not be read."), *FullPath);
+		return 1;
+	}
+
+	TMap<FString, double> BaselineMs;
+	for (const TSharedPtr<FJsonValue>& Value : Root->GetArrayField(TEXT("Results")))
+	{
+		const TSharedPtr<FJsonObject>& Object = Value->AsObject();
+		FMapBenchmarkResult Result;
+		Result.Size = Object->GetIntegerField(TEXT("Size"));
+		Result.Workflow = Object->GetStringField(TEXT("Workflow"));
+		Result.Stage = Object->GetStringField(TEXT("Stage"));
+		BaselineMs.Add(Result.GetKey(), Object->GetNumberField(TEXT("Ms")));
+	}
+
+	int32 Regressions = 0;
+	for (const FMapBenchmarkResult& Result : Results)
+	{
+		const double* Base = BaselineMs.Find(Result.GetKey());
+		if (Base == nullptr) {
+			continue;
+		}
+		if (Result.Milliseconds > *Base * (1.0 + Tolerance) && Result.Milliseconds - *Base > MinRegressionMs) {
+			UE_LOG(MapBenchmark, Warning, TEXT("Regression %s: %.2f ms, baseline %.2f ms"), *Result.GetKey(),
+				Result.Milliseconds, *Base);
+			Regressions++;
+		}
+	}
+	UE_LOG(MapBenchmark, Log, TEXT("%d regressions against %s"), Regressions, *FullPath);
+	return Regressions;
+}
@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MapBenchmarkCommandlet.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(MapBenchmark, Log, All);
+
+class ATerrain;
+class AHexGrid;
+class WorkflowProfiler;
+
+struct FMapBenchmarkResult
+{
+	int32 Size = 0;
+	FString Workflow;
+	FString Stage;
+	//Best of the repeats
+	double Milliseconds = MAX_dbl;
+	int64 Items = 0;
+
+	FString GetKey() const
+	{
+		return FString::Printf(TEXT("%d/%s/%s"), Size, *Workflow, *Stage);
+	}
+};
+
+struct FMapThreadScalingResult
+{
+	int32 Size = 0;
+	int32 Threads = 0;
+	//Best of the repeats
+	double Milliseconds = MAX_dbl;
+};
+
+/**
+ * Times every headless workflow stage of a terrain and a procedural hex grid covering it, at several grid sizes.
+ *   -run=MapBenchmark [-Sizes=249,1000] [-Large] [-Repeat=3] [-Seed=1337] [-Out=Saved/MapBenchmark/Report.json]
+ *                     [-Baseline=Report.json] [-Tolerance=0.15] [-ThreadScaling]
+ * Sizes are NumRows and NumColumns of the terrain, a stage keeps its best active time of the repeats.
+ * Large adds size 4000, about 6M tiles and 2GB of adjacency, too much for most dev and CI machines.
+ * With a baseline, an earlier report, stages slower by more than Tolerance are listed and the commandlet fails.
+ * No baseline is committed, timings belong to one machine. Record one there with a run on the reference commit,
+ * -Out=Saved/MapBenchmark/Baseline.json, then pass it as -Baseline. A missing baseline fails before any run.
+ * Every size first checks the batched terrain noise against FastNoise and the default altitude graph against the
+ * built-in recipe, then the gathered terrain normals against the mesh triangles, and fails on a mismatch.
+ * The terrain has water on, the default graph is the recipe with water. Both altitude paths are timed over every
+ * vertex as AltitudeNoise/Recipe and AltitudeNoise/Graph.
+ * ThreadScaling also times the terrain vertices stage on 1, 2, 4... threads up to the workers and the calling thread.
+ */
+UCLASS()
+class MAPTESTCPP_API UMapBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+private:
+	//Never begins play, actors spawned here only run the headless paths
+	UPROPERTY()
+	TObjectPtr<UWorld> BenchmarkWorld;
+
+	TArray<FMapBenchmarkResult> Results;
+	TArray<FMapThreadScalingResult> ThreadScalingResults;
+
+public:
+	UMapBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	bool RunSize(int32 Size, int32 Seed);
+	void AddResults(int32 Size, const FString& Workflow, const WorkflowProfiler& Profiler);
+	void AddResult(int32 Size, const FString& Workflow, const FString& Stage, double Milliseconds, int64 Items);
+	bool RunThreadScaling(int32 Size, int32 Seed, int32 Repeat);
+	void LogThreadScaling() const;
+
+	bool WriteReport(const FString& FullPath) const;
+	//Regressions found
+	int32 CompareBaseline(const FString& FullPath, float Tolerance) const;
+
+};
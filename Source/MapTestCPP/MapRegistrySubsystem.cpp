@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MapRegistrySubsystem.h"
+
+#include <Engine/World.h>
+
+DEFINE_LOG_CATEGORY(MapRegistry);
+
+//Run and drop the waiters State is past, callbacks may add new waiters meanwhile
+template<typename ActorType, typename StateType>
+static void FireStageWaiters(TArray<TMapStageWaiter<ActorType, StateType>>& Waiters, ActorType* Actor, StateType State)
+{
+	TArray<TMapStageWaiter<ActorType, StateType>> Pending = MoveTemp(Waiters);
+	Waiters.Reset();
+	for (TMapStageWaiter<ActorType, StateType>& Waiter : Pending)
+	{
+		if (!Waiter.Listener.IsValid()) {
+			continue;
+		}
+		if (State > Waiter.Stage) {
+			Waiter.Callback(Actor);
+		}
+		else {
+			Waiters.Add(MoveTemp(Waiter));
+		}
+	}
+}
+
+void UMapRegistrySubsystem::Deinitialize()
+{
+	TerrainWaiters.Empty();
+	HexGridWaiters.Empty();
+	HexGridRegisteredWaiters.Empty();
+	Super::Deinitialize();
+}
+
+void UMapRegistrySubsystem::RegisterTerrain(ATerrain* InTerrain)
+{
+	if (Terrain.IsValid() && Terrain.Get() != InTerrain) {
+		UE_LOG(MapRegistry, Warning, TEXT("More than one Terrain, %s is not registered!"), *InTerrain->GetName());
+		return;
+	}
+	Terrain = InTerrain;
+}
+
+void UMapRegistrySubsystem::UnregisterTerrain(ATerrain* InTerrain)
+{
+	if (Terrain.Get() == InTerrain) {
+		Terrain.Reset();
+	}
+}
+
+void UMapRegistrySubsystem::RegisterHexGrid(AHexGrid* InHexGrid)
+{
+	if (HexGrid.IsValid() && HexGrid.Get() != InHexGrid) {
+		UE_LOG(MapRegistry, Warning, TEXT("More than one HexGrid, %s is not registered!"), *InHexGrid->GetName());
+		return;
+	}
+	HexGrid = InHexGrid;
+
+	TArray<TPair<TWeakObjectPtr<UObject>, TFunction<void(AHexGrid*)>>> Pending = MoveTemp(HexGridRegisteredWaiters);
+	HexGridRegisteredWaiters.Reset();
+	for (TPair<TWeakObjectPtr<UObject>, TFunction<void(AHexGrid*)>>& Waiter : Pending)
+	{
+		if (Waiter.Key.IsValid()) {
+			Waiter.Value(InHexGrid);
+		}
+	}
+	OnHexGridRegistered.Broadcast(InHexGrid);
+}
+
+void UMapRegistrySubsystem::UnregisterHexGrid(AHexGrid* InHexGrid)
+{
+	if (HexGrid.Get() == InHexGrid) {
+		HexGrid.Reset();
+	}
+}
+
+void UMapRegistrySubsystem::NotifyTerrainStageDone(ATerrain* InTerrain, Enum_TerrainWorkflowState State)
+{
+	check(IsInGameThread());
+	if (Terrain.Get() != InTerrain) {
+		return;
+	}
+	if (State != Enum_TerrainWorkflowState::Error) {
+		FireStageWaiters(TerrainWaiters, InTerrain, State);
+	}
+	OnTerrainStageDone.Broadcast(InTerrain, State);
+}
+
+void UMapRegistrySubsystem::NotifyHexGridStageDone(AHexGrid* InHexGrid, Enum_HexGridWorkflowState State)
+{
+	check(IsInGameThread());
+	if (HexGrid.Get() != InHexGrid) {
+		return;
+	}
+	if (State != Enum_HexGridWorkflowState::Error) {
+		FireStageWaiters(HexGridWaiters, InHexGrid, State);
+	}
+	OnHexGridStageDone.Broadcast(InHexGrid, State);
+}
+
+void UMapRegistrySubsystem::WhenTerrainStageDone(UObject* Listener, Enum_TerrainWorkflowState Stage,
+	TFunction<void(ATerrain*)> Callback)
+{
+	ATerrain* Current = Terrain.Get();
+	if (Current != nullptr && Current->IsWorkFlowOverStage(Stage) && !Current->IsWorkFlowError()) {
+		Callback(Current);
+		return;
+	}
+	TerrainWaiters.Add({ Listener, Stage, MoveTemp(Callback) });
+}
+
+void UMapRegistrySubsystem::WhenHexGridStageDone(UObject* Listener, Enum_HexGridWorkflowState Stage,
+	TFunction<void(AHexGrid*)> Callback)
+{
+	AHexGrid* Current = HexGrid.Get();
+	if (Current != nullptr && Current->IsWorkFlowOverStage(Stage) && !Current->IsWorkFlowError()) {
+		Callback(Current);
+		return;
+	}
+	HexGridWaiters.Add({ Listener, Stage, MoveTemp(Callback) });
+}
+
+void UMapRegistrySubsystem::WhenHexGridRegistered(UObject* Listener, TFunction<void(AHexGrid*)> Callback)
+{
+	if (AHexGrid* Current = HexGrid.Get()) {
+		Callback(Current);
+		return;
+	}
+	HexGridRegisteredWaiters.Add({ Listener, MoveTemp(Callback) });
+}
+
+UMapRegistrySubsystem* UMapRegistrySubsystem::Get(const UObject* WorldContextObject)
+{
+	UWorld* World = WorldContextObject != nullptr ? WorldContextObject->GetWorld() : nullptr;
+	return World != nullptr ? World->GetSubsystem<UMapRegistrySubsystem>() : nullptr;
+}
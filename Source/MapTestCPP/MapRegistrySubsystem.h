@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Terrain.h"
+#include "HexGrid.h"
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "MapRegistrySubsystem.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(MapRegistry, Log, All);
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnHexGridRegistered, AHexGrid*);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnTerrainStageDone, ATerrain*, Enum_TerrainWorkflowState);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnHexGridStageDone, AHexGrid*, Enum_HexGridWorkflowState);
+
+template<typename ActorType, typename StateType>
+struct TMapStageWaiter
+{
+	TWeakObjectPtr<UObject> Listener;
+	StateType Stage;
+	TFunction<void(ActorType*)> Callback;
+};
+
+/**
+ * The terrain and hex grid of a world, registered from BeginPlay to EndPlay.
+ * Actors broadcast their workflow milestones here, so others wait on an event instead of polling for actors.
+ */
+UCLASS()
+class MAPTESTCPP_API UMapRegistrySubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+private:
+	TWeakObjectPtr<ATerrain> Terrain;
+	TWeakObjectPtr<AHexGrid> HexGrid;
+
+	TArray<TMapStageWaiter<ATerrain, Enum_TerrainWorkflowState>> TerrainWaiters;
+	TArray<TMapStageWaiter<AHexGrid, Enum_HexGridWorkflowState>> HexGridWaiters;
+	TArray<TPair<TWeakObjectPtr<UObject>, TFunction<void(AHexGrid*)>>> HexGridRegisteredWaiters;
+
+public:
+	FOnHexGridRegistered OnHexGridRegistered;
+	//Milestones only, InitWorkflow once its results are readable, then Done or Error
+	FOnTerrainStageDone OnTerrainStageDone;
+	FOnHexGridStageDone OnHexGridStageDone;
+
+public:
+	virtual void Deinitialize() override;
+
+	//One of each per world, a second one is refused
+	void RegisterTerrain(ATerrain* InTerrain);
+	void UnregisterTerrain(ATerrain* InTerrain);
+	void RegisterHexGrid(AHexGrid* InHexGrid);
+	void UnregisterHexGrid(AHexGrid* InHexGrid);
+
+	FORCEINLINE ATerrain* GetTerrain() const
+	{
+		return Terrain.Get();
+	}
+
+	FORCEINLINE AHexGrid* GetHexGrid() const
+	{
+		return HexGrid.Get();
+	}
+
+	//Game thread only, State is the state after the finished stage
+	void NotifyTerrainStageDone(ATerrain* InTerrain, Enum_TerrainWorkflowState State);
+	void NotifyHexGridStageDone(AHexGrid* InHexGrid, Enum_HexGridWorkflowState State);
+
+	//Callback runs now when the registered actor is already past Stage, else once a milestone past it is broadcast.
+	//Never for Error, dropped when Listener is gone.
+	void WhenTerrainStageDone(UObject* Listener, Enum_TerrainWorkflowState Stage, TFunction<void(ATerrain*)> Callback);
+	void WhenHexGridStageDone(UObject* Listener, Enum_HexGridWorkflowState Stage, TFunction<void(AHexGrid*)> Callback);
+	void WhenHexGridRegistered(UObject* Listener, TFunction<void(AHexGrid*)> Callback);
+
+	static UMapRegistrySubsystem* Get(const UObject* WorldContextObject);
+
+};
@@ -13,18 +13,14 @@ struct FStructLoopData
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite)
 	float Rate = 0.01f;
 
-	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, meta = (ClampMin = "1"))
-	int32 LoopDepthLimit = 4;
-
-	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite)
-	TArray<int32> IndexSaved = {};
-
-	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite)
-	bool HasInitialized = false;
-
+	//Position of the resumable loop, iterations done
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, meta = (ClampMin = "0"))
 	int32 Count = 0;
 
+	//Frame budget slicing, iterations between clock reads and start of the current slice
+	int32 CheckInterval = 1;
+	double SliceStartTime = 0.0;
+
 };
 
 USTRUCT(BlueprintType)
@@ -32,13 +28,13 @@ struct FStructHexTileNeighbors
 {
 	GENERATED_BODY()
 
-	UPROPERTY()
+	UPROPERTY(BlueprintReadOnly)
 	int32 Radius;
 
-	UPROPERTY()
+	UPROPERTY(BlueprintReadOnly)
 	int32 Count;
 
-	UPROPERTY()
+	UPROPERTY(BlueprintReadOnly)
 	TArray<FIntPoint> Tiles;
 };
 
@@ -71,9 +67,6 @@ struct FStructHexTileData
 	UPROPERTY(BlueprintReadOnly)
 	float AngleToUp;
 
-	UPROPERTY(BlueprintReadOnly)
-	TArray<FStructHexTileNeighbors> Neighbors;
-
 	UPROPERTY(BlueprintReadOnly)
 	int32 TerrainWalkingBlockLevel;
 
@@ -4,13 +4,20 @@
 #include "Terrain.h"
 #include "FlowControlUtility.h"
 #include "HexGrid.h"
+#include "MapRegistrySubsystem.h"
+#include "HexGridBakedCache.h"
+#include "TerrainNoiseGraph.h"
 
 #include <Kismet/GameplayStatics.h>
 #include <Kismet/KismetMaterialLibrary.h>
 #include <Kismet/KismetMathLibrary.h>
 #include <Math/UnrealMathUtility.h>
+#include <Async/ParallelFor.h>
 #include <TimerManager.h>
+#include <Async/Async.h>
 #include <ProceduralMeshComponent.h>
+#include <Engine/CollisionProfile.h>
+#include <Components/DecalComponent.h>
 #include <EnhancedInputComponent.h>
 #include <EnhancedInputSubsystems.h>
 
@@ -44,11 +51,65 @@ void ATerrain::BeginPlay()
 	AddInputMappingContext();
 	BindEnchancedInputAction();
 
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->RegisterTerrain(this);
+	}
+	Profiler.Init(GetName(), StaticEnum<Enum_TerrainWorkflowState>());
+	InitChunkCollision();
 	WorkflowState = Enum_TerrainWorkflowState::InitWorkflow;
 	CreateTerrainFlow();
 	StartUpdateMousePos();
 }
 
+void ATerrain::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Graph.CancelAndWait();
+	FlowControlUtility::CancelScheduled(this, WorkflowDelegate);
+	if (!HeightfieldReadyEvent.IsCompleted()) {
+		HeightfieldReadyEvent.Trigger();
+	}
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->UnregisterTerrain(this);
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
+void ATerrain::Regenerate()
+{
+	Graph.CancelAndWait();
+	FlowControlUtility::CancelScheduled(this, WorkflowDelegate);
+
+	//The grid reads the terrain, so it stops before the buffers are reset and waits for this run
+	Profiler.Init(GetName(), StaticEnum<Enum_TerrainWorkflowState>());
+	WorkflowState = Enum_TerrainWorkflowState::InitWorkflow;
+	bWorkflowFailed = false;
+	if (HexGrid != nullptr) {
+		HexGrid->Regenerate();
+	}
+
+	//Waiters of the last run are released, the grid has dropped them
+	if (!HeightfieldReadyEvent.IsCompleted()) {
+		HeightfieldReadyEvent.Trigger();
+	}
+	HeightfieldReadyEvent = UE::Tasks::FTaskEvent(TEXT("TerrainHeightfieldReady"));
+	Heightfield.Reset();
+	MeshChunks.Reset();
+
+	//Same sizes as the last run unless the params changed, Reset keeps the allocations
+	Vertices.Reset();
+	UVs.Reset();
+	Normals.Reset();
+	VertexColors.Reset();
+	TreeValues.Reset();
+	WaterVertices.Reset();
+	WaterUVs.Reset();
+	WaterTriangles.Reset();
+	WaterNormals.Reset();
+	ResetProgress();
+	FlowControlUtility::ScheduleNextPoll(this, WorkflowDelegate, DefaultTimerRate);
+	UE_LOG(Terrain, Log, TEXT("Regenerate terrain!"));
+}
+
 // Called every frame
 void ATerrain::Tick(float DeltaTime)
 {
@@ -115,7 +176,7 @@ bool ATerrain::IsMouseClickTraceHit()
 
 	FHitResult result;
 	FCollisionQueryParams params;
-	bool isHit = TerrainMesh->LineTraceComponent(result, location, HoldTraceLength * direction + location,
+	bool isHit = ActorLineTraceSingle(result, location, HoldTraceLength * direction + location, ECC_Visibility,
 		params);
 	return isHit;
 }
@@ -140,7 +201,7 @@ void ATerrain::UpdateMousePosition()
 
 		FHitResult result;
 		FCollisionQueryParams params;
-		bool isHit = TerrainMesh->LineTraceComponent(result, location, HoldTraceLength * direction + location,
+		bool isHit = ActorLineTraceSingle(result, location, HoldTraceLength * direction + location, ECC_Visibility,
 			params);
 		if (isHit) {
 			MousePos.Set(result.Location.X, result.Location.Y, result.Location.Z);
@@ -190,104 +251,22 @@ bool ATerrain::IsRightHold()
 
 void ATerrain::CreateNoise()
 {
-	NWHighMountain = NewObject<UFastNoiseWrapper>(this);
-	NWLowMountain = NewObject<UFastNoiseWrapper>(this);
-	NWWater = NewObject<UFastNoiseWrapper>(this);
-	NWMoisture = NewObject<UFastNoiseWrapper>(this);
-	NWTemperature = NewObject<UFastNoiseWrapper>(this);
-	NWBiomes = NewObject<UFastNoiseWrapper>(this);
-	NWTree = NewObject<UFastNoiseWrapper>(this);
-
-	if (NWHighMountain != nullptr && NWLowMountain != nullptr && NWWater != nullptr && 
-		NWMoisture != nullptr && NWTemperature != nullptr && NWBiomes!=nullptr && 
-		NWTree != nullptr) {
-		NWHighMountain->SetupFastNoise(NWHighMountain_NoiseType,
-			NWHighMountain_NoiseSeed,
-			NWHighMountain_NoiseFrequency,
-			NWHighMountain_Interp,
-			NWHighMountain_FractalType,
-			NWHighMountain_Octaves,
-			NWHighMountain_Lacunarity,
-			NWHighMountain_Gain,
-			NWHighMountain_CellularJitter,
-			NWHighMountain_CDF,
-			NWHighMountain_CRT);
-
-		NWLowMountain->SetupFastNoise(NWLowMountain_NoiseType,
-			NWLowMountain_NoiseSeed,
-			NWLowMountain_NoiseFrequency,
-			NWLowMountain_Interp,
-			NWLowMountain_FractalType,
-			NWLowMountain_Octaves,
-			NWLowMountain_Lacunarity,
-			NWLowMountain_Gain,
-			NWLowMountain_CellularJitter,
-			NWLowMountain_CDF,
-			NWLowMountain_CRT);
-
-		NWWater->SetupFastNoise(NWWater_NoiseType,
-			NWWater_NoiseSeed,
-			NWWater_NoiseFrequency,
-			NWWater_Interp,
-			NWWater_FractalType,
-			NWWater_Octaves,
-			NWWater_Lacunarity,
-			NWWater_Gain,
-			NWWater_CellularJitter,
-			NWWater_CDF,
-			NWWater_CRT);
-
-		NWMoisture->SetupFastNoise(NWMoisture_NoiseType,
-			NWMoisture_NoiseSeed,
-			NWMoisture_NoiseFrequency,
-			NWMoisture_Interp,
-			NWMoisture_FractalType,
-			NWMoisture_Octaves,
-			NWMoisture_Lacunarity,
-			NWMoisture_Gain,
-			NWMoisture_CellularJitter,
-			NWMoisture_CDF,
-			NWMoisture_CRT);
-
-		NWTemperature->SetupFastNoise(NWTemperature_NoiseType,
-			NWTemperature_NoiseSeed,
-			NWTemperature_NoiseFrequency,
-			NWTemperature_Interp,
-			NWTemperature_FractalType,
-			NWTemperature_Octaves,
-			NWTemperature_Lacunarity,
-			NWTemperature_Gain,
-			NWTemperature_CellularJitter,
-			NWTemperature_CDF,
-			NWTemperature_CRT);
-
-		NWBiomes->SetupFastNoise(NWBiomes_NoiseType,
-			NWBiomes_NoiseSeed,
-			NWBiomes_NoiseFrequency,
-			NWBiomes_Interp,
-			NWBiomes_FractalType,
-			NWBiomes_Octaves,
-			NWBiomes_Lacunarity,
-			NWBiomes_Gain,
-			NWBiomes_CellularJitter,
-			NWBiomes_CDF,
-			NWBiomes_CRT);
-
-		NWTree->SetupFastNoise(NWTree_NoiseType,
-			NWTree_NoiseSeed,
-			NWTree_NoiseFrequency,
-			NWTree_Interp,
-			NWTree_FractalType,
-			NWTree_Octaves,
-			NWTree_Lacunarity,
-			NWTree_Gain,
-			NWTree_CellularJitter,
-			NWTree_CDF,
-			NWTree_CRT);
-
-		//CreateNoiseDone = true;
-		UE_LOG(Terrain, Log, TEXT("Create and set Noise."));
-	}
+	using ELayer = TerrainNoise::ELayer;
+	Noise.SetupLayer(ELayer::HighMountain, NWHighMountain_NoiseType, NWHighMountain_NoiseSeed, NWHighMountain_NoiseFrequency, NWHighMountain_Interp,
+		NWHighMountain_FractalType, NWHighMountain_Octaves, NWHighMountain_Lacunarity, NWHighMountain_Gain, NWHighMountain_CellularJitter, NWHighMountain_CDF, NWHighMountain_CRT);
+	Noise.SetupLayer(ELayer::LowMountain, NWLowMountain_NoiseType, NWLowMountain_NoiseSeed, NWLowMountain_NoiseFrequency, NWLowMountain_Interp,
+		NWLowMountain_FractalType, NWLowMountain_Octaves, NWLowMountain_Lacunarity, NWLowMountain_Gain, NWLowMountain_CellularJitter, NWLowMountain_CDF, NWLowMountain_CRT);
+	Noise.SetupLayer(ELayer::Water, NWWater_NoiseType, NWWater_NoiseSeed, NWWater_NoiseFrequency, NWWater_Interp,
+		NWWater_FractalType, NWWater_Octaves, NWWater_Lacunarity, NWWater_Gain, NWWater_CellularJitter, NWWater_CDF, NWWater_CRT);
+	Noise.SetupLayer(ELayer::Moisture, NWMoisture_NoiseType, NWMoisture_NoiseSeed, NWMoisture_NoiseFrequency, NWMoisture_Interp,
+		NWMoisture_FractalType, NWMoisture_Octaves, NWMoisture_Lacunarity, NWMoisture_Gain, NWMoisture_CellularJitter, NWMoisture_CDF, NWMoisture_CRT);
+	Noise.SetupLayer(ELayer::Temperature, NWTemperature_NoiseType, NWTemperature_NoiseSeed, NWTemperature_NoiseFrequency, NWTemperature_Interp,
+		NWTemperature_FractalType, NWTemperature_Octaves, NWTemperature_Lacunarity, NWTemperature_Gain, NWTemperature_CellularJitter, NWTemperature_CDF, NWTemperature_CRT);
+	Noise.SetupLayer(ELayer::Biomes, NWBiomes_NoiseType, NWBiomes_NoiseSeed, NWBiomes_NoiseFrequency, NWBiomes_Interp,
+		NWBiomes_FractalType, NWBiomes_Octaves, NWBiomes_Lacunarity, NWBiomes_Gain, NWBiomes_CellularJitter, NWBiomes_CDF, NWBiomes_CRT);
+	Noise.SetupLayer(ELayer::Tree, NWTree_NoiseType, NWTree_NoiseSeed, NWTree_NoiseFrequency, NWTree_Interp,
+		NWTree_FractalType, NWTree_Octaves, NWTree_Lacunarity, NWTree_Gain, NWTree_CellularJitter, NWTree_CDF, NWTree_CRT);
+	UE_LOG(Terrain, Log, TEXT("Create and set Noise."));
 }
 
 bool ATerrain::IsWorkFlowStepDone(Enum_TerrainWorkflowState state)
@@ -321,28 +300,51 @@ void ATerrain::InitTreeParam()
 	OneMinTAS = 1.0 - TreeAreaScaleA;
 }
 
+void ATerrain::InitNoiseParams()
+{
+	TerrainNoise::FParams Params;
+	Params.TileNumRowRatio = TileNumRowRatio;
+	Params.TileNumColumnRatio = TileNumColumnRatio;
+	Params.TileAltitudeMultiplier = TileAltitudeMultiplier;
+	TerrainNoise::MappingByLevel(HighMountainLevel, HighRangeMapping, Params.HighMapping);
+	TerrainNoise::MappingByLevel(LowMountainLevel, LowRangeMapping, Params.LowMapping);
+	Params.HasWater = HasWater;
+	TerrainNoise::MappingByLevel(WaterLevel, WaterRangeMapping, Params.WaterMapping);
+	TerrainNoise::MappingByLevel(WaterLevel, WaterGroundRangeMapping, Params.WaterGroundMapping);
+	Params.WaterBaseRatio = WaterBaseRatio;
+	Params.WaterBankSharpness = WaterBankSharpness;
+	Params.TreeAreaScaleA = TreeAreaScaleA;
+	Params.OneMinTAS = OneMinTAS;
+	Noise.SetParams(Params);
+
+	Noise.ResetAltitudeProgram();
+	if (AltitudeGraph != nullptr) {
+		TerrainNoiseProgram Program;
+		FString Error;
+		if (Program.Compile(*AltitudeGraph, AltitudeGraph_NoiseSeed, TileNumRowRatio, TileNumColumnRatio, Error)) {
+			UE_LOG(Terrain, Log, TEXT("Altitude graph %s compiled to %d instructions."), *AltitudeGraph->GetName(),
+				Program.GetInstructionNum());
+			Noise.SetAltitudeProgram(MoveTemp(Program));
+		}
+		else {
+			UE_LOG(Terrain, Warning, TEXT("Altitude graph %s can not be compiled, built-in recipe used. %s"),
+				*AltitudeGraph->GetName(), *Error);
+		}
+	}
+}
+
 void ATerrain::InitLoopData()
 {
 	FlowControlUtility::InitLoopData(CreateVerticesLoopData);
-	FlowControlUtility::InitLoopData(CreateTrianglesLoopData);
-	FlowControlUtility::InitLoopData(CalNormalsInitLoopData);
-	FlowControlUtility::InitLoopData(CalNormalsAccLoopData);
-	FlowControlUtility::InitLoopData(NormalizeNormalsLoopData);
+	FlowControlUtility::InitLoopData(CalNormalsLoopData);
 }
 
 void ATerrain::InitHexGrid()
 {
-	FTimerHandle TimerHandle;
-	TArray<AActor*> OutActors;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), AHexGrid::StaticClass(), OutActors);
-	if (OutActors.Num() == 1) {
-		HexGrid = (AHexGrid*)OutActors[0];
-	}
-	else {
-		WorkflowState = Enum_TerrainWorkflowState::Error;
-		GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
-		UE_LOG(Terrain, Warning, TEXT("More than one HexGrid!"));
-		return;
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->WhenHexGridRegistered(this, [this](AHexGrid* InHexGrid) {
+			HexGrid = InHexGrid;
+		});
 	}
 }
 
@@ -366,6 +368,11 @@ void ATerrain::InitTerrainFormBaseRatio()
 void ATerrain::InitWater()
 {
 	SetWaterZ();
+	InitWaterBase();
+}
+
+void ATerrain::InitWaterBase()
+{
 	WaterBase = WaterBaseRatio * TileAltitudeMultiplier - WaterMesh->GetComponentLocation().Z;
 }
 
@@ -389,37 +396,106 @@ void ATerrain::InitWorkflow()
 	InitTerrainFormBaseRatio();
 	InitWater();
 	InitTreeParam();
+	InitNoiseParams();
+	InitProgress();
 
-	FTimerHandle TimerHandle;
+	//The only stage that sets the state itself, it runs on the game thread before any other and the registry reads it
 	if (CheckMaterialSetting()) {
 		WorkflowState = Enum_TerrainWorkflowState::CreateVerticesAndUVs;
 		UE_LOG(Terrain, Log, TEXT("Init workflow done!"));
 	}
 	else {
 		WorkflowState = Enum_TerrainWorkflowState::Error;
+		bWorkflowFailed = true;
 		UE_LOG(Terrain, Log, TEXT("CheckMaterialSetting() error!"));
 	}
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, DefaultTimerRate, false);
+	NotifyStageDone();
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+}
+
+void ATerrain::InitHeadless()
+{
+	Profiler.Init(GetName(), StaticEnum<Enum_TerrainWorkflowState>());
+	Profiler.Run((int32)Enum_TerrainWorkflowState::InitWorkflow, [this]() {
+		CreateNoise();
+		InitTileParameter();
+		InitLoopData();
+		InitWaterBase();
+		InitTreeParam();
+		InitNoiseParams();
+	});
+	WorkflowState = Enum_TerrainWorkflowState::CreateVerticesAndUVs;
+}
+
+void ATerrain::BuildHeadless()
+{
+	using EState = Enum_TerrainWorkflowState;
+	FlowControlUtility::FUnslicedScope UnslicedScope(WorkflowDelegate);
+	Profiler.Run((int32)EState::CreateVerticesAndUVs, [this]() { CreateVertices(); });
+	Profiler.Run((int32)EState::CalNormals, [this]() { CalNormals(); });
+}
+
+void ATerrain::GetHeightfield(TArray<float>& Out_Heights, int32& Out_Rows, int32& Out_Columns) const
+{
+	Out_Rows = Heightfield.GetRows();
+	Out_Columns = Heightfield.GetColumns();
+	Out_Heights = Heightfield.GetHeights();
+}
+
+void ATerrain::StartWorkflowGraph()
+{
+	auto Stage = [this](TFunction<void()> Work) {
+		return [this, Work]() {
+			if (!bWorkflowFailed) {
+				Work();
+			}
+		};
+	};
+	//Graph stages overlap, so each call is timed under its own state rather than the current one
+	using EState = Enum_TerrainWorkflowState;
+	auto Profiled = [this](EState State, void (ATerrain::*Function)()) {
+		Profiler.Run((int32)State, [this, Function]() { (this->*Function)(); });
+	};
+
+	bWorkflowFailed = false;
+	GraphWorkflowState = Enum_TerrainWorkflowState::InitWorkflow;
+	Graph.Reset();
+	int32 Init = Graph.AddStage(TEXT("TerrainInit"), {}, [Profiled]() {
+		Profiled(EState::InitWorkflow, &ATerrain::InitWorkflow);
+	}, true);
+	int32 Vertices = Graph.AddStage(TEXT("TerrainVertices"), { Init }, Stage([Profiled]() {
+		Profiled(EState::CreateVerticesAndUVs, &ATerrain::CreateVertices);
+	}));
+	Graph.AddStage(TEXT("TerrainNormals"), { Vertices }, Stage([Profiled]() {
+		Profiled(EState::CalNormals, &ATerrain::CalNormals);
+	}));
+
+	//Mesh sections and water need the game thread, the timer workflow takes over
+	Graph.Launch(WorkflowDelegate, [this]() {
+		WorkflowState = bWorkflowFailed ? Enum_TerrainWorkflowState::Error : Enum_TerrainWorkflowState::DrawLandMesh;
+		FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, DefaultTimerRate);
+	});
+	UE_LOG(Terrain, Log, TEXT("Start workflow graph!"));
 }
 
 //bind to delegate
 void ATerrain::CreateTerrainFlow()
 {
+	WorkflowProfiler::FSliceScope Slice(Profiler, (int32)WorkflowState);
 	switch (WorkflowState)
 	{
 	case Enum_TerrainWorkflowState::InitWorkflow:
+		if (bRunWorkflowAsGraph) {
+			StartWorkflowGraph();
+			break;
+		}
 		InitWorkflow();
 		break;
 	case Enum_TerrainWorkflowState::CreateVerticesAndUVs:
 		CreateVertices();
 		break;
-	case Enum_TerrainWorkflowState::CreateTriangles:
-		CreateTriangles();
-		break;
-	case Enum_TerrainWorkflowState::CalNormalsInit:
-	case Enum_TerrainWorkflowState::CalNormalsAcc:
-	case Enum_TerrainWorkflowState::NormalizeNormals:
-		CreateNormals();
+	case Enum_TerrainWorkflowState::CalNormals:
+		CalNormals();
 		break;
 	case Enum_TerrainWorkflowState::DrawLandMesh:
 		CreateTerrainMesh();
@@ -429,9 +505,13 @@ void ATerrain::CreateTerrainFlow()
 		CreateWater();
 		WorkflowState = Enum_TerrainWorkflowState::Done;
 	case Enum_TerrainWorkflowState::Done:
+		NotifyStageDone();
+		Profiler.Finish();
 		UE_LOG(Terrain, Log, TEXT("Create terrain done."));
 		break;
 	case Enum_TerrainWorkflowState::Error:
+		NotifyStageDone();
+		Profiler.Finish();
 		UE_LOG(Terrain, Warning, TEXT("CreateTerrainFlow Error!"));
 		break;
 	default:
@@ -439,20 +519,64 @@ void ATerrain::CreateTerrainFlow()
 	}
 }
 
+void ATerrain::NotifyStageDone()
+{
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->NotifyTerrainStageDone(this, WorkflowState);
+	}
+}
+
+void ATerrain::SetWorkflowState(Enum_TerrainWorkflowState State)
+{
+	if (!FlowControlUtility::IsUnsliced(WorkflowDelegate)) {
+		WorkflowState = State;
+		return;
+	}
+	//Graph stages run on worker threads, the furthest state they reached is set on the game thread
+	Enum_TerrainWorkflowState Furthest = GraphWorkflowState;
+	while (Furthest < State && !GraphWorkflowState.compare_exchange_weak(Furthest, State))
+	{
+	}
+	AsyncTask(ENamedThreads::GameThread, [WeakThis = TWeakObjectPtr<ATerrain>(this)]() {
+		if (ATerrain* This = WeakThis.Get()) {
+			This->PublishGraphWorkflowState();
+		}
+	});
+}
+
+void ATerrain::PublishGraphWorkflowState()
+{
+	//Dropped once the graph is done or cancelled, the completion has set the state then
+	Enum_TerrainWorkflowState State = GraphWorkflowState;
+	if (Graph.IsRunning() && !bWorkflowFailed && State > WorkflowState) {
+		WorkflowState = State;
+		NotifyStageDone();
+	}
+}
+
 void ATerrain::ResetProgress()
 {
 	ProgressTarget = 0;
 	ProgressCurrent = 0;
 }
 
+void ATerrain::InitProgress()
+{
+	//Items of every stage up front, stages only add what they finished, so the progress never goes back
+	int32 VertexNum = (NumRows + 1) * (NumColumns + 1);
+	ProgressTarget = VertexNum * 2;
+	ProgressCurrent = 0;
+}
+
 void ATerrain::GetProgress(float& Out_Progress)
 {
 	float Rate;
-	if (ProgressTarget == 0.0) {
+	int32 Target = ProgressTarget;
+	if (Target == 0) {
 		Out_Progress = 0.0;
 	}
 	else {
-		Rate = float(ProgressCurrent) / float(ProgressTarget);
+		Rate = float(ProgressCurrent) / float(Target);
 		Rate = Rate > 1.0 ? 1.0 : Rate;
 		Out_Progress = Rate;
 	}
@@ -460,396 +584,465 @@ void ATerrain::GetProgress(float& Out_Progress)
 
 void ATerrain::CreateVertices()
 {
-	int32 HalfRow = NumRows * 0.5;
-	int32 HalfColumn = NumColumns * 0.5;
-
-	bool OnceLoopCol = true;
-	int32 Count = 0;
-	TArray<int32> Indices = {0, 0};
-	bool SaveLoopFlag = false;
-
-	float RatioStd;
-	float Ratio;
+	int32 ColumnVertexNum = NumColumns + 1;
 
-	if (!CreateVerticesLoopData.HasInitialized) {
-		CreateVerticesLoopData.HasInitialized = true;
-		ProgressTarget = (NumRows + 1) * (NumColumns + 1);
+	//Sized once, rows are written in place from worker threads
+	if (CreateVerticesLoopData.Count == 0) {
+		int32 VertexNum = (NumRows + 1) * ColumnVertexNum;
+		Vertices.SetNumUninitialized(VertexNum);
+		UVs.SetNumUninitialized(VertexNum);
+		VertexColors.SetNumUninitialized(VertexNum);
+		TreeValues.SetNumUninitialized(VertexNum);
+		InitHeightfield();
 	}
 
-	int32 i = CreateVerticesLoopData.IndexSaved[0];
-	int32 j;
-	for ( ; i <= NumRows; i++) {
-		Indices[0] = i;
-		float X = i - HalfRow;
-		j = OnceLoopCol ? CreateVerticesLoopData.IndexSaved[1] : 0;
-		for (; j <= NumColumns; j++) {
-			Indices[1] = j;
-			float Y = j - HalfColumn;
-			FlowControlUtility::SaveLoopData(this, CreateVerticesLoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-			if (SaveLoopFlag) {
-				return;
-			}
-			
-			CreateVertex(X, Y, RatioStd, Ratio);
-			CreateUV(X, Y);
-			CreateVertexColorsForAMTA(RatioStd, X, Y);
-			AddTreeValues(X, Y);
-
-			ProgressCurrent = CreateVerticesLoopData.Count;
-			Count++;
-		}
-		OnceLoopCol = false;
+	bool LoopDone = FlowControlUtility::RunChunks(this, CreateVerticesLoopData, NumRows + 1, WorkflowDelegate,
+		[this, ColumnVertexNum](int32 RowBegin, int32 RowEnd) {
+			CreateVertexRows(RowBegin, RowEnd, 0);
+			ProgressCurrent += (RowEnd - RowBegin) * ColumnVertexNum;
+		});
+	if (!LoopDone) {
+		return;
+	}
+	if (!HeightfieldReadyEvent.IsCompleted()) {
+		HeightfieldReadyEvent.Trigger();
 	}
-	ResetProgress();
 
-	WorkflowState = Enum_TerrainWorkflowState::CreateTriangles;
-	FTimerHandle TimerHandle;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, CreateVerticesLoopData.Rate, false);
+	SetWorkflowState(Enum_TerrainWorkflowState::CalNormals);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, CreateVerticesLoopData.Rate);
 	UE_LOG(Terrain, Log, TEXT("Create vertices and UVs done."));
 }
 
-float ATerrain::GetAltitude(float X, float Y, float& OutRatioStd, float& OutRatio)
+void ATerrain::CreateVerticesInBands(int32 BandNum)
 {
-	OutRatio = GetHighMountainRatio(X, Y) + GetLowMountianRatio(X, Y);
-	if (HasWater) {
-		float wRatio = GetWaterRatio(X, Y);
-		float alpha = 1 - wRatio / WaterBaseRatio;
-		alpha = FMath::Clamp<float>(alpha, 0.0, 1.0);
-		OutRatio = wRatio + FMath::Lerp<float>(wRatio, OutRatio, alpha);
-	}
-	OutRatioStd = OutRatio * 0.5 + 0.5;
-	float z = OutRatio * TileAltitudeMultiplier;
-	return z;
+	int32 VertexNum = (NumRows + 1) * (NumColumns + 1);
+	Vertices.SetNumUninitialized(VertexNum);
+	UVs.SetNumUninitialized(VertexNum);
+	VertexColors.SetNumUninitialized(VertexNum);
+	TreeValues.SetNumUninitialized(VertexNum);
+	InitHeightfield();
+	CreateVertexRows(0, NumRows + 1, FMath::Max(BandNum, 1));
 }
 
-float ATerrain::MappingFromRangeToRange(float InputValue, const FStructHeightMapping& Mapping)
+void ATerrain::InitHeightfield()
 {
-	float alpha = (Mapping.RangeMax - FMath::Clamp<float>(InputValue, Mapping.RangeMin, Mapping.RangeMax)) / (Mapping.RangeMax - Mapping.RangeMin);
-	return FMath::Lerp<float>(Mapping.MappingMax, Mapping.MappingMin, alpha);
+	int32 HalfRow = NumRows * 0.5;
+	int32 HalfColumn = NumColumns * 0.5;
+	FVector2D Origin(-HalfRow * TileSizeMultiplier, -HalfColumn * TileSizeMultiplier);
+	Heightfield.Init(NumRows + 1, NumColumns + 1, Origin, TileSizeMultiplier);
 }
 
-float ATerrain::GetHeightRatio(UFastNoiseWrapper* NWP, const FStructHeightMapping& Mapping, float X, float Y)
+void ATerrain::CreateVertexRows(int32 RowBegin, int32 RowEnd, int32 BandNum)
 {
-	float value = 0.0;
-	if (NWP != nullptr) {
-		value = NWP->GetNoise2D(X * TileNumRowRatio, Y * TileNumColumnRatio);
-		return MappingFromRangeToRange(value, Mapping);
+	int32 RowNum = RowEnd - RowBegin;
+	if (RowNum <= 0) {
+		return;
 	}
-	return 0.0f;
-}
-
-void ATerrain::MappingByLevel(float level, const FStructHeightMapping& InMapping, 
-	FStructHeightMapping& OutMapping)
-{
-	OutMapping.RangeMin = InMapping.RangeMin + InMapping.RangeMinOffset * level;
-	OutMapping.RangeMax = InMapping.RangeMax + InMapping.RangeMaxOffset * level;
-	OutMapping.MappingMin = InMapping.MappingMin;
-	OutMapping.MappingMax = InMapping.MappingMax;
-	OutMapping.RangeMinOffset = InMapping.RangeMinOffset;
-	OutMapping.RangeMaxOffset = InMapping.RangeMaxOffset;
-}
-
-float ATerrain::GetHighMountainRatio(float X, float Y)
-{
-	FStructHeightMapping mapping;
-	MappingByLevel(HighMountainLevel, HighRangeMapping, mapping);
-	return GetHeightRatio(NWHighMountain, mapping, X, Y);
-}
-
-float ATerrain::GetLowMountianRatio(float X, float Y)
-{
-	FStructHeightMapping mapping;
-	MappingByLevel(LowMountainLevel, LowRangeMapping, mapping);
-	return GetHeightRatio(NWLowMountain, mapping, X, Y);
+	BandNum = BandNum > 0 ? FMath::Min(BandNum, RowNum) : RowNum;
+	ParallelFor(BandNum, [this, RowBegin, RowNum, BandNum](int32 Band) {
+		int32 BandBegin = RowBegin + (int64)RowNum * Band / BandNum;
+		int32 BandEnd = RowBegin + (int64)RowNum * (Band + 1) / BandNum;
+		for (int32 Row = BandBegin; Row < BandEnd; Row++)
+		{
+			CreateVertexRow(Row);
+		}
+	}, BandNum == 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
 }
 
-float ATerrain::GetWaterRatio(float X, float Y)
+//Vertex color R:Altidude G:Moisture B:Temperature A:Biomes
+void ATerrain::CreateVertexRow(int32 Row)
 {
-	FStructHeightMapping mapping;
-	FStructHeightMapping groundMapping;
-	MappingByLevel(WaterLevel, WaterRangeMapping, mapping);
-	MappingByLevel(WaterLevel, WaterGroundRangeMapping, groundMapping);
-	float ratio = GetHeightRatio(NWWater, mapping, X, Y) + GetHeightRatio(NWWater, groundMapping, X, Y);
-	ratio = ratio > 0.0 ? 0.0 : ratio;
-
-	//cal water bank
-	ratio = FMath::Abs<float>(ratio);
-	float alpha = ratio * WaterBankSharpness;
-	alpha = FMath::Clamp<float>(alpha, 0.0, 1.0);
-	float exp = FMath::Lerp<float>(3.0, 1.0, alpha);
-	ratio = -FMath::Pow(ratio, exp);
-
-	return ratio;
-}
+	const int32 BatchSize = TerrainNoise::BatchSize;
+	int32 HalfRow = NumRows * 0.5;
+	int32 HalfColumn = NumColumns * 0.5;
+	int32 ColumnVertexNum = NumColumns + 1;
+	float X[BatchSize];
+	float Y[BatchSize];
+	float RatioStd[BatchSize];
+	for (int32 i = 0; i < BatchSize; i++)
+	{
+		X[i] = Row - HalfRow;
+	}
 
-float ATerrain::GetNoise2DStd(UFastNoiseWrapper* NWP, float X, float Y, float scale)
-{
-	float value = 0.0;
-	if (NWP != nullptr) {
-		value = NWP->GetNoise2D(X * TileNumRowRatio, Y * TileNumColumnRatio);
-		value = FMath::Clamp<float>(value * scale, -1.0, 1.0);
-		value = (value + 1) * 0.5;
+	//Columns in noise batches, heights, colors and tree values go straight to their buffers
+	for (int32 Begin = 0; Begin < ColumnVertexNum; Begin += BatchSize)
+	{
+		int32 Count = FMath::Min(BatchSize, ColumnVertexNum - Begin);
+		int32 Index = Row * ColumnVertexNum + Begin;
+		float* Z = Heightfield.GetRow(Row) + Begin;
+		for (int32 i = 0; i < Count; i++)
+		{
+			Y[i] = Begin + i - HalfColumn;
+		}
+		Noise.GetAltitudeBatch(X, Y, Count, Z, RatioStd);
+		Noise.GetVertexColorBatch(RatioStd, X, Y, Count, VertexColors.GetData() + Index);
+		Noise.GetTreeValueBatch(X, Y, Count, TreeValues.GetData() + Index);
+		for (int32 i = 0; i < Count; i++)
+		{
+			Vertices[Index + i] = FVector(X[i] * TileSizeMultiplier, Y[i] * TileSizeMultiplier, Z[i]);
+			UVs[Index + i] = FVector2D(X[i] * UVScale, Y[i] * UVScale);
+		}
 	}
-	return value;
 }
 
 float ATerrain::GetAltitudeByPos2D(const FVector2D Pos2D, AActor* Caller)
 {
+	if (IsHeightfieldReady()) {
+		return Heightfield.GetHeight(Pos2D);
+	}
 	float X = Pos2D.X / TileSizeMultiplier;
 	float Y = Pos2D.Y / TileSizeMultiplier;
 	float Out_RatioStd;
 	float Out_Ratio;
-	float Z = GetAltitude(X, Y, Out_RatioStd, Out_Ratio);
+	float Z = Noise.GetAltitude(X, Y, Out_RatioStd, Out_Ratio);
 	return Z;
 }
 
-void ATerrain::CreateVertex(float X, float Y, float& OutRatioStd, float& OutRatio)
+void ATerrain::GetAltitudesByPos2D(const FVector2D* Positions, int32 Num, float* Out_Z, FVector* Out_Normals) const
 {
-	float VX = X * TileSizeMultiplier;
-	float VY = Y * TileSizeMultiplier;
-	float VZ = GetAltitude(X, Y, OutRatioStd, OutRatio);
-	Vertices.Add(FVector(VX, VY, VZ));
+	check(IsHeightfieldReady());
+	Heightfield.GetBatch(Positions, Num, Out_Z, Out_Normals);
 }
 
-void ATerrain::CreateUV(float X, float Y)
+bool ATerrain::GetGroundByPos2D(const FVector2D& Pos2D, float& Out_Z, FVector& Out_Normal)
 {
-	float UVx = X * UVScale;
-	float UVy = Y * UVScale;
-	UVs.Add(FVector2D(UVx, UVy));
-}
-
-//Create vertex Color(R:Altidude G:Moisture B:Temperature A:Biomes)
-void ATerrain::CreateVertexColorsForAMTA(float RatioStd, float X, float Y)
-{
-	float Moisture = GetNoise2DStd(NWMoisture, X, Y, 3.0);
-	float Temperature = GetNoise2DStd(NWTemperature, X, Y, 3.0);
-	float Biomes = GetNoise2DStd(NWBiomes, X, Y, 3.0);
-	VertexColors.Add(FLinearColor(RatioStd, Moisture, Temperature, Biomes));
+	if (!IsHeightfieldReady()) {
+		return false;
+	}
+	Heightfield.GetBatch(&Pos2D, 1, &Out_Z, &Out_Normal);
+	return true;
 }
 
-void ATerrain::AddTreeValues(float X, float Y)
+bool ATerrain::CheckNoiseBatchParity(float Tolerance)
 {
-	float value = NWTree->GetNoise2D(X, Y);
-	value = (value - OneMinTAS) / TreeAreaScaleA;
-	value = FMath::Clamp<float>(value, 0.0, 1.0);
-	TreeValues.Add(value);
+	float MaxError;
+	bool Pass = Noise.CheckBatchParity(Tolerance, MaxError);
+	if (Pass) {
+		UE_LOG(Terrain, Log, TEXT("Noise batch parity passed, max error %g."), MaxError);
+	}
+	else {
+		UE_LOG(Terrain, Error, TEXT("Noise batch parity failed, max error %g, tolerance %g."), MaxError, Tolerance);
+	}
+	return Pass;
 }
 
-void ATerrain::CreateTriangles()
+bool ATerrain::CheckDefaultGraphParity(float Tolerance, double& Out_RecipeMs, double& Out_GraphMs)
 {
-	int32 ColumnVertexNum = NumColumns + 1;
-	int32 RowMOne = NumRows - 1;
-	int32 ColumnMOne = NumColumns - 1;
-
-	int32 RowVertex;
-	int32 RowPlusOneVertex;
-
-	bool OnceLoopCol = true;
-	int32 Count = 0;
-	TArray<int32> Indices = { 0, 0 };
-	bool SaveLoopFlag = false;
-
-	if (!CreateTrianglesLoopData.HasInitialized) {
-		CreateTrianglesLoopData.HasInitialized = true;
-		ProgressTarget = NumRows * NumColumns;
+	Out_RecipeMs = 0.0;
+	Out_GraphMs = 0.0;
+	if (!HasWater) {
+		UE_LOG(Terrain, Error, TEXT("Default graph parity needs HasWater, the default graph is the recipe with water."));
+		return false;
+	}
+	UTerrainNoiseGraph* DefaultGraph = NewObject<UTerrainNoiseGraph>(GetTransientPackage());
+	DefaultGraph->ResetToDefaultRecipe();
+	TerrainNoiseProgram Program;
+	FString Error;
+	if (!Program.Compile(*DefaultGraph, AltitudeGraph_NoiseSeed, TileNumRowRatio, TileNumColumnRatio, Error)) {
+		UE_LOG(Terrain, Error, TEXT("Default graph can not be compiled. %s"), *Error);
+		return false;
 	}
 
-	int32 i = CreateTrianglesLoopData.IndexSaved[0];
-	int32 j;
+	float MaxError;
+	bool Pass = Noise.CheckProgramParity(Program, Tolerance, MaxError);
+	if (Pass) {
+		UE_LOG(Terrain, Log, TEXT("Default graph parity passed, max error %g."), MaxError);
+	}
+	else {
+		UE_LOG(Terrain, Error, TEXT("Default graph parity failed, max error %g, tolerance %g."), MaxError, Tolerance);
+		return false;
+	}
 
-	for ( ; i <= RowMOne; i++) {
-		Indices[0] = i;
-		RowVertex = i * ColumnVertexNum;
-		RowPlusOneVertex = (i + 1) * ColumnVertexNum;
-		j = OnceLoopCol ? CreateTrianglesLoopData.IndexSaved[1] : 0;
-		for (; j <= ColumnMOne; j++) {
-			Indices[1] = j;
-			FlowControlUtility::SaveLoopData(this, CreateTrianglesLoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-			if (SaveLoopFlag) {
-				return;
+	//The vertex positions of CreateVertexRow, ratios only, nothing is written to the terrain
+	auto TimeRows = [this](TFunctionRef<void(const float*, const float*, int32, float*)> Evaluate) {
+		const int32 BatchSize = TerrainNoise::BatchSize;
+		int32 HalfRow = NumRows * 0.5;
+		int32 HalfColumn = NumColumns * 0.5;
+		int32 ColumnVertexNum = NumColumns + 1;
+		double StartTime = FPlatformTime::Seconds();
+		ParallelFor(NumRows + 1, [&](int32 Row) {
+			float X[BatchSize];
+			float Y[BatchSize];
+			float Ratios[BatchSize];
+			for (int32 i = 0; i < BatchSize; i++)
+			{
+				X[i] = Row - HalfRow;
 			}
-			CreatePairTriangles(j, RowVertex, RowPlusOneVertex);
-			ProgressCurrent = CreateTrianglesLoopData.Count;
-			Count++;
-		}
-		OnceLoopCol = false;
+			for (int32 Begin = 0; Begin < ColumnVertexNum; Begin += BatchSize)
+			{
+				int32 Count = FMath::Min(BatchSize, ColumnVertexNum - Begin);
+				for (int32 i = 0; i < Count; i++)
+				{
+					Y[i] = Begin + i - HalfColumn;
+				}
+				Evaluate(X, Y, Count, Ratios);
+			}
+		});
+		return (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	};
+	Out_RecipeMs = TimeRows([this](const float* X, const float* Y, int32 Num, float* Out_Ratios) {
+		Noise.GetRecipeRatioBatch(X, Y, Num, Out_Ratios);
+	});
+	Out_GraphMs = TimeRows([&Program](const float* X, const float* Y, int32 Num, float* Out_Ratios) {
+		Program.Evaluate(X, Y, Num, Out_Ratios);
+	});
+	return true;
+}
+
+void ATerrain::HashAltitudeParams(FXxHash64Builder& Builder)
+{
+	auto HashNoise = [&Builder](EFastNoise_NoiseType NoiseType, int32 Seed, float Frequency, EFastNoise_Interp Interp,
+		EFastNoise_FractalType FractalType, int32 Octaves, float Lacunarity, float Gain, float CellularJitter,
+		EFastNoise_CellularDistanceFunction CDF, EFastNoise_CellularReturnType CRT) {
+		HexGridBakedCache::HashValue(Builder, NoiseType);
+		HexGridBakedCache::HashValue(Builder, Seed);
+		HexGridBakedCache::HashValue(Builder, Frequency);
+		HexGridBakedCache::HashValue(Builder, Interp);
+		HexGridBakedCache::HashValue(Builder, FractalType);
+		HexGridBakedCache::HashValue(Builder, Octaves);
+		HexGridBakedCache::HashValue(Builder, Lacunarity);
+		HexGridBakedCache::HashValue(Builder, Gain);
+		HexGridBakedCache::HashValue(Builder, CellularJitter);
+		HexGridBakedCache::HashValue(Builder, CDF);
+		HexGridBakedCache::HashValue(Builder, CRT);
+	};
+	auto HashMapping = [&Builder](const FStructHeightMapping& Mapping) {
+		HexGridBakedCache::HashValue(Builder, Mapping.RangeMin);
+		HexGridBakedCache::HashValue(Builder, Mapping.RangeMax);
+		HexGridBakedCache::HashValue(Builder, Mapping.MappingMin);
+		HexGridBakedCache::HashValue(Builder, Mapping.MappingMax);
+		HexGridBakedCache::HashValue(Builder, Mapping.RangeMinOffset);
+		HexGridBakedCache::HashValue(Builder, Mapping.RangeMaxOffset);
+	};
+
+	HashNoise(NWHighMountain_NoiseType, NWHighMountain_NoiseSeed, NWHighMountain_NoiseFrequency, NWHighMountain_Interp,
+		NWHighMountain_FractalType, NWHighMountain_Octaves, NWHighMountain_Lacunarity, NWHighMountain_Gain,
+		NWHighMountain_CellularJitter, NWHighMountain_CDF, NWHighMountain_CRT);
+	HashNoise(NWLowMountain_NoiseType, NWLowMountain_NoiseSeed, NWLowMountain_NoiseFrequency, NWLowMountain_Interp,
+		NWLowMountain_FractalType, NWLowMountain_Octaves, NWLowMountain_Lacunarity, NWLowMountain_Gain,
+		NWLowMountain_CellularJitter, NWLowMountain_CDF, NWLowMountain_CRT);
+	HashNoise(NWWater_NoiseType, NWWater_NoiseSeed, NWWater_NoiseFrequency, NWWater_Interp,
+		NWWater_FractalType, NWWater_Octaves, NWWater_Lacunarity, NWWater_Gain,
+		NWWater_CellularJitter, NWWater_CDF, NWWater_CRT);
+
+	HexGridBakedCache::HashValue(Builder, TileSizeMultiplier);
+	HexGridBakedCache::HashValue(Builder, TileAltitudeMultiplier);
+	HexGridBakedCache::HashValue(Builder, TileNumRowRatio);
+	HexGridBakedCache::HashValue(Builder, TileNumColumnRatio);
+	HexGridBakedCache::HashValue(Builder, TerrainWidth);
+	HexGridBakedCache::HashValue(Builder, TerrainHeight);
+
+	HexGridBakedCache::HashValue(Builder, HighMountainLevel);
+	HashMapping(HighRangeMapping);
+	HexGridBakedCache::HashValue(Builder, LowMountainLevel);
+	HashMapping(LowRangeMapping);
+
+	HexGridBakedCache::HashValue(Builder, HasWater);
+	HexGridBakedCache::HashValue(Builder, WaterLevel);
+	HashMapping(WaterRangeMapping);
+	HashMapping(WaterGroundRangeMapping);
+	HexGridBakedCache::HashValue(Builder, WaterBankSharpness);
+	HexGridBakedCache::HashValue(Builder, WaterBaseRatio);
+	HexGridBakedCache::HashValue(Builder, WaterBase);
+
+	const TerrainNoiseProgram& AltitudeProgram = Noise.GetAltitudeProgram();
+	HexGridBakedCache::HashValue(Builder, AltitudeProgram.IsValid());
+	if (AltitudeProgram.IsValid()) {
+		AltitudeProgram.Hash(Builder);
 	}
-	ResetProgress();
-
-	WorkflowState = Enum_TerrainWorkflowState::CalNormalsInit;
-	FTimerHandle TimerHandle;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, CreateTrianglesLoopData.Rate, false);
-	UE_LOG(Terrain, Log, TEXT("Create triangles done."));
 }
 
-void ATerrain::CreatePairTriangles(int32 ColumnIndex, int32 RowVertex, int32 RowPlusOneVertex)
+void ATerrain::CalNormals()
 {
-	TArray<int32> VIndices = { 0, 0, 0, 0, 0, 0 };
-	int32 VI0 = ColumnIndex + RowVertex;
-	VIndices[0] = VI0;
-	VIndices[3] = VI0;
-	int32 VI1 = ColumnIndex + RowPlusOneVertex;
-	VIndices[2] = VI1;
-	int32 VI2 = (ColumnIndex + 1) + RowVertex;
-	VIndices[4] = VI2;
-	int32 VI3 = (ColumnIndex + 1) + RowPlusOneVertex;
-	VIndices[1] = VI3;
-	VIndices[5] = VI3;
+	int32 ColumnVertexNum = NumColumns + 1;
 
-	Triangles.Append(VIndices);
+	//Sized once, rows are written in place from worker threads
+	if (CalNormalsLoopData.Count == 0) {
+		Normals.SetNumUninitialized((NumRows + 1) * ColumnVertexNum);
+	}
 
+	bool LoopDone = FlowControlUtility::RunChunks(this, CalNormalsLoopData, NumRows + 1, WorkflowDelegate,
+		[this, ColumnVertexNum](int32 RowBegin, int32 RowEnd) {
+			CalNormalRows(RowBegin, RowEnd);
+			ProgressCurrent += (RowEnd - RowBegin) * ColumnVertexNum;
+		});
+	if (!LoopDone) {
+		return;
+	}
+
+	SetWorkflowState(Enum_TerrainWorkflowState::DrawLandMesh);
+	FlowControlUtility::ScheduleNextStage(this, WorkflowDelegate, CalNormalsLoopData.Rate);
+	UE_LOG(Terrain, Log, TEXT("Calculate normals done."));
 }
 
-void ATerrain::CreateNormals()
+void ATerrain::CalNormalRows(int32 RowBegin, int32 RowEnd)
 {
-	CalNormalsWorkflow();
+	//Each row reads the heights of its neighbor rows and writes only its own normals
+	int32 ColumnVertexNum = NumColumns + 1;
+	ParallelFor(RowEnd - RowBegin, [this, RowBegin, ColumnVertexNum](int32 i) {
+		int32 Row = RowBegin + i;
+		Heightfield.GetVertexNormals(Row, Normals.GetData() + Row * ColumnVertexNum);
+	});
 }
 
-void ATerrain::CalNormalsWorkflow()
+bool ATerrain::CheckNormalsParity(float Tolerance)
 {
-	switch (WorkflowState)
+	//The scatter over the triangles the gather replaced, with the cell split of the mesh chunks
+	int32 ColumnVertexNum = NumColumns + 1;
+	TArray<FVector> Reference;
+	Reference.Init(FVector::ZeroVector, Vertices.Num());
+	auto AddFace = [this, &Reference](int32 Index1, int32 Index2, int32 Index3) {
+		FVector Normal = FVector::CrossProduct(Vertices[Index1] - Vertices[Index2], Vertices[Index3] - Vertices[Index2]);
+		Reference[Index1] += Normal;
+		Reference[Index2] += Normal;
+		Reference[Index3] += Normal;
+	};
+	if (Vertices.Num() == (NumRows + 1) * ColumnVertexNum) {
+		for (int32 Row = 0; Row < NumRows; Row++)
+		{
+			for (int32 Column = 0; Column < NumColumns; Column++)
+			{
+				int32 VI0 = Column + Row * ColumnVertexNum;
+				int32 VI1 = VI0 + ColumnVertexNum;
+				int32 VI2 = VI0 + 1;
+				int32 VI3 = VI1 + 1;
+				AddFace(VI0, VI3, VI1);
+				AddFace(VI0, VI2, VI3);
+			}
+		}
+	}
+
+	double MaxError = Normals.Num() == Reference.Num() ? 0.0 : MAX_dbl;
+	for (int32 i = 0; i < Normals.Num() && i < Reference.Num(); i++)
 	{
-	case Enum_TerrainWorkflowState::CalNormalsInit:
-		CalNormalsInit();
-		break;
-	case Enum_TerrainWorkflowState::CalNormalsAcc:
-		CalNormalsAcc();
-		break;
-	case Enum_TerrainWorkflowState::NormalizeNormals:
-		NormalizeNormals();
-		break;
-	default:
-		break;
+		Reference[i].Normalize();
+		MaxError = FMath::Max(MaxError, (Normals[i] - Reference[i]).GetAbsMax());
+	}
+	bool Pass = MaxError <= Tolerance;
+	if (Pass) {
+		UE_LOG(Terrain, Log, TEXT("Normals parity passed, max error %g."), MaxError);
 	}
+	else {
+		UE_LOG(Terrain, Error, TEXT("Normals parity failed, max error %g, tolerance %g."), MaxError, Tolerance);
+	}
+	return Pass;
 }
 
-void ATerrain::CalNormalsInit()
+void ATerrain::CreateTerrainMesh()
 {
-	int32 Count = 0;
-	TArray<int32> Indices = { 0 };
-	bool SaveLoopFlag = false;
-
-	if (!CalNormalsInitLoopData.HasInitialized) {
-		CalNormalsInitLoopData.HasInitialized = true;
-		ProgressTarget = Vertices.Num();
-	}
-
-	int32 i = CalNormalsInitLoopData.IndexSaved[0];
-	for ( ; i <= Vertices.Num() - 1; i++) {
-		Indices[0] = i;
-		FlowControlUtility::SaveLoopData(this, CalNormalsInitLoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-		if (SaveLoopFlag) {
-			return;
-		}
-		NormalsAcc.Add(FVector(0, 0, 0));
-		ProgressCurrent = CalNormalsInitLoopData.Count;
-		Count++;
+	//Chunk buffers in parallel, the sections on the game thread
+	MeshChunks.Init(NumRows, NumColumns, MeshChunkSize);
+	MeshChunks.BuildAll(Vertices, Normals, UVs, VertexColors);
+	InitChunkMeshes(MeshChunks.Num());
+	for (int32 i = 0; i < MeshChunks.Num(); i++)
+	{
+		const TerrainMeshChunks::FChunk& Chunk = MeshChunks.GetChunk(i);
+		ChunkMeshes[i]->CreateMeshSection_LinearColor(0, Chunk.Vertices, Chunk.Triangles, Chunk.Normals, Chunk.UVs,
+			Chunk.VertexColors, TArray<FProcMeshTangent>(), true);
 	}
-	ResetProgress();
+	MeshChunks.ReleaseBuffers();
 
-	WorkflowState = Enum_TerrainWorkflowState::CalNormalsAcc;
-	FTimerHandle TimerHandle;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, CalNormalsInitLoopData.Rate, false);
-	UE_LOG(Terrain, Log, TEXT("Calculate normals initialization done."));
+	UE_LOG(Terrain, Log, TEXT("Create terrain mesh done, %d chunks."), MeshChunks.Num());
 }
 
-void ATerrain::CalNormalsAcc()
+void ATerrain::InitChunkMeshes(int32 Num)
 {
-	int32 Count = 0;
-	TArray<int32> Indices = { 0 };
-	bool SaveLoopFlag = false;
-
-	if (!CalNormalsAccLoopData.HasInitialized) {
-		CalNormalsAccLoopData.HasInitialized = true;
-		ProgressTarget = Triangles.Num() / 3;
+	//Kept across regenerations, sections are replaced
+	while (ChunkMeshes.Num() > Num)
+	{
+		ChunkMeshes.Pop()->DestroyComponent();
 	}
-
-	int32 i = CalNormalsAccLoopData.IndexSaved[0];
-	int32 last = Triangles.Num() / 3 - 1;
-	for ( ; i <= last; i++) {
-		Indices[0] = i;
-		FlowControlUtility::SaveLoopData(this, CalNormalsAccLoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-		if (SaveLoopFlag) {
-			return;
+	while (ChunkMeshes.Num() < Num)
+	{
+		UProceduralMeshComponent* ChunkMesh = NewObject<UProceduralMeshComponent>(this,
+			MakeUniqueObjectName(this, UProceduralMeshComponent::StaticClass(), TEXT("TerrainChunk")));
+		ChunkMesh->SetupAttachment(TerrainMesh);
+		ChunkMesh->SetCollisionProfileName(ChunkCollisionProfileName);
+		if (ChunkCollisionProfileName == UCollisionProfile::CustomCollisionProfileName) {
+			ChunkMesh->SetCollisionEnabled(ChunkCollisionEnabled);
+			ChunkMesh->SetCollisionObjectType(ChunkCollisionObjectType);
+			ChunkMesh->SetCollisionResponseToChannels(ChunkCollisionResponses);
 		}
-		CalTriangleNormalForVertex(i);
-		ProgressCurrent = CalNormalsAccLoopData.Count;
-		Count++;
+		ChunkMesh->SetReceivesDecals(TerrainMesh->bReceivesDecals);
+		ChunkMesh->RegisterComponent();
+		ChunkMeshes.Add(ChunkMesh);
 	}
-	ResetProgress();
-
-	WorkflowState = Enum_TerrainWorkflowState::NormalizeNormals;
-	FTimerHandle TimerHandle;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, CalNormalsAccLoopData.Rate, false);
-	UE_LOG(Terrain, Log, TEXT("Calculate normals accumulation done."));
 }
 
-void ATerrain::CalTriangleNormalForVertex(int32 TriangleIndex)
+void ATerrain::InitChunkCollision()
 {
-	int32 Index3Times = TriangleIndex * 3;
-	int32 Index1 = Triangles[Index3Times];
-	int32 Index2 = Triangles[Index3Times + 1];
-	int32 Index3 = Triangles[Index3Times + 2];
-
-	FVector Normal = FVector::CrossProduct(Vertices[Index1] - Vertices[Index2], Vertices[Index3] - Vertices[Index2]);
-
-	FVector N1 = NormalsAcc[Index1] + Normal;
-	NormalsAcc[Index1] = N1;
-
-	FVector N2 = NormalsAcc[Index2] + Normal;
-	NormalsAcc[Index2] = N2;
-
-	FVector N3 = NormalsAcc[Index3] + Normal;
-	NormalsAcc[Index3] = N3;
+	//A custom profile has no name to apply, its settings are copied one by one
+	ChunkCollisionProfileName = TerrainMesh->GetCollisionProfileName();
+	ChunkCollisionEnabled = TerrainMesh->GetCollisionEnabled();
+	ChunkCollisionObjectType = TerrainMesh->GetCollisionObjectType();
+	ChunkCollisionResponses = TerrainMesh->GetCollisionResponseToChannels();
+	TerrainMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
 }
 
-void ATerrain::NormalizeNormals()
+void ATerrain::UpdateMeshChunks(int32 RowBegin, int32 RowEnd, int32 ColumnBegin, int32 ColumnEnd)
 {
-	int32 Count = 0;
-	TArray<int32> Indices = { 0 };
-	bool SaveLoopFlag = false;
+	TArray<int32> Indices;
+	MeshChunks.FindChunks(RowBegin, RowEnd, ColumnBegin, ColumnEnd, Indices);
+	MeshChunks.Build(Indices, Vertices, Normals, UVs, VertexColors);
+	for (int32 i : Indices)
+	{
+		const TerrainMeshChunks::FChunk& Chunk = MeshChunks.GetChunk(i);
+		ChunkMeshes[i]->UpdateMeshSection_LinearColor(0, Chunk.Vertices, Chunk.Normals, Chunk.UVs, Chunk.VertexColors,
+			TArray<FProcMeshTangent>());
+	}
+	MeshChunks.ReleaseBuffers();
+	UE_LOG(Terrain, Log, TEXT("Update %d of %d mesh chunks."), Indices.Num(), MeshChunks.Num());
+}
 
-	if (!NormalizeNormalsLoopData.HasInitialized) {
-		NormalizeNormalsLoopData.HasInitialized = true;
-		ProgressTarget = NormalsAcc.Num();
+bool ATerrain::SetVertexHeights(int32 Row, int32 Column, int32 RowNum, int32 ColumnNum, const TArray<float>& Heights)
+{
+	int32 ColumnVertexNum = NumColumns + 1;
+	if (!IsWorkFlowDone() || MeshChunks.Num() != ChunkMeshes.Num()) {
+		UE_LOG(Terrain, Warning, TEXT("SetVertexHeights before the terrain is done."));
+		return false;
+	}
+	//Tile heights, normals and block levels of the grid are baked from the heightfield and would go stale
+	if (HexGrid != nullptr) {
+		UE_LOG(Terrain, Error, TEXT("SetVertexHeights with hex grid %s bound, its tiles are not rebuilt from edited heights."),
+			*HexGrid->GetName());
+		return false;
+	}
+	if (Row < 0 || Column < 0 || RowNum <= 0 || ColumnNum <= 0 || Row + RowNum > NumRows + 1 ||
+		Column + ColumnNum > ColumnVertexNum || Heights.Num() != RowNum * ColumnNum) {
+		UE_LOG(Terrain, Warning, TEXT("SetVertexHeights, block %d x %d at (%d, %d) with %d heights is out of the terrain."),
+			RowNum, ColumnNum, Row, Column, Heights.Num());
+		return false;
 	}
 
-	int32 i = NormalizeNormalsLoopData.IndexSaved[0];
-	int32 last = NormalsAcc.Num() - 1;
-	for ( ; i <= last; i++) {
-		Indices[0] = i;
-		FlowControlUtility::SaveLoopData(this, NormalizeNormalsLoopData, Count, Indices, WorkflowDelegate, SaveLoopFlag);
-		if (SaveLoopFlag) {
-			return;
+	//Zero altitude is a valid setting, every height is then 0 and so the altitude color
+	float InvAltitude = TileAltitudeMultiplier > 0.f ? 1.f / TileAltitudeMultiplier : 0.f;
+	for (int32 r = 0; r < RowNum; r++)
+	{
+		float* HeightRow = Heightfield.GetRow(Row + r);
+		for (int32 c = 0; c < ColumnNum; c++)
+		{
+			float Z = Heights[r * ColumnNum + c];
+			int32 Index = (Row + r) * ColumnVertexNum + Column + c;
+			HeightRow[Column + c] = Z;
+			Vertices[Index].Z = Z;
+			VertexColors[Index].R = Z * InvAltitude * 0.5 + 0.5;
 		}
-		NormalsAcc[i].Normalize();
-		Normals.Add(NormalsAcc[i]);
-		ProgressCurrent = NormalizeNormalsLoopData.Count;
-		Count++;
 	}
-	ResetProgress();
 
-	WorkflowState = Enum_TerrainWorkflowState::DrawLandMesh;
-	FTimerHandle TimerHandle;
-	GetWorldTimerManager().SetTimer(TimerHandle, WorkflowDelegate, NormalizeNormalsLoopData.Rate, false);
-	UE_LOG(Terrain, Log, TEXT("Normalize normals done."));
-}
-
-void ATerrain::CreateTerrainMesh()
-{
-	TerrainMesh->CreateMeshSection_LinearColor(0, Vertices, Triangles, Normals, UVs, VertexColors, 
-		TArray<FProcMeshTangent>(), true );
-	TerrainMesh->bUseComplexAsSimpleCollision = true;
-	TerrainMesh->SetCollisionResponseToAllChannels(ECollisionResponse::ECR_Block);
-	TerrainMesh->SetCollisionObjectType(ECollisionChannel::ECC_WorldStatic);
-	TerrainMesh->bUseComplexAsSimpleCollision = false;
-
-	UE_LOG(Terrain, Log, TEXT("Create terrain mesh done."));
+	//Normals read the neighbor heights, so they change one vertex further
+	int32 RowBegin = FMath::Max(Row - 1, 0);
+	int32 RowEnd = FMath::Min(Row + RowNum + 1, NumRows + 1);
+	CalNormalRows(RowBegin, RowEnd);
+	UpdateMeshChunks(RowBegin, RowEnd, Column - 1, Column + ColumnNum + 1);
+	return true;
 }
 
 void ATerrain::SetTerrainMaterial()
 {
-	TerrainMesh->SetMaterial(0, TerrainMaterialIns);
+	for (UProceduralMeshComponent* ChunkMesh : ChunkMeshes)
+	{
+		ChunkMesh->SetMaterial(0, TerrainMaterialIns);
+	}
 }
 
 void ATerrain::CreateWater()
@@ -962,6 +1155,10 @@ void ATerrain::CreateCaustics()
 	FVector location(0, 0, base - sink - 1);
 	FRotator rotator(0.0, 0.0, 0.0);
 
-	UGameplayStatics::SpawnDecalAtLocation(this, CausticsMaterialIns, size, location, rotator);
+	//A regenerated terrain replaces the decal of the last run
+	if (CausticsDecal != nullptr) {
+		CausticsDecal->DestroyComponent();
+	}
+	CausticsDecal = UGameplayStatics::SpawnDecalAtLocation(this, CausticsMaterialIns, size, location, rotator);
 }
 
@@ -3,24 +3,33 @@
 #pragma once
 
 #include "StructDefine.h"
+#include "WorkflowGraph.h"
+#include "WorkflowProfiler.h"
+#include "TerrainNoise.h"
+#include "TerrainHeightfield.h"
+#include "TerrainMeshChunks.h"
 
 #include <FastNoiseWrapper.h>
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+
+#include <atomic>
+
 #include "Terrain.generated.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(Terrain, Log, All);
 
+struct FXxHash64Builder;
+
 UENUM(BlueprintType)
 enum class Enum_TerrainWorkflowState: uint8
 {
 	InitWorkflow,
 	CreateVerticesAndUVs,
+	//No longer a stage, the chunks build their own triangles, kept for the values Blueprints store
 	CreateTriangles,
-	CalNormalsInit,
-	CalNormalsAcc,
-	NormalizeNormals,
+	CalNormals,
 	DrawLandMesh,
 	CreateWater,
 	CreateTree,
@@ -34,8 +43,17 @@ class MAPTESTCPP_API ATerrain : public AActor
 	GENERATED_BODY()
 
 private:
+	//Noise layers, sampled from worker threads
+	TerrainNoise Noise;
+
+	//Vertex heights for ground queries, filled by the vertices stage
+	TerrainHeightfield Heightfield;
+	UE::Tasks::FTaskEvent HeightfieldReadyEvent{ TEXT("TerrainHeightfieldReady") };
+
+	//Mesh chunk ranges, buffers only while chunks are built and uploaded
+	TerrainMeshChunks MeshChunks;
+
 	//noise param for high mountain
-	UFastNoiseWrapper* NWHighMountain;
 	EFastNoise_NoiseType NWHighMountain_NoiseType = EFastNoise_NoiseType::PerlinFractal;
 	EFastNoise_Interp NWHighMountain_Interp = EFastNoise_Interp::Quintic;
 	EFastNoise_FractalType NWHighMountain_FractalType = EFastNoise_FractalType::RigidMulti;
@@ -47,7 +65,6 @@ private:
 	EFastNoise_CellularReturnType NWHighMountain_CRT = EFastNoise_CellularReturnType::CellValue;
 	
 	//noise param for low mountain
-	UFastNoiseWrapper* NWLowMountain;
 	EFastNoise_NoiseType NWLowMountain_NoiseType = EFastNoise_NoiseType::PerlinFractal;
 	EFastNoise_Interp NWLowMountain_Interp = EFastNoise_Interp::Quintic;
 	EFastNoise_FractalType NWLowMountain_FractalType = EFastNoise_FractalType::RigidMulti;
@@ -59,7 +76,6 @@ private:
 	EFastNoise_CellularReturnType NWLowMountain_CRT = EFastNoise_CellularReturnType::CellValue;
 
 	//noise param for water
-	UFastNoiseWrapper* NWWater;
 	EFastNoise_NoiseType NWWater_NoiseType = EFastNoise_NoiseType::PerlinFractal;
 	EFastNoise_Interp NWWater_Interp = EFastNoise_Interp::Quintic;
 	EFastNoise_FractalType NWWater_FractalType = EFastNoise_FractalType::FBM;
@@ -71,7 +87,6 @@ private:
 	EFastNoise_CellularReturnType NWWater_CRT = EFastNoise_CellularReturnType::CellValue;
 
 	//noise param for moisture
-	UFastNoiseWrapper* NWMoisture;
 	EFastNoise_NoiseType NWMoisture_NoiseType = EFastNoise_NoiseType::PerlinFractal;
 	EFastNoise_Interp NWMoisture_Interp = EFastNoise_Interp::Quintic;
 	EFastNoise_FractalType NWMoisture_FractalType = EFastNoise_FractalType::FBM;
@@ -83,7 +98,6 @@ private:
 	EFastNoise_CellularReturnType NWMoisture_CRT = EFastNoise_CellularReturnType::CellValue;
 
 	//noise param for temperature
-	UFastNoiseWrapper* NWTemperature;
 	EFastNoise_NoiseType NWTemperature_NoiseType = EFastNoise_NoiseType::PerlinFractal;
 	EFastNoise_Interp NWTemperature_Interp = EFastNoise_Interp::Quintic;
 	EFastNoise_FractalType NWTemperature_FractalType = EFastNoise_FractalType::FBM;
@@ -95,7 +109,6 @@ private:
 	EFastNoise_CellularReturnType NWTemperature_CRT = EFastNoise_CellularReturnType::CellValue;
 
 	//noise param for biomes
-	UFastNoiseWrapper* NWBiomes;
 	EFastNoise_NoiseType NWBiomes_NoiseType = EFastNoise_NoiseType::PerlinFractal;
 	EFastNoise_Interp NWBiomes_Interp = EFastNoise_Interp::Quintic;
 	EFastNoise_FractalType NWBiomes_FractalType = EFastNoise_FractalType::FBM;
@@ -107,7 +120,6 @@ private:
 	EFastNoise_CellularReturnType NWBiomes_CRT = EFastNoise_CellularReturnType::CellValue;
 
 	//noise param for tree
-	UFastNoiseWrapper* NWTree;
 	EFastNoise_NoiseType NWTree_NoiseType = EFastNoise_NoiseType::PerlinFractal;
 	EFastNoise_Interp NWTree_Interp = EFastNoise_Interp::Quintic;
 	EFastNoise_FractalType NWTree_FractalType = EFastNoise_FractalType::FBM;
@@ -122,15 +134,18 @@ private:
 	FTimerDynamicDelegate WorkflowDelegate;
 	FTimerDynamicDelegate UpdateMousePosDelegate;
 
+	//Workflow stages as a task graph
+	WorkflowGraph Graph;
+
+	//Per stage timings of the workflow
+	WorkflowProfiler Profiler;
+
 	//Timer handle
 	FTimerHandle UpdateMousePosTimerHandle;
 
 	//Mouse pos
 	FVector MousePos;
 
-	//For normal calculate
-	TArray<FVector> NormalsAcc;
-
 	//water param
 	float WaterBase;
 
@@ -146,6 +161,21 @@ private:
 
 	float TileNumRowRatio = 1.0;
 	float TileNumColumnRatio = 1.0;
+
+	//Set when init fails, graph stages never write WorkflowState
+	std::atomic<bool> bWorkflowFailed = false;
+	//Furthest state the graph stages reached, copied into WorkflowState on the game thread
+	std::atomic<Enum_TerrainWorkflowState> GraphWorkflowState = Enum_TerrainWorkflowState::InitWorkflow;
+
+	//Items of the whole build, stages of the graph add to it from worker threads, read by GetProgress
+	std::atomic<int32> ProgressTarget = 0;
+	std::atomic<int32> ProgressCurrent = 0;
+
+	//Collision of TerrainMesh as edited, taken at BeginPlay for the chunks, the root itself has no sections
+	FName ChunkCollisionProfileName;
+	ECollisionEnabled::Type ChunkCollisionEnabled = ECollisionEnabled::QueryOnly;
+	ECollisionChannel ChunkCollisionObjectType = ECollisionChannel::ECC_WorldStatic;
+	FCollisionResponseContainer ChunkCollisionResponses;
 	
 
 protected:
@@ -154,6 +184,11 @@ protected:
 	class UProceduralMeshComponent* TerrainMesh;
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly)
 	class UProceduralMeshComponent* WaterMesh;
+	//One per mesh chunk, attached to TerrainMesh, so each chunk has its own bounds and collision
+	UPROPERTY(VisibleInstanceOnly, BlueprintReadOnly, Transient)
+	TArray<class UProceduralMeshComponent*> ChunkMeshes;
+	UPROPERTY()
+	class UDecalComponent* CausticsDecal = nullptr;
 
 	//Noise variables BP for high mountain
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Noise|HighMountain")
@@ -190,6 +225,11 @@ protected:
 	int32 NWTree_NoiseSeed = 0;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Noise|Tree", meta = (ClampMin = "0.0"))
 	float NWTree_NoiseFrequency = 0.01;
+	//Altitude recipe as data, replaces the mountain and water layers above, the seed is added to every node seed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Noise|Graph")
+	class UTerrainNoiseGraph* AltitudeGraph = nullptr;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Noise|Graph")
+	int32 AltitudeGraph_NoiseSeed = 0;
 
 	//Tile variables BP
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Tile", meta = (ClampMin = "0"))
@@ -208,6 +248,9 @@ protected:
 	float TileAltitudeMax = 5000.0;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Tile", meta = (ClampMin = "0.0"))
 	float UVScale = 1.0;
+	//Cells per side of a terrain mesh chunk
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Tile", meta = (ClampMin = "1"))
+	int32 MeshChunkSize = 64;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Terrain", meta = (ClampMin = "0.0", ClampMax = "1.0"))
 	float HighMountainLevel = 0.5;
@@ -275,17 +318,15 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Timer")
 	float UpdateMousePosTimerRate = 0.01f;
 
+	//Run vertices and normals as a task graph on worker threads, mesh and water stay on the timer workflow
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Workflow")
+	bool bRunWorkflowAsGraph = true;
+
 	//Loop BP
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
 	FStructLoopData CreateVerticesLoopData;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData CreateTrianglesLoopData;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData CalNormalsInitLoopData;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData CalNormalsAccLoopData;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Custom|Loop")
-	FStructLoopData NormalizeNormalsLoopData;
+	FStructLoopData CalNormalsLoopData;
 
 	//Render variables
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Custom|Render|Land")
@@ -294,9 +335,6 @@ protected:
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Custom|Render|Land")
 	TArray<FVector2D> UVs;
 
-	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Custom|Render|Land")
-	TArray<int32> Triangles;
-
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Custom|Render|Land")
 	TArray<FVector> Normals;
 
@@ -323,12 +361,6 @@ protected:
 	UPROPERTY(BlueprintReadOnly)
 	Enum_TerrainWorkflowState WorkflowState = Enum_TerrainWorkflowState::InitWorkflow;
 
-	//Progress
-	UPROPERTY(BlueprintReadOnly)
-	int32 ProgressTarget = 0;
-	UPROPERTY(BlueprintReadOnly)
-	int32 ProgressCurrent = 0;
-
 	//Hex grid
 	UPROPERTY(BlueprintReadOnly)
 	class AHexGrid* HexGrid;
@@ -348,7 +380,48 @@ public:
 	ATerrain();
 
 	bool IsWorkFlowStepDone(Enum_TerrainWorkflowState state);
+	//Mesh surface once the heightfield is ready, the noise before
 	float GetAltitudeByPos2D(const FVector2D Pos2D, AActor* Caller);
+	//Mesh surface heights and normals of many positions, safe on worker threads once the heightfield is ready.
+	//Out_Z or Out_Normals may be nullptr.
+	void GetAltitudesByPos2D(const FVector2D* Positions, int32 Num, float* Out_Z, FVector* Out_Normals = nullptr) const;
+
+	//False until the vertices stage is done
+	UFUNCTION(BlueprintCallable)
+	bool GetGroundByPos2D(const FVector2D& Pos2D, float& Out_Z, FVector& Out_Normal);
+	//Vector batch noise against the FastNoise samples, after the init
+	bool CheckNoiseBatchParity(float Tolerance = 1e-4f);
+	//The default UTerrainNoiseGraph compiled with the seed and ratios of this terrain against the built-in recipe,
+	//after the init. That graph is the recipe with water at the default params, so HasWater must be on.
+	//Out_RecipeMs and Out_GraphMs time one batched altitude pass of each over every vertex, rows in parallel.
+	bool CheckDefaultGraphParity(float Tolerance, double& Out_RecipeMs, double& Out_GraphMs);
+	//Gathered normals against an accumulation of the face normals over the grid cells, after the build
+	bool CheckNormalsParity(float Tolerance = 1e-4f);
+
+	//Every param GetAltitudeByPos2D and the grid block checks read, valid after InitWorkflow
+	void HashAltitudeParams(FXxHash64Builder& Builder);
+
+	//No world, components or materials: noise and params on the game thread, then the geometry on any thread
+	void InitHeadless();
+	void BuildHeadless();
+
+	//Whole vertices stage at once on the calling thread and BandNum parallel bands, after InitHeadless.
+	//The thread scaling of the benchmark, the same results for any BandNum.
+	void CreateVerticesInBands(int32 BandNum);
+
+	//Vertex heights row major, (NumRows + 1) rows of (NumColumns + 1) after the vertices stage
+	void GetHeightfield(TArray<float>& Out_Heights, int32& Out_Rows, int32& Out_Columns) const;
+
+	//Vertex heights of RowNum x ColumnNum vertices from (Row, Column), row major, once the workflow is done.
+	//Normals around them and only the mesh chunks they touch are rebuilt. False while a hex grid is bound,
+	//its tiles are baked from the heights and are not rebuilt.
+	UFUNCTION(BlueprintCallable)
+	bool SetVertexHeights(int32 Row, int32 Column, int32 RowNum, int32 ColumnNum, const TArray<float>& Heights);
+
+	//Cancel the workflow and build again with the current params, the hex grid follows.
+	//Buffers keep their allocations, the noise layers are set up again from the params.
+	UFUNCTION(BlueprintCallable)
+	void Regenerate();
 
 	UFUNCTION(BlueprintCallable)
 	bool IsLeftHold();
@@ -385,44 +458,38 @@ private:
 	void InitHexGrid();
 	void InitTerrainFormBaseRatio();
 	void InitWater();
+	void InitWaterBase();
 	void InitTreeParam();
+	void InitNoiseParams();
 	bool CheckMaterialSetting();
 
 	//create Workflow
 	UFUNCTION()
 	void CreateTerrainFlow();
+	void StartWorkflowGraph();
+	//Stages set the next state through this, inside the graph it is published to the game thread
+	void SetWorkflowState(Enum_TerrainWorkflowState State);
+	void PublishGraphWorkflowState();
+	//Broadcast the current state to the map registry
+	void NotifyStageDone();
 
 	//Vertices create
 	void CreateVertices();
-	float GetAltitude(float X, float Y, float& OutRatioStd, float& OutRatio);
-	float MappingFromRangeToRange(float InputValue, const FStructHeightMapping& Mapping);
-	float GetHeightRatio(UFastNoiseWrapper* NWP, const FStructHeightMapping& Mapping, float X, float Y);
-	void MappingByLevel(float level, const FStructHeightMapping& InMapping, FStructHeightMapping& OutMapping);
-	float GetHighMountainRatio(float X, float Y);
-	float GetLowMountianRatio(float X, float Y);
-	float GetWaterRatio(float X, float Y);
-
-
-	float GetNoise2DStd(UFastNoiseWrapper* NWP, float X, float Y, float scale);
-	void CreateVertex(float X, float Y, float& OutRatioStd, float& OutRatio);
-	void CreateUV(float X, float Y);
-	void CreateVertexColorsForAMTA(float RatioStd, float X, float Y);
-	void AddTreeValues(float X, float Y);
-
-	//Triangles create
-	void CreateTriangles();
-	void CreatePairTriangles(int32 ColumnIndex, int32 RowVertex, int32 RowPlusOneVertex);
-
-	//Normals create
-	void CreateNormals();
-	void CalNormalsWorkflow();
-	void CalNormalsInit();
-	void CalNormalsAcc();
-	void CalTriangleNormalForVertex(int32 Index);
-	void NormalizeNormals();
+	//Rows of vertices into the sized buffers, split in BandNum parallel bands, one band per row when 0
+	void CreateVertexRows(int32 RowBegin, int32 RowEnd, int32 BandNum);
+	void CreateVertexRow(int32 Row);
+	void InitHeightfield();
+
+	//Normals create, gathered per vertex from the heightfield, rows in parallel
+	void CalNormals();
+	void CalNormalRows(int32 RowBegin, int32 RowEnd);
 
 	//Mesh create
 	void CreateTerrainMesh();
+	void InitChunkMeshes(int32 Num);
+	void InitChunkCollision();
+	//Vertices [RowBegin, RowEnd) x [ColumnBegin, ColumnEnd) changed, rebuilds and uploads the chunks holding them
+	void UpdateMeshChunks(int32 RowBegin, int32 RowEnd, int32 ColumnBegin, int32 ColumnEnd);
 	void SetTerrainMaterial();
 	
 	//Create Water
@@ -439,6 +506,7 @@ private:
 	void CreateCaustics();
 
 	void ResetProgress();
+	void InitProgress();
 
 	//Input
 	bool IsMouseClickTraceHit();
@@ -453,9 +521,21 @@ private:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	UFUNCTION(BlueprintCallable)
 	void GetProgress(float& Out_Progress);
+	//Items of the whole build and the ones done, the counters are atomic so they are read through these
+	UFUNCTION(BlueprintPure)
+	FORCEINLINE int32 GetProgressTarget() const
+	{
+		return ProgressTarget;
+	}
+	UFUNCTION(BlueprintPure)
+	FORCEINLINE int32 GetProgressCurrent() const
+	{
+		return ProgressCurrent;
+	}
 
 public:	
 	// Called every frame
@@ -472,6 +552,16 @@ public:
 		return WorkflowState > State;
 	}
 
+	FORCEINLINE const WorkflowProfiler& GetProfiler() const
+	{
+		return Profiler;
+	}
+
+	FORCEINLINE bool IsWorkFlowError()
+	{
+		return WorkflowState == Enum_TerrainWorkflowState::Error;
+	}
+
 	FORCEINLINE float GetWidth() {
 		return TerrainWidth;
 	}
@@ -484,6 +574,17 @@ public:
 		return TileAltitudeMultiplier;
 	}
 
+	FORCEINLINE bool IsHeightfieldReady() const
+	{
+		return HeightfieldReadyEvent.IsCompleted();
+	}
+
+	//Completes when the vertices stage is done, never for a run cancelled before that
+	FORCEINLINE const UE::Tasks::FTaskEvent& GetHeightfieldReadyEvent() const
+	{
+		return HeightfieldReadyEvent;
+	}
+
 	FORCEINLINE float GetWaterBase() {
 		return WaterBase;
 	}
@@ -3,9 +3,9 @@
 
 #include "TerrainCamera.h"
 #include "Terrain.h"
+#include "MapRegistrySubsystem.h"
 
 #include <EnhancedInputSubsystems.h>
-#include <Kismet/GameplayStatics.h>
 #include <kismet/KismetMathLibrary.h>
 #include <GameFramework/SpringArmComponent.h>
 #include <Camera/CameraComponent.h>
@@ -33,7 +33,6 @@ ATerrainCamera::ATerrainCamera()
 
 void ATerrainCamera::BindDelegate()
 {
-	TerrainDelegate.BindUFunction(Cast<UObject>(this), TEXT("OnGetTerrainInfo"));
 	ScrollScreenDelegate.BindUFunction(Cast<UObject>(this), TEXT("OnScrollScreen"));
 }
 
@@ -105,8 +104,11 @@ void ATerrainCamera::BeginPlay()
 	InitCamera();
 	BindEnchancedInputAction();
 
-	FTimerHandle TimerHandleT;
-	GetWorldTimerManager().SetTimer(TimerHandleT, TerrainDelegate, TimingForWaitTerrain, false);
+	if (UMapRegistrySubsystem* Registry = UMapRegistrySubsystem::Get(this)) {
+		Registry->WhenTerrainStageDone(this, Enum_TerrainWorkflowState::InitWorkflow, [this](ATerrain* InTerrain) {
+			OnGetTerrainInfo(InTerrain);
+		});
+	}
 
 	FTimerHandle TimerHandleSS;
 	GetWorldTimerManager().SetTimer(TimerHandleSS, ScrollScreenDelegate, TimingForScrollScreen, true);
@@ -136,27 +138,11 @@ void ATerrainCamera::SetupPlayerInputComponent(UInputComponent* PlayerInputCompo
 	}
 }
 
-void ATerrainCamera::OnGetTerrainInfo()
+void ATerrainCamera::OnGetTerrainInfo(ATerrain* InTerrain)
 {
-	TSubclassOf<ATerrain> ClassToFind = ATerrain::StaticClass();
-	TArray<AActor*> Actors;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), ClassToFind, Actors);
-	if (Actors.Num() == 1) {
-		Terrain = Cast<ATerrain>(Actors[0]);
-		if (Terrain->IsWorkFlowOverStage(Enum_TerrainWorkflowState::InitWorkflow)) {
-			BoundaryMin.Set(-BoundaryScalar * Terrain->GetWidth(), -BoundaryScalar * Terrain->GetHeight(), -1);
-			BoundaryMax.Set(BoundaryScalar * Terrain->GetWidth(), BoundaryScalar * Terrain->GetHeight(), 1);
-		}
-		else {
-			FTimerHandle TimerHandle;
-			GetWorldTimerManager().SetTimer(TimerHandle, TerrainDelegate, TimingForWaitTerrain, false);
-		}
-	}
-	else {
-		FTimerHandle TimerHandle;
-		GetWorldTimerManager().SetTimer(TimerHandle, TerrainDelegate, TimingForWaitTerrain, false);
-	}
-
+	Terrain = InTerrain;
+	BoundaryMin.Set(-BoundaryScalar * Terrain->GetWidth(), -BoundaryScalar * Terrain->GetHeight(), -1);
+	BoundaryMax.Set(BoundaryScalar * Terrain->GetWidth(), BoundaryScalar * Terrain->GetHeight(), 1);
 }
 
 void ATerrainCamera::OnScrollScreen()
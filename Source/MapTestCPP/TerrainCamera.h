@@ -15,7 +15,6 @@ class MAPTESTCPP_API ATerrainCamera : public APawn
 
 private:
 	//delegate
-	FTimerDynamicDelegate TerrainDelegate;
 	FTimerDynamicDelegate ScrollScreenDelegate;
 
 	//Terrain
@@ -35,9 +34,6 @@ protected:
 	class UInputMappingContext* InputMapping;
 
 	//Terrain
-	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Custom|TerrainInfo")
-	float TimingForWaitTerrain = 0.1;
-
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Custom|TerrainInfo")
 	float BoundaryScalar = 0.45;
 	
@@ -124,8 +120,7 @@ private:
 	UFUNCTION()
 	void OnCameraZoomOut(const FInputActionValue& Value);
 
-	UFUNCTION()
-	void OnGetTerrainInfo();
+	void OnGetTerrainInfo(class ATerrain* InTerrain);
 
 	UFUNCTION()
 	void OnScrollScreen();
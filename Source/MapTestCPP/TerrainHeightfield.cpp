@@ -0,0 +1,141 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainHeightfield.h"
+
+TerrainHeightfield::TerrainHeightfield()
+{
+}
+
+TerrainHeightfield::~TerrainHeightfield()
+{
+}
+
+void TerrainHeightfield::Init(int32 InRows, int32 InColumns, const FVector2D& InOrigin, double InCellSize)
+{
+	Rows = InRows;
+	Columns = InColumns;
+	Origin = InOrigin;
+	CellSize = InCellSize;
+	InvCellSize = InCellSize > 0.0 ? 1.0 / InCellSize : 1.0;
+	Heights.SetNumUninitialized(Rows * Columns);
+}
+
+void TerrainHeightfield::Reset()
+{
+	Heights.Reset();
+	Rows = 0;
+	Columns = 0;
+}
+
+float TerrainHeightfield::GetHeight(const FVector2D& Pos) const
+{
+	float Height;
+	float SlopeX;
+	float SlopeY;
+	GetPlane(Pos, Height, SlopeX, SlopeY);
+	return Height;
+}
+
+FVector TerrainHeightfield::GetNormal(const FVector2D& Pos) const
+{
+	float Height;
+	float SlopeX;
+	float SlopeY;
+	GetPlane(Pos, Height, SlopeX, SlopeY);
+	return FVector(-SlopeX, -SlopeY, 1.0).GetSafeNormal();
+}
+
+void TerrainHeightfield::GetBatch(const FVector2D* Positions, int32 Num, float* Out_Heights, FVector* Out_Normals) const
+{
+	for (int32 i = 0; i < Num; i++)
+	{
+		float Height;
+		float SlopeX;
+		float SlopeY;
+		GetPlane(Positions[i], Height, SlopeX, SlopeY);
+		if (Out_Heights != nullptr) {
+			Out_Heights[i] = Height;
+		}
+		if (Out_Normals != nullptr) {
+			Out_Normals[i] = FVector(-SlopeX, -SlopeY, 1.0).GetSafeNormal();
+		}
+	}
+}
+
+void TerrainHeightfield::GetVertexNormals(int32 Row, FVector* Out_Normals) const
+{
+	//Face normals of the up to 6 triangles around a vertex, divided by CellSize. Every triangle covers the same
+	//area in XY, so each one adds CellSize to Z and its height differences to X and Y.
+	const float* Up = Row > 0 ? GetRow(Row - 1) : nullptr;
+	const float* Mid = GetRow(Row);
+	const float* Down = Row + 1 < Rows ? GetRow(Row + 1) : nullptr;
+	for (int32 Column = 0; Column < Columns; Column++)
+	{
+		bool HasLeft = Column > 0;
+		bool HasRight = Column + 1 < Columns;
+		double X = 0.0;
+		double Y = 0.0;
+		double Z = 0.0;
+		if (Down != nullptr && HasRight) {
+			//Both triangles of cell (Row, Column)
+			X += (double)(Mid[Column] - Down[Column]) + (Mid[Column + 1] - Down[Column + 1]);
+			Y += (double)(Down[Column] - Down[Column + 1]) + (Mid[Column] - Mid[Column + 1]);
+			Z += CellSize * 2.0;
+		}
+		if (Up != nullptr && HasRight) {
+			//Triangle (Row - 1, Column), (Row, Column + 1), (Row, Column)
+			X += Up[Column] - Mid[Column];
+			Y += Mid[Column] - Mid[Column + 1];
+			Z += CellSize;
+		}
+		if (Down != nullptr && HasLeft) {
+			//Triangle (Row, Column - 1), (Row, Column), (Row + 1, Column)
+			X += Mid[Column] - Down[Column];
+			Y += Mid[Column - 1] - Mid[Column];
+			Z += CellSize;
+		}
+		if (Up != nullptr && HasLeft) {
+			//Both triangles of cell (Row - 1, Column - 1)
+			X += (double)(Up[Column - 1] - Mid[Column - 1]) + (Up[Column] - Mid[Column]);
+			Y += (double)(Mid[Column - 1] - Mid[Column]) + (Up[Column - 1] - Up[Column]);
+			Z += CellSize * 2.0;
+		}
+		Out_Normals[Column] = FVector(X, Y, Z).GetSafeNormal();
+	}
+}
+
+void TerrainHeightfield::GetPlane(const FVector2D& Pos, float& Out_Height, float& Out_SlopeX, float& Out_SlopeY) const
+{
+	Out_SlopeX = 0.0;
+	Out_SlopeY = 0.0;
+	if (Rows < 2 || Columns < 2) {
+		Out_Height = Heights.Num() > 0 ? Heights[0] : 0.0;
+		return;
+	}
+
+	double GridX = FMath::Clamp((Pos.X - Origin.X) * InvCellSize, 0.0, (double)(Rows - 1));
+	double GridY = FMath::Clamp((Pos.Y - Origin.Y) * InvCellSize, 0.0, (double)(Columns - 1));
+	int32 Row = FMath::Min((int32)GridX, Rows - 2);
+	int32 Column = FMath::Min((int32)GridY, Columns - 2);
+	float FracX = GridX - Row;
+	float FracY = GridY - Column;
+
+	const float* Row0 = Heights.GetData() + Row * Columns + Column;
+	const float* Row1 = Row0 + Columns;
+	float DeltaX;
+	float DeltaY;
+	if (FracX >= FracY) {
+		//Triangle (Row, Column), (Row + 1, Column + 1), (Row + 1, Column)
+		DeltaX = Row1[0] - Row0[0];
+		DeltaY = Row1[1] - Row1[0];
+	}
+	else {
+		//Triangle (Row, Column), (Row, Column + 1), (Row + 1, Column + 1)
+		DeltaX = Row1[1] - Row0[1];
+		DeltaY = Row0[1] - Row0[0];
+	}
+	Out_Height = Row0[0] + FracX * DeltaX + FracY * DeltaY;
+	Out_SlopeX = DeltaX * InvCellSize;
+	Out_SlopeY = DeltaY * InvCellSize;
+}
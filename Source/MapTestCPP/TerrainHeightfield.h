@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Vertex heights of the terrain mesh, one float per vertex, Rows rows of Columns vertices row major.
+ * Queries interpolate on the mesh triangles, cells are split from vertex (Row, Column) to (Row + 1, Column + 1)
+ * like the mesh chunks, so heights and normals are those of the rendered surface.
+ * Positions are in terrain space like the vertices and clamped to the grid. Once filled it is read only,
+ * queries are safe from any number of threads.
+ */
+class MAPTESTCPP_API TerrainHeightfield
+{
+private:
+	TArray<float> Heights;
+	int32 Rows = 0;
+	int32 Columns = 0;
+	//Terrain space position of vertex (0, 0)
+	FVector2D Origin = FVector2D::ZeroVector;
+	double CellSize = 1.0;
+	double InvCellSize = 1.0;
+
+public:
+	TerrainHeightfield();
+	~TerrainHeightfield();
+	TerrainHeightfield(const TerrainHeightfield&) = default;
+	TerrainHeightfield(TerrainHeightfield&&) = default;
+	TerrainHeightfield& operator=(const TerrainHeightfield&) = default;
+	TerrainHeightfield& operator=(TerrainHeightfield&&) = default;
+
+	//Sized for the grid, rows are filled through GetRow
+	void Init(int32 InRows, int32 InColumns, const FVector2D& InOrigin, double InCellSize);
+	//Keeps the allocation for the next terrain
+	void Reset();
+
+	FORCEINLINE float* GetRow(int32 Row)
+	{
+		return Heights.GetData() + Row * Columns;
+	}
+
+	FORCEINLINE const float* GetRow(int32 Row) const
+	{
+		return Heights.GetData() + Row * Columns;
+	}
+
+	FORCEINLINE const TArray<float>& GetHeights() const
+	{
+		return Heights;
+	}
+
+	FORCEINLINE int32 GetRows() const
+	{
+		return Rows;
+	}
+
+	FORCEINLINE int32 GetColumns() const
+	{
+		return Columns;
+	}
+
+	float GetHeight(const FVector2D& Pos) const;
+	FVector GetNormal(const FVector2D& Pos) const;
+	//Out_Heights or Out_Normals may be nullptr
+	void GetBatch(const FVector2D* Positions, int32 Num, float* Out_Heights, FVector* Out_Normals) const;
+	//Mesh vertex normals of a row, Columns of them, the sum of the face normals around each vertex weighted by area
+	void GetVertexNormals(int32 Row, FVector* Out_Normals) const;
+
+private:
+	//Height of the triangle under Pos and its slopes along X and Y per terrain unit
+	void GetPlane(const FVector2D& Pos, float& Out_Height, float& Out_SlopeX, float& Out_SlopeY) const;
+
+};
@@ -0,0 +1,148 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainMeshChunks.h"
+
+#include <Async/ParallelFor.h>
+
+TerrainMeshChunks::TerrainMeshChunks()
+{
+}
+
+TerrainMeshChunks::~TerrainMeshChunks()
+{
+}
+
+void TerrainMeshChunks::Init(int32 InNumRows, int32 InNumColumns, int32 InChunkSize)
+{
+	NumRows = InNumRows;
+	NumColumns = InNumColumns;
+	ChunkSize = FMath::Max(InChunkSize, 1);
+	ChunkRows = FMath::DivideAndRoundUp(NumRows, ChunkSize);
+	ChunkColumns = FMath::DivideAndRoundUp(NumColumns, ChunkSize);
+
+	Chunks.Reset();
+	Chunks.SetNum(ChunkRows * ChunkColumns);
+	for (int32 ChunkRow = 0; ChunkRow < ChunkRows; ChunkRow++)
+	{
+		for (int32 ChunkColumn = 0; ChunkColumn < ChunkColumns; ChunkColumn++)
+		{
+			FChunk& Chunk = Chunks[ChunkRow * ChunkColumns + ChunkColumn];
+			Chunk.RowBegin = ChunkRow * ChunkSize;
+			Chunk.RowEnd = FMath::Min(Chunk.RowBegin + ChunkSize, NumRows);
+			Chunk.ColumnBegin = ChunkColumn * ChunkSize;
+			Chunk.ColumnEnd = FMath::Min(Chunk.ColumnBegin + ChunkSize, NumColumns);
+		}
+	}
+}
+
+void TerrainMeshChunks::Reset()
+{
+	Chunks.Reset();
+	ChunkRows = 0;
+	ChunkColumns = 0;
+	NumRows = 0;
+	NumColumns = 0;
+}
+
+void TerrainMeshChunks::Build(const TArray<int32>& Indices, const TArray<FVector>& Vertices, const TArray<FVector>& Normals,
+	const TArray<FVector2D>& UVs, const TArray<FLinearColor>& VertexColors)
+{
+	ParallelFor(Indices.Num(), [&](int32 i) {
+		BuildChunk(Chunks[Indices[i]], Vertices, Normals, UVs, VertexColors);
+	});
+}
+
+void TerrainMeshChunks::BuildAll(const TArray<FVector>& Vertices, const TArray<FVector>& Normals,
+	const TArray<FVector2D>& UVs, const TArray<FLinearColor>& VertexColors)
+{
+	ParallelFor(Chunks.Num(), [&](int32 i) {
+		BuildChunk(Chunks[i], Vertices, Normals, UVs, VertexColors);
+	});
+}
+
+void TerrainMeshChunks::ReleaseBuffers()
+{
+	for (FChunk& Chunk : Chunks)
+	{
+		Chunk.Vertices.Empty();
+		Chunk.Triangles.Empty();
+		Chunk.Normals.Empty();
+		Chunk.UVs.Empty();
+		Chunk.VertexColors.Empty();
+	}
+}
+
+void TerrainMeshChunks::FindChunks(int32 RowBegin, int32 RowEnd, int32 ColumnBegin, int32 ColumnEnd, TArray<int32>& Out_Indices) const
+{
+	Out_Indices.Reset();
+	RowBegin = FMath::Max(RowBegin, 0);
+	RowEnd = FMath::Min(RowEnd, NumRows + 1);
+	ColumnBegin = FMath::Max(ColumnBegin, 0);
+	ColumnEnd = FMath::Min(ColumnEnd, NumColumns + 1);
+	if (RowBegin >= RowEnd || ColumnBegin >= ColumnEnd) {
+		return;
+	}
+
+	//A vertex on a chunk border belongs to the chunks on both sides
+	int32 ChunkRowBegin = FMath::Max((RowBegin - 1) / ChunkSize, 0);
+	int32 ChunkRowEnd = FMath::Min((RowEnd - 1) / ChunkSize + 1, ChunkRows);
+	int32 ChunkColumnBegin = FMath::Max((ColumnBegin - 1) / ChunkSize, 0);
+	int32 ChunkColumnEnd = FMath::Min((ColumnEnd - 1) / ChunkSize + 1, ChunkColumns);
+	for (int32 ChunkRow = ChunkRowBegin; ChunkRow < ChunkRowEnd; ChunkRow++)
+	{
+		for (int32 ChunkColumn = ChunkColumnBegin; ChunkColumn < ChunkColumnEnd; ChunkColumn++)
+		{
+			const FChunk& Chunk = Chunks[ChunkRow * ChunkColumns + ChunkColumn];
+			if (RowBegin <= Chunk.RowEnd && RowEnd > Chunk.RowBegin &&
+				ColumnBegin <= Chunk.ColumnEnd && ColumnEnd > Chunk.ColumnBegin) {
+				Out_Indices.Add(ChunkRow * ChunkColumns + ChunkColumn);
+			}
+		}
+	}
+}
+
+void TerrainMeshChunks::BuildChunk(FChunk& Chunk, const TArray<FVector>& Vertices, const TArray<FVector>& Normals,
+	const TArray<FVector2D>& UVs, const TArray<FLinearColor>& VertexColors) const
+{
+	int32 RowNum = Chunk.RowEnd - Chunk.RowBegin;
+	int32 ColumnNum = Chunk.ColumnEnd - Chunk.ColumnBegin;
+	int32 ColumnVertexNum = NumColumns + 1;
+	int32 ChunkColumnVertexNum = ColumnNum + 1;
+	int32 VertexNum = (RowNum + 1) * ChunkColumnVertexNum;
+
+	Chunk.Vertices.SetNumUninitialized(VertexNum);
+	Chunk.Normals.SetNumUninitialized(VertexNum);
+	Chunk.UVs.SetNumUninitialized(VertexNum);
+	Chunk.VertexColors.SetNumUninitialized(VertexNum);
+	for (int32 Row = 0; Row <= RowNum; Row++)
+	{
+		int32 Source = (Chunk.RowBegin + Row) * ColumnVertexNum + Chunk.ColumnBegin;
+		int32 Dest = Row * ChunkColumnVertexNum;
+		FMemory::Memcpy(Chunk.Vertices.GetData() + Dest, Vertices.GetData() + Source, ChunkColumnVertexNum * sizeof(FVector));
+		FMemory::Memcpy(Chunk.Normals.GetData() + Dest, Normals.GetData() + Source, ChunkColumnVertexNum * sizeof(FVector));
+		FMemory::Memcpy(Chunk.UVs.GetData() + Dest, UVs.GetData() + Source, ChunkColumnVertexNum * sizeof(FVector2D));
+		FMemory::Memcpy(Chunk.VertexColors.GetData() + Dest, VertexColors.GetData() + Source, ChunkColumnVertexNum * sizeof(FLinearColor));
+	}
+
+	//Each cell split along its VI0-VI3 diagonal, CheckNormalsParity uses the same split
+	Chunk.Triangles.SetNumUninitialized(RowNum * ColumnNum * 6);
+	int32* Triangle = Chunk.Triangles.GetData();
+	for (int32 Row = 0; Row < RowNum; Row++)
+	{
+		for (int32 Column = 0; Column < ColumnNum; Column++)
+		{
+			int32 VI0 = Row * ChunkColumnVertexNum + Column;
+			int32 VI1 = VI0 + ChunkColumnVertexNum;
+			int32 VI2 = VI0 + 1;
+			int32 VI3 = VI1 + 1;
+			Triangle[0] = VI0;
+			Triangle[1] = VI3;
+			Triangle[2] = VI1;
+			Triangle[3] = VI0;
+			Triangle[4] = VI2;
+			Triangle[5] = VI3;
+			Triangle += 6;
+		}
+	}
+}
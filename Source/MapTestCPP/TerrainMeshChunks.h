@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Terrain mesh split in square chunks of ChunkSize cells, the last row and column of chunks may be smaller.
+ * A chunk copies its vertices, one row and column past its cells, from the whole terrain buffers so border
+ * vertices and normals are the same on both sides. Triangles are local, cells are split from vertex
+ * (Row, Column) to (Row + 1, Column + 1).
+ * Chunks are independent, any set of them builds in parallel. Buffers only live until they are uploaded.
+ */
+class MAPTESTCPP_API TerrainMeshChunks
+{
+public:
+	struct FChunk
+	{
+		//Cells [RowBegin, RowEnd) x [ColumnBegin, ColumnEnd) of the terrain
+		int32 RowBegin = 0;
+		int32 RowEnd = 0;
+		int32 ColumnBegin = 0;
+		int32 ColumnEnd = 0;
+
+		TArray<FVector> Vertices;
+		TArray<int32> Triangles;
+		TArray<FVector> Normals;
+		TArray<FVector2D> UVs;
+		TArray<FLinearColor> VertexColors;
+	};
+
+private:
+	TArray<FChunk> Chunks;
+	int32 ChunkSize = 64;
+	int32 ChunkRows = 0;
+	int32 ChunkColumns = 0;
+	int32 NumRows = 0;
+	int32 NumColumns = 0;
+
+public:
+	TerrainMeshChunks();
+	~TerrainMeshChunks();
+	TerrainMeshChunks(const TerrainMeshChunks&) = default;
+	TerrainMeshChunks(TerrainMeshChunks&&) = default;
+	TerrainMeshChunks& operator=(const TerrainMeshChunks&) = default;
+	TerrainMeshChunks& operator=(TerrainMeshChunks&&) = default;
+
+	//Chunk ranges of a terrain of InNumRows x InNumColumns cells, chunks are row major
+	void Init(int32 InNumRows, int32 InNumColumns, int32 InChunkSize);
+	void Reset();
+
+	//Terrain buffers are row major with NumColumns + 1 vertices per row
+	void Build(const TArray<int32>& Indices, const TArray<FVector>& Vertices, const TArray<FVector>& Normals,
+		const TArray<FVector2D>& UVs, const TArray<FLinearColor>& VertexColors);
+	void BuildAll(const TArray<FVector>& Vertices, const TArray<FVector>& Normals,
+		const TArray<FVector2D>& UVs, const TArray<FLinearColor>& VertexColors);
+	//Once uploaded, the ranges stay
+	void ReleaseBuffers();
+
+	//Chunks holding a vertex of [RowBegin, RowEnd) x [ColumnBegin, ColumnEnd)
+	void FindChunks(int32 RowBegin, int32 RowEnd, int32 ColumnBegin, int32 ColumnEnd, TArray<int32>& Out_Indices) const;
+
+	FORCEINLINE int32 Num() const
+	{
+		return Chunks.Num();
+	}
+
+	FORCEINLINE const FChunk& GetChunk(int32 Index) const
+	{
+		return Chunks[Index];
+	}
+
+private:
+	void BuildChunk(FChunk& Chunk, const TArray<FVector>& Vertices, const TArray<FVector>& Normals,
+		const TArray<FVector2D>& UVs, const TArray<FLinearColor>& VertexColors) const;
+
+};
@@ -0,0 +1,300 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainNoise.h"
+
+TerrainNoise::TerrainNoise()
+{
+}
+
+TerrainNoise::~TerrainNoise()
+{
+}
+
+void TerrainNoise::SetupLayer(ELayer Layer, EFastNoise_NoiseType NoiseType, int32 Seed, float Frequency, EFastNoise_Interp Interp,
+	EFastNoise_FractalType FractalType, int32 Octaves, float Lacunarity, float Gain, float CellularJitter,
+	EFastNoise_CellularDistanceFunction CDF, EFastNoise_CellularReturnType CRT)
+{
+	TerrainNoiseLayer::FSettings Settings;
+	Settings.NoiseType = NoiseType;
+	Settings.Seed = Seed;
+	Settings.Frequency = Frequency;
+	Settings.Interp = Interp;
+	Settings.FractalType = FractalType;
+	Settings.Octaves = Octaves;
+	Settings.Lacunarity = Lacunarity;
+	Settings.Gain = Gain;
+	Settings.CellularJitter = CellularJitter;
+	Settings.CDF = CDF;
+	Settings.CRT = CRT;
+	Layers[(int32)Layer].Setup(Settings);
+}
+
+void TerrainNoise::SetParams(const FParams& InParams)
+{
+	Params = InParams;
+}
+
+void TerrainNoise::SetAltitudeProgram(TerrainNoiseProgram&& InProgram)
+{
+	AltitudeProgram = MoveTemp(InProgram);
+}
+
+void TerrainNoise::ResetAltitudeProgram()
+{
+	AltitudeProgram.Reset();
+}
+
+float TerrainNoise::GetAltitude(float X, float Y, float& Out_RatioStd, float& Out_Ratio) const
+{
+	if (AltitudeProgram.IsValid()) {
+		Out_Ratio = AltitudeProgram.Evaluate(X, Y);
+		Out_RatioStd = Out_Ratio * 0.5 + 0.5;
+		return Out_Ratio * Params.TileAltitudeMultiplier;
+	}
+
+	Out_Ratio = GetRecipeRatio(X, Y);
+	Out_RatioStd = Out_Ratio * 0.5 + 0.5;
+	return Out_Ratio * Params.TileAltitudeMultiplier;
+}
+
+float TerrainNoise::GetRecipeRatio(float X, float Y) const
+{
+	float SX = X * Params.TileNumRowRatio;
+	float SY = Y * Params.TileNumColumnRatio;
+	float WaterValue = Params.HasWater ? Layers[(int32)ELayer::Water].GetNoise(SX, SY) : 0.0;
+	return GetAltitudeRatio(Layers[(int32)ELayer::HighMountain].GetNoise(SX, SY),
+		Layers[(int32)ELayer::LowMountain].GetNoise(SX, SY), WaterValue);
+}
+
+FLinearColor TerrainNoise::GetVertexColor(float RatioStd, float X, float Y) const
+{
+	float SX = X * Params.TileNumRowRatio;
+	float SY = Y * Params.TileNumColumnRatio;
+	float Moisture = GetNoiseStd(Layers[(int32)ELayer::Moisture].GetNoise(SX, SY), 3.0);
+	float Temperature = GetNoiseStd(Layers[(int32)ELayer::Temperature].GetNoise(SX, SY), 3.0);
+	float Biomes = GetNoiseStd(Layers[(int32)ELayer::Biomes].GetNoise(SX, SY), 3.0);
+	return FLinearColor(RatioStd, Moisture, Temperature, Biomes);
+}
+
+float TerrainNoise::GetTreeValue(float X, float Y) const
+{
+	return GetTreeValueFromNoise(Layers[(int32)ELayer::Tree].GetNoise(X, Y));
+}
+
+void TerrainNoise::GetAltitudeBatch(const float* X, const float* Y, int32 Num, float* Out_Z, float* Out_RatioStd) const
+{
+	float Ratios[BatchSize];
+	for (int32 Begin = 0; Begin < Num; Begin += BatchSize)
+	{
+		int32 Count = FMath::Min(BatchSize, Num - Begin);
+		if (AltitudeProgram.IsValid()) {
+			AltitudeProgram.Evaluate(X + Begin, Y + Begin, Count, Ratios);
+		}
+		else {
+			GetRecipeRatioBatch(X + Begin, Y + Begin, Count, Ratios);
+		}
+		for (int32 i = 0; i < Count; i++)
+		{
+			float Ratio = Ratios[i];
+			if (Out_Z != nullptr) {
+				Out_Z[Begin + i] = Ratio * Params.TileAltitudeMultiplier;
+			}
+			if (Out_RatioStd != nullptr) {
+				Out_RatioStd[Begin + i] = Ratio * 0.5 + 0.5;
+			}
+		}
+	}
+}
+
+void TerrainNoise::GetVertexColorBatch(const float* RatioStd, const float* X, const float* Y, int32 Num, FLinearColor* Out_Colors) const
+{
+	float SX[BatchSize];
+	float SY[BatchSize];
+	float Moisture[BatchSize];
+	float Temperature[BatchSize];
+	float Biomes[BatchSize];
+	for (int32 Begin = 0; Begin < Num; Begin += BatchSize)
+	{
+		int32 Count = FMath::Min(BatchSize, Num - Begin);
+		for (int32 i = 0; i < Count; i++)
+		{
+			SX[i] = X[Begin + i] * Params.TileNumRowRatio;
+			SY[i] = Y[Begin + i] * Params.TileNumColumnRatio;
+		}
+		GetLayerBatch(ELayer::Moisture, SX, SY, Count, Moisture);
+		GetLayerBatch(ELayer::Temperature, SX, SY, Count, Temperature);
+		GetLayerBatch(ELayer::Biomes, SX, SY, Count, Biomes);
+		for (int32 i = 0; i < Count; i++)
+		{
+			Out_Colors[Begin + i] = FLinearColor(RatioStd[Begin + i], GetNoiseStd(Moisture[i], 3.0),
+				GetNoiseStd(Temperature[i], 3.0), GetNoiseStd(Biomes[i], 3.0));
+		}
+	}
+}
+
+void TerrainNoise::GetTreeValueBatch(const float* X, const float* Y, int32 Num, float* Out_Values) const
+{
+	//Tree noise is not scaled by the tile ratios
+	GetLayerBatch(ELayer::Tree, X, Y, Num, Out_Values);
+	for (int32 i = 0; i < Num; i++)
+	{
+		Out_Values[i] = GetTreeValueFromNoise(Out_Values[i]);
+	}
+}
+
+void TerrainNoise::GetLayerBatch(ELayer Layer, const float* X, const float* Y, int32 Num, float* Out_Values) const
+{
+	Layers[(int32)Layer].GetBatch(X, Y, Num, Out_Values);
+}
+
+void TerrainNoise::GetRecipeRatioBatch(const float* X, const float* Y, int32 Num, float* Out_Ratios) const
+{
+	float SX[BatchSize];
+	float SY[BatchSize];
+	float High[BatchSize];
+	float Low[BatchSize];
+	float Water[BatchSize];
+	for (int32 Begin = 0; Begin < Num; Begin += BatchSize)
+	{
+		int32 Count = FMath::Min(BatchSize, Num - Begin);
+		for (int32 i = 0; i < Count; i++)
+		{
+			SX[i] = X[Begin + i] * Params.TileNumRowRatio;
+			SY[i] = Y[Begin + i] * Params.TileNumColumnRatio;
+		}
+		GetLayerBatch(ELayer::HighMountain, SX, SY, Count, High);
+		GetLayerBatch(ELayer::LowMountain, SX, SY, Count, Low);
+		if (Params.HasWater) {
+			GetLayerBatch(ELayer::Water, SX, SY, Count, Water);
+		}
+		for (int32 i = 0; i < Count; i++)
+		{
+			Out_Ratios[Begin + i] = GetAltitudeRatio(High[i], Low[i], Params.HasWater ? Water[i] : 0.0f);
+		}
+	}
+}
+
+void TerrainNoise::MakeParitySamples(TArray<float>& Out_X, TArray<float>& Out_Y)
+{
+	const int32 SideNum = 48;
+	Out_X.Reset(SideNum * SideNum);
+	Out_Y.Reset(SideNum * SideNum);
+	for (int32 Row = 0; Row < SideNum; Row++)
+	{
+		for (int32 Column = 0; Column < SideNum; Column++)
+		{
+			Out_X.Add((Row - SideNum / 2) * (Row % 2 == 0 ? 1.0f : 7.31f));
+			Out_Y.Add((Column - SideNum / 2) * (Column % 3 == 0 ? 1.0f : 3.17f));
+		}
+	}
+}
+
+bool TerrainNoise::CheckBatchParity(float Tolerance, float& Out_MaxError) const
+{
+	TArray<float> X;
+	TArray<float> Y;
+	MakeParitySamples(X, Y);
+	int32 Num = X.Num();
+	TArray<float> Batch;
+	Batch.SetNumUninitialized(Num);
+
+	Out_MaxError = 0.0;
+	for (int32 Layer = 0; Layer < (int32)ELayer::Num; Layer++)
+	{
+		GetLayerBatch((ELayer)Layer, X.GetData(), Y.GetData(), Num, Batch.GetData());
+		for (int32 i = 0; i < Num; i++)
+		{
+			Out_MaxError = FMath::Max(Out_MaxError, FMath::Abs(Batch[i] - Layers[Layer].GetNoise(X[i], Y[i])));
+		}
+	}
+
+	//Altitude in ratio units, the multiplier would scale the error. The recipe even with a program,
+	//the program has one path only and CheckProgramParity checks it.
+	GetRecipeRatioBatch(X.GetData(), Y.GetData(), Num, Batch.GetData());
+	for (int32 i = 0; i < Num; i++)
+	{
+		Out_MaxError = FMath::Max(Out_MaxError, FMath::Abs(Batch[i] - GetRecipeRatio(X[i], Y[i])));
+	}
+	return Out_MaxError <= Tolerance;
+}
+
+bool TerrainNoise::CheckProgramParity(const TerrainNoiseProgram& Program, float Tolerance, float& Out_MaxError) const
+{
+	Out_MaxError = MAX_flt;
+	if (!Program.IsValid()) {
+		return false;
+	}
+	TArray<float> X;
+	TArray<float> Y;
+	MakeParitySamples(X, Y);
+	int32 Num = X.Num();
+	TArray<float> Recipe;
+	TArray<float> Compiled;
+	Recipe.SetNumUninitialized(Num);
+	Compiled.SetNumUninitialized(Num);
+	GetRecipeRatioBatch(X.GetData(), Y.GetData(), Num, Recipe.GetData());
+	Program.Evaluate(X.GetData(), Y.GetData(), Num, Compiled.GetData());
+
+	Out_MaxError = 0.0;
+	for (int32 i = 0; i < Num; i++)
+	{
+		Out_MaxError = FMath::Max(Out_MaxError, FMath::Abs(Compiled[i] - Recipe[i]));
+	}
+	return Out_MaxError <= Tolerance;
+}
+
+void TerrainNoise::MappingByLevel(float Level, const FStructHeightMapping& InMapping, FStructHeightMapping& Out_Mapping)
+{
+	Out_Mapping.RangeMin = InMapping.RangeMin + InMapping.RangeMinOffset * Level;
+	Out_Mapping.RangeMax = InMapping.RangeMax + InMapping.RangeMaxOffset * Level;
+	Out_Mapping.MappingMin = InMapping.MappingMin;
+	Out_Mapping.MappingMax = InMapping.MappingMax;
+	Out_Mapping.RangeMinOffset = InMapping.RangeMinOffset;
+	Out_Mapping.RangeMaxOffset = InMapping.RangeMaxOffset;
+}
+
+float TerrainNoise::GetAltitudeRatio(float HighValue, float LowValue, float WaterValue) const
+{
+	float Ratio = MappingFromRangeToRange(HighValue, Params.HighMapping) + MappingFromRangeToRange(LowValue, Params.LowMapping);
+	if (Params.HasWater) {
+		float wRatio = GetWaterRatio(WaterValue);
+		float alpha = 1 - wRatio / Params.WaterBaseRatio;
+		alpha = FMath::Clamp<float>(alpha, 0.0, 1.0);
+		Ratio = wRatio + FMath::Lerp<float>(wRatio, Ratio, alpha);
+	}
+	return Ratio;
+}
+
+float TerrainNoise::GetWaterRatio(float WaterValue) const
+{
+	//Water and water ground map the same sample
+	float ratio = MappingFromRangeToRange(WaterValue, Params.WaterMapping)
+		+ MappingFromRangeToRange(WaterValue, Params.WaterGroundMapping);
+	ratio = ratio > 0.0 ? 0.0 : ratio;
+
+	//cal water bank
+	ratio = FMath::Abs<float>(ratio);
+	float alpha = ratio * Params.WaterBankSharpness;
+	alpha = FMath::Clamp<float>(alpha, 0.0, 1.0);
+	float exp = FMath::Lerp<float>(3.0, 1.0, alpha);
+	return -FMath::Pow(ratio, exp);
+}
+
+float TerrainNoise::GetTreeValueFromNoise(float Value) const
+{
+	Value = (Value - Params.OneMinTAS) / Params.TreeAreaScaleA;
+	return FMath::Clamp<float>(Value, 0.0, 1.0);
+}
+
+float TerrainNoise::GetNoiseStd(float Value, float Scale)
+{
+	Value = FMath::Clamp<float>(Value * Scale, -1.0, 1.0);
+	return (Value + 1) * 0.5;
+}
+
+float TerrainNoise::MappingFromRangeToRange(float InputValue, const FStructHeightMapping& Mapping)
+{
+	float alpha = (Mapping.RangeMax - FMath::Clamp<float>(InputValue, Mapping.RangeMin, Mapping.RangeMax)) / (Mapping.RangeMax - Mapping.RangeMin);
+	return FMath::Lerp<float>(Mapping.MappingMax, Mapping.MappingMin, alpha);
+}
@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "StructDefine.h"
+#include "TerrainNoiseLayer.h"
+#include "TerrainNoiseProgram.h"
+
+#include <FastNoiseWrapper.h>
+
+#include "CoreMinimal.h"
+
+/**
+ * Noise layers of a terrain and their mapping to altitude, vertex colors and tree values, as plain FastNoise.
+ * Nothing changes after setup, so any number of threads sample it at once.
+ * X and Y are vertex coordinates, in tiles from the terrain center.
+ * Batch calls run the vector path of TerrainNoiseLayer, CheckBatchParity compares it with FastNoise.
+ * With an altitude program, a compiled UTerrainNoiseGraph, the altitude comes from it instead of the built-in recipe,
+ * CheckProgramParity compares a program with the batched built-in recipe.
+ */
+class MAPTESTCPP_API TerrainNoise
+{
+public:
+	enum class ELayer : uint8
+	{
+		HighMountain,
+		LowMountain,
+		Water,
+		Moisture,
+		Temperature,
+		Biomes,
+		Tree,
+		Num
+	};
+
+	//Terrain params the sampling reads, height mappings already shifted by their level
+	struct FParams
+	{
+		float TileNumRowRatio = 1.0;
+		float TileNumColumnRatio = 1.0;
+		float TileAltitudeMultiplier = 100.0;
+		FStructHeightMapping HighMapping;
+		FStructHeightMapping LowMapping;
+		bool HasWater = false;
+		FStructHeightMapping WaterMapping;
+		FStructHeightMapping WaterGroundMapping;
+		float WaterBaseRatio = -0.005;
+		float WaterBankSharpness = 50.0;
+		float TreeAreaScaleA = 1.0;
+		float OneMinTAS = 0.0;
+	};
+
+	//Samples per block of a batch call, scratch buffers of this size live on the stack
+	static constexpr int32 BatchSize = 256;
+
+private:
+	TerrainNoiseLayer Layers[(int32)ELayer::Num];
+	TerrainNoiseProgram AltitudeProgram;
+	FParams Params;
+
+public:
+	TerrainNoise();
+	~TerrainNoise();
+	TerrainNoise(const TerrainNoise&) = delete;
+	TerrainNoise& operator=(const TerrainNoise&) = delete;
+
+	//Game thread, the same params as UFastNoiseWrapper::SetupFastNoise
+	void SetupLayer(ELayer Layer, EFastNoise_NoiseType NoiseType, int32 Seed, float Frequency, EFastNoise_Interp Interp,
+		EFastNoise_FractalType FractalType, int32 Octaves, float Lacunarity, float Gain, float CellularJitter,
+		EFastNoise_CellularDistanceFunction CDF, EFastNoise_CellularReturnType CRT);
+	void SetParams(const FParams& InParams);
+	//Game thread, replaces the high, low and water layers of the altitude
+	void SetAltitudeProgram(TerrainNoiseProgram&& InProgram);
+	void ResetAltitudeProgram();
+
+	float GetAltitude(float X, float Y, float& Out_RatioStd, float& Out_Ratio) const;
+	//R altitude, G moisture, B temperature, A biomes
+	FLinearColor GetVertexColor(float RatioStd, float X, float Y) const;
+	float GetTreeValue(float X, float Y) const;
+
+	//Batch versions of the above, any Num, outputs may be nullptr when not needed
+	void GetAltitudeBatch(const float* X, const float* Y, int32 Num, float* Out_Z, float* Out_RatioStd) const;
+	void GetVertexColorBatch(const float* RatioStd, const float* X, const float* Y, int32 Num, FLinearColor* Out_Colors) const;
+	void GetTreeValueBatch(const float* X, const float* Y, int32 Num, float* Out_Values) const;
+	//FastNoise::GetNoise of one layer, X and Y already in noise space
+	void GetLayerBatch(ELayer Layer, const float* X, const float* Y, int32 Num, float* Out_Values) const;
+	//Altitude ratio of the built-in recipe even with an altitude program, any Num
+	void GetRecipeRatioBatch(const float* X, const float* Y, int32 Num, float* Out_Ratios) const;
+
+	//Every layer and the built-in altitude of both paths on a fixed set of samples, false when one differs by more than Tolerance
+	bool CheckBatchParity(float Tolerance, float& Out_MaxError) const;
+	//Program against the batched built-in recipe on the same samples, in altitude ratio units
+	bool CheckProgramParity(const TerrainNoiseProgram& Program, float Tolerance, float& Out_MaxError) const;
+
+	FORCEINLINE const FParams& GetParams() const
+	{
+		return Params;
+	}
+
+	FORCEINLINE const TerrainNoiseProgram& GetAltitudeProgram() const
+	{
+		return AltitudeProgram;
+	}
+
+	static void MappingByLevel(float Level, const FStructHeightMapping& InMapping, FStructHeightMapping& Out_Mapping);
+
+private:
+	float GetRecipeRatio(float X, float Y) const;
+	//Fractional, integer and negative coords, integers hit the FastFloor edge case
+	static void MakeParitySamples(TArray<float>& Out_X, TArray<float>& Out_Y);
+	//Both paths map raw layer values the same way
+	float GetAltitudeRatio(float HighValue, float LowValue, float WaterValue) const;
+	float GetWaterRatio(float WaterValue) const;
+	float GetTreeValueFromNoise(float Value) const;
+	static float GetNoiseStd(float Value, float Scale);
+	static float MappingFromRangeToRange(float InputValue, const FStructHeightMapping& Mapping);
+
+};
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainNoiseGraph.h"
+
+void UTerrainNoiseGraph::ResetToDefaultRecipe()
+{
+	using EOp = Enum_NoiseGraphOp;
+	Modify();
+	Nodes.Reset();
+
+	auto AddNoise = [this](EFastNoise_FractalType FractalType, int32 Octaves, float Frequency) {
+		FStructNoiseGraphNode Node;
+		Node.Op = EOp::Noise;
+		Node.FractalType = FractalType;
+		Node.Octaves = Octaves;
+		Node.NoiseFrequency = Frequency;
+		return AddNode(Node);
+	};
+	auto AddRemap = [this](int32 Input, const FStructHeightMapping& Mapping, float Level) {
+		FStructNoiseGraphNode Node;
+		Node.Op = EOp::Remap;
+		Node.Inputs = { Input };
+		Node.Mapping = Mapping;
+		Node.Level = Level;
+		return AddNode(Node);
+	};
+	auto AddClamp = [this](int32 Input, float Min, float Max) {
+		FStructNoiseGraphNode Node;
+		Node.Op = EOp::Clamp;
+		Node.Inputs = { Input };
+		Node.ClampMin = Min;
+		Node.ClampMax = Max;
+		return AddNode(Node);
+	};
+
+	//High and low mountains
+	int32 High = AddRemap(AddNoise(EFastNoise_FractalType::RigidMulti, 6, 0.005), { 0.4, 0.6, 0.0, 0.7, -0.2, -0.2 }, 0.5);
+	int32 Low = AddRemap(AddNoise(EFastNoise_FractalType::RigidMulti, 6, 0.01), { 0.5, 1.0, 0.0, 0.3, -0.4, 0.0 }, 0.5);
+	int32 Land = AddOp(EOp::Add, { High, Low });
+
+	//Water below zero, its bank sharpened by WaterBankSharpness 50
+	int32 WaterNoise = AddNoise(EFastNoise_FractalType::FBM, 2, 0.01);
+	int32 Water = AddOp(EOp::Add, { AddRemap(WaterNoise, { -0.6, -0.4, -0.4, -0.1, 0.2, 0.2 }, 0.5),
+		AddRemap(WaterNoise, { -0.4, 1.0, 0.1, 0.2, 0.2, 0.0 }, 0.5) });
+	int32 Depth = AddOp(EOp::Abs, { AddOp(EOp::Min, { Water, AddConstant(0.0) }) });
+	int32 BankAlpha = AddClamp(AddOp(EOp::Multiply, { Depth, AddConstant(50.0) }), 0.0, 1.0);
+	int32 BankExp = AddOp(EOp::Blend, { AddConstant(3.0), AddConstant(1.0), BankAlpha });
+	int32 WaterRatio = AddOp(EOp::Negate, { AddOp(EOp::Pow, { Depth, BankExp }) });
+
+	//Land fades into water above WaterBaseRatio -0.005
+	int32 LandAlpha = AddClamp(AddOp(EOp::Subtract, { AddConstant(1.0), AddOp(EOp::Divide, { WaterRatio, AddConstant(-0.005) }) }), 0.0, 1.0);
+	AddOp(EOp::Add, { WaterRatio, AddOp(EOp::Blend, { WaterRatio, Land, LandAlpha }) });
+	OutputNode = -1;
+}
+
+int32 UTerrainNoiseGraph::AddNode(const FStructNoiseGraphNode& Node)
+{
+	return Nodes.Add(Node);
+}
+
+int32 UTerrainNoiseGraph::AddConstant(float Value)
+{
+	FStructNoiseGraphNode Node;
+	Node.Op = Enum_NoiseGraphOp::Constant;
+	Node.Value = Value;
+	return AddNode(Node);
+}
+
+int32 UTerrainNoiseGraph::AddOp(Enum_NoiseGraphOp Op, const TArray<int32>& Inputs)
+{
+	FStructNoiseGraphNode Node;
+	Node.Op = Op;
+	Node.Inputs = Inputs;
+	return AddNode(Node);
+}
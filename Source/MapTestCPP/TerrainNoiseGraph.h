@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "StructDefine.h"
+
+#include <FastNoiseWrapper.h>
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "TerrainNoiseGraph.generated.h"
+
+UENUM(BlueprintType)
+enum class Enum_NoiseGraphOp : uint8
+{
+	//Value
+	Constant,
+	//Noise at the sample position
+	Noise,
+	//Input through Mapping shifted by Level, like the terrain height layers
+	Remap,
+	Add,
+	Subtract,
+	Multiply,
+	Divide,
+	Min,
+	Max,
+	//Lerp from input 0 to input 1 by input 2
+	Blend,
+	//Input clamped to ClampMin and ClampMax
+	Clamp,
+	Abs,
+	Negate,
+	//Input 0 to the power of input 1
+	Pow
+};
+
+USTRUCT(BlueprintType)
+struct FStructNoiseGraphNode
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	Enum_NoiseGraphOp Op = Enum_NoiseGraphOp::Constant;
+
+	//Indices of earlier nodes, as many as the op reads
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<int32> Inputs;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (EditCondition = "Op == Enum_NoiseGraphOp::Constant", EditConditionHides))
+	float Value = 0.0;
+
+	//Noise, the params of UFastNoiseWrapper::SetupFastNoise
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	EFastNoise_NoiseType NoiseType = EFastNoise_NoiseType::PerlinFractal;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	int32 NoiseSeed = 0;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides, ClampMin = "0.0"))
+	float NoiseFrequency = 0.01;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	EFastNoise_Interp Interp = EFastNoise_Interp::Quintic;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	EFastNoise_FractalType FractalType = EFastNoise_FractalType::FBM;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides, ClampMin = "1"))
+	int32 Octaves = 3;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	float Lacunarity = 2.0;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	float Gain = 0.5;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	float CellularJitter = 0.45;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	EFastNoise_CellularDistanceFunction CDF = EFastNoise_CellularDistanceFunction::Euclidean;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	EFastNoise_CellularReturnType CRT = EFastNoise_CellularReturnType::CellValue;
+	//Position scaled by the StdNumRows / NumRows ratios like the height layers, off for a fixed scale like the trees
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Noise", EditConditionHides))
+	bool bScaleByTileRatio = true;
+
+	//Remap
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Remap", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Remap", EditConditionHides))
+	FStructHeightMapping Mapping = { -1.0, 1.0, -1.0, 1.0, 0.0, 0.0 };
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Remap", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Remap", EditConditionHides, ClampMin = "0.0", ClampMax = "1.0"))
+	float Level = 0.5;
+
+	//Clamp
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Clamp", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Clamp", EditConditionHides))
+	float ClampMin = 0.0;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Clamp", meta = (EditCondition = "Op == Enum_NoiseGraphOp::Clamp", EditConditionHides))
+	float ClampMax = 1.0;
+
+};
+
+/**
+ * Terrain altitude recipe as a graph of noise, remap, blend and clamp nodes, a terrain type without code.
+ * The output is the altitude ratio, about -1 to 1, ATerrain scales it by its altitude multiplier.
+ * ATerrain compiles it with TerrainNoiseProgram at init.
+ */
+UCLASS(BlueprintType)
+class MAPTESTCPP_API UTerrainNoiseGraph : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	//A node reads only earlier nodes, so the array order is an evaluation order
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Graph")
+	TArray<FStructNoiseGraphNode> Nodes;
+
+	//Node giving the altitude ratio, the last node when -1
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Graph", meta = (ClampMin = "-1"))
+	int32 OutputNode = -1;
+
+public:
+	//Nodes of the built-in recipe with water and the ATerrain default params, a starting point for new types
+	UFUNCTION(CallInEditor, Category = "Graph")
+	void ResetToDefaultRecipe();
+
+private:
+	int32 AddNode(const FStructNoiseGraphNode& Node);
+	int32 AddConstant(float Value);
+	int32 AddOp(Enum_NoiseGraphOp Op, const TArray<int32>& Inputs);
+
+};
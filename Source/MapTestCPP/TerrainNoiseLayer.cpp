@@ -0,0 +1,209 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainNoiseLayer.h"
+
+#include <random>
+
+//FastNoise 2D gradients by perm12 value
+static const float GradX[] = { 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0 };
+static const float GradY[] = { 1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1 };
+
+TerrainNoiseLayer::TerrainNoiseLayer()
+{
+}
+
+TerrainNoiseLayer::~TerrainNoiseLayer()
+{
+}
+
+void TerrainNoiseLayer::Setup(const FSettings& InSettings)
+{
+	Settings = InSettings;
+
+	//The plugin enums list the FastNoise values in the same order
+	Noise.SetNoiseType(static_cast<FastNoise::NoiseType>(Settings.NoiseType));
+	Noise.SetSeed(Settings.Seed);
+	Noise.SetFrequency(Settings.Frequency);
+	Noise.SetInterp(static_cast<FastNoise::Interp>(Settings.Interp));
+	Noise.SetFractalType(static_cast<FastNoise::FractalType>(Settings.FractalType));
+	Noise.SetFractalOctaves(Settings.Octaves);
+	Noise.SetFractalLacunarity(Settings.Lacunarity);
+	Noise.SetFractalGain(Settings.Gain);
+	Noise.SetCellularJitter(Settings.CellularJitter);
+	Noise.SetCellularDistanceFunction(static_cast<FastNoise::CellularDistanceFunction>(Settings.CDF));
+	Noise.SetCellularReturnType(static_cast<FastNoise::CellularReturnType>(Settings.CRT));
+
+	bVectorized = Settings.NoiseType == EFastNoise_NoiseType::Perlin || Settings.NoiseType == EFastNoise_NoiseType::PerlinFractal;
+
+	//FastNoise::SetSeed
+	std::mt19937_64 Gen(Settings.Seed);
+	for (int32 i = 0; i < 256; i++)
+	{
+		Perm[i] = (uint8)i;
+	}
+	for (int32 j = 0; j < 256; j++)
+	{
+		int32 k = (int32)(Gen() % (256 - j)) + j;
+		uint8 l = Perm[j];
+		Perm[j] = Perm[j + 256] = Perm[k];
+		Perm[k] = l;
+		Perm12[j] = Perm12[j + 256] = Perm[j] % 12;
+	}
+
+	//FastNoise::CalculateFractalBounding
+	float Amp = Settings.Gain;
+	float AmpFractal = 1.0;
+	for (int32 i = 1; i < Settings.Octaves; i++)
+	{
+		AmpFractal += Amp;
+		Amp *= Settings.Gain;
+	}
+	FractalBounding = 1.0 / AmpFractal;
+}
+
+//FastNoise::InterpHermiteFunc and InterpQuinticFunc
+static FORCEINLINE VectorRegister4Float Interp4(EFastNoise_Interp Interp, const VectorRegister4Float& T)
+{
+	switch (Interp)
+	{
+	case EFastNoise_Interp::Hermite:
+		return VectorMultiply(VectorMultiply(T, T), VectorSubtract(VectorSetFloat1(3.0f), VectorMultiply(VectorSetFloat1(2.0f), T)));
+	case EFastNoise_Interp::Quintic:
+		return VectorMultiply(VectorMultiply(VectorMultiply(T, T), T), VectorAdd(VectorMultiply(T,
+			VectorSubtract(VectorMultiply(T, VectorSetFloat1(6.0f)), VectorSetFloat1(15.0f))), VectorSetFloat1(10.0f)));
+	default:
+		return T;
+	}
+}
+
+//FastNoise::Lerp
+static FORCEINLINE VectorRegister4Float Lerp4(const VectorRegister4Float& A, const VectorRegister4Float& B, const VectorRegister4Float& T)
+{
+	return VectorAdd(A, VectorMultiply(T, VectorSubtract(B, A)));
+}
+
+//FastNoise::SinglePerlin for 4 samples, the gradient lookups per lane, the rest in vector registers
+static VectorRegister4Float SinglePerlin4(const uint8* Perm, const uint8* Perm12, EFastNoise_Interp Interp, uint8 Offset,
+	const VectorRegister4Float& X, const VectorRegister4Float& Y)
+{
+	//FastNoise::FastFloor, (int)f - 1 for every negative f, the compare mask is -1 per true lane
+	VectorRegister4Float Zero = VectorZeroFloat();
+	VectorRegister4Int X0 = VectorIntAdd(VectorFloatToInt(X), VectorCast4FloatTo4Int(VectorCompareLT(X, Zero)));
+	VectorRegister4Int Y0 = VectorIntAdd(VectorFloatToInt(Y), VectorCast4FloatTo4Int(VectorCompareLT(Y, Zero)));
+
+	VectorRegister4Float XD0 = VectorSubtract(X, VectorIntToFloat(X0));
+	VectorRegister4Float YD0 = VectorSubtract(Y, VectorIntToFloat(Y0));
+	VectorRegister4Float XD1 = VectorSubtract(XD0, VectorOneFloat());
+	VectorRegister4Float YD1 = VectorSubtract(YD0, VectorOneFloat());
+	VectorRegister4Float XS = Interp4(Interp, XD0);
+	VectorRegister4Float YS = Interp4(Interp, YD0);
+
+	//Corners 00, 10, 01, 11
+	alignas(16) int32 XI[4];
+	alignas(16) int32 YI[4];
+	alignas(16) float GX[4][4];
+	alignas(16) float GY[4][4];
+	VectorIntStoreAligned(X0, XI);
+	VectorIntStoreAligned(Y0, YI);
+	for (int32 Lane = 0; Lane < 4; Lane++)
+	{
+		int32 Row0 = Perm[(YI[Lane] & 0xff) + Offset];
+		int32 Row1 = Perm[((YI[Lane] + 1) & 0xff) + Offset];
+		int32 Column0 = XI[Lane] & 0xff;
+		int32 Column1 = (XI[Lane] + 1) & 0xff;
+		uint8 Lut[4] = { Perm12[Column0 + Row0], Perm12[Column1 + Row0], Perm12[Column0 + Row1], Perm12[Column1 + Row1] };
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			GX[Corner][Lane] = GradX[Lut[Corner]];
+			GY[Corner][Lane] = GradY[Lut[Corner]];
+		}
+	}
+
+	VectorRegister4Float G00 = VectorAdd(VectorMultiply(XD0, VectorLoadAligned(GX[0])), VectorMultiply(YD0, VectorLoadAligned(GY[0])));
+	VectorRegister4Float G10 = VectorAdd(VectorMultiply(XD1, VectorLoadAligned(GX[1])), VectorMultiply(YD0, VectorLoadAligned(GY[1])));
+	VectorRegister4Float G01 = VectorAdd(VectorMultiply(XD0, VectorLoadAligned(GX[2])), VectorMultiply(YD1, VectorLoadAligned(GY[2])));
+	VectorRegister4Float G11 = VectorAdd(VectorMultiply(XD1, VectorLoadAligned(GX[3])), VectorMultiply(YD1, VectorLoadAligned(GY[3])));
+	return Lerp4(Lerp4(G00, G10, XS), Lerp4(G01, G11, XS), YS);
+}
+
+void TerrainNoiseLayer::GetBatch(const float* X, const float* Y, int32 Num, float* Out_Values) const
+{
+	if (!bVectorized) {
+		for (int32 i = 0; i < Num; i++)
+		{
+			Out_Values[i] = Noise.GetNoise(X[i], Y[i]);
+		}
+		return;
+	}
+
+	VectorRegister4Float Frequency = VectorSetFloat1(Settings.Frequency);
+	VectorRegister4Float Lacunarity = VectorSetFloat1(Settings.Lacunarity);
+	VectorRegister4Float One = VectorOneFloat();
+	VectorRegister4Float Two = VectorSetFloat1(2.0f);
+	for (int32 Begin = 0; Begin < Num; Begin += 4)
+	{
+		//The tail group is padded with its last sample
+		alignas(16) float LaneX[4];
+		alignas(16) float LaneY[4];
+		alignas(16) float LaneOut[4];
+		int32 Count = FMath::Min(4, Num - Begin);
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			LaneX[Lane] = X[Begin + FMath::Min(Lane, Count - 1)];
+			LaneY[Lane] = Y[Begin + FMath::Min(Lane, Count - 1)];
+		}
+		VectorRegister4Float VX = VectorMultiply(VectorLoadAligned(LaneX), Frequency);
+		VectorRegister4Float VY = VectorMultiply(VectorLoadAligned(LaneY), Frequency);
+
+		//FastNoise::SinglePerlinFractalFBM, Billow and RigidMulti
+		VectorRegister4Float Sum;
+		if (Settings.NoiseType == EFastNoise_NoiseType::Perlin) {
+			Sum = SinglePerlin4(Perm, Perm12, Settings.Interp, 0, VX, VY);
+		}
+		else {
+			VectorRegister4Float Value = SinglePerlin4(Perm, Perm12, Settings.Interp, Perm[0], VX, VY);
+			switch (Settings.FractalType)
+			{
+			case EFastNoise_FractalType::Billow:
+				Sum = VectorSubtract(VectorMultiply(VectorAbs(Value), Two), One);
+				break;
+			case EFastNoise_FractalType::RigidMulti:
+				Sum = VectorSubtract(One, VectorAbs(Value));
+				break;
+			default:
+				Sum = Value;
+				break;
+			}
+			float Amp = 1.0;
+			for (int32 i = 1; i < Settings.Octaves; i++)
+			{
+				VX = VectorMultiply(VX, Lacunarity);
+				VY = VectorMultiply(VY, Lacunarity);
+				Amp *= Settings.Gain;
+				Value = SinglePerlin4(Perm, Perm12, Settings.Interp, Perm[i], VX, VY);
+				switch (Settings.FractalType)
+				{
+				case EFastNoise_FractalType::Billow:
+					Sum = VectorAdd(Sum, VectorMultiply(VectorSubtract(VectorMultiply(VectorAbs(Value), Two), One), VectorSetFloat1(Amp)));
+					break;
+				case EFastNoise_FractalType::RigidMulti:
+					Sum = VectorSubtract(Sum, VectorMultiply(VectorSubtract(One, VectorAbs(Value)), VectorSetFloat1(Amp)));
+					break;
+				default:
+					Sum = VectorAdd(Sum, VectorMultiply(Value, VectorSetFloat1(Amp)));
+					break;
+				}
+			}
+			if (Settings.FractalType != EFastNoise_FractalType::RigidMulti) {
+				Sum = VectorMultiply(Sum, VectorSetFloat1(FractalBounding));
+			}
+		}
+
+		VectorStoreAligned(Sum, LaneOut);
+		for (int32 Lane = 0; Lane < Count; Lane++)
+		{
+			Out_Values[Begin + Lane] = LaneOut[Lane];
+		}
+	}
+}
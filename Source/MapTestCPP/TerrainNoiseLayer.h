@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <FastNoiseWrapper.h>
+
+#include "CoreMinimal.h"
+
+/**
+ * One FastNoise 2D noise with a batch path. Perlin and PerlinFractal (FBM, Billow and RigidMulti) are evaluated
+ * 4 samples at a time in vector registers with the FastNoise operations in the same order, other noise types
+ * fall back to FastNoise per sample. Read only after Setup, safe from any number of threads.
+ */
+class MAPTESTCPP_API TerrainNoiseLayer
+{
+public:
+	//The params of UFastNoiseWrapper::SetupFastNoise
+	struct FSettings
+	{
+		EFastNoise_NoiseType NoiseType = EFastNoise_NoiseType::PerlinFractal;
+		int32 Seed = 0;
+		float Frequency = 0.01;
+		EFastNoise_Interp Interp = EFastNoise_Interp::Quintic;
+		EFastNoise_FractalType FractalType = EFastNoise_FractalType::FBM;
+		int32 Octaves = 3;
+		float Lacunarity = 2.0;
+		float Gain = 0.5;
+		float CellularJitter = 0.45;
+		EFastNoise_CellularDistanceFunction CDF = EFastNoise_CellularDistanceFunction::Euclidean;
+		EFastNoise_CellularReturnType CRT = EFastNoise_CellularReturnType::CellValue;
+	};
+
+private:
+	FastNoise Noise;
+	FSettings Settings;
+
+	//What the vector path needs, the perm tables are built from the seed as FastNoise does
+	uint8 Perm[512];
+	uint8 Perm12[512];
+	float FractalBounding = 1.0;
+	bool bVectorized = false;
+
+public:
+	TerrainNoiseLayer();
+	~TerrainNoiseLayer();
+	TerrainNoiseLayer(const TerrainNoiseLayer&) = default;
+	TerrainNoiseLayer(TerrainNoiseLayer&&) = default;
+	TerrainNoiseLayer& operator=(const TerrainNoiseLayer&) = default;
+	TerrainNoiseLayer& operator=(TerrainNoiseLayer&&) = default;
+
+	void Setup(const FSettings& InSettings);
+
+	//FastNoise::GetNoise, X and Y before the frequency
+	FORCEINLINE float GetNoise(float X, float Y) const
+	{
+		return Noise.GetNoise(X, Y);
+	}
+
+	void GetBatch(const float* X, const float* Y, int32 Num, float* Out_Values) const;
+
+	FORCEINLINE const FSettings& GetSettings() const
+	{
+		return Settings;
+	}
+
+};
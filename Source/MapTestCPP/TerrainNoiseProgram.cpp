@@ -0,0 +1,412 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainNoiseProgram.h"
+#include "TerrainNoiseGraph.h"
+#include "TerrainNoise.h"
+#include "HexGridBakedCache.h"
+
+TerrainNoiseProgram::TerrainNoiseProgram()
+{
+}
+
+TerrainNoiseProgram::~TerrainNoiseProgram()
+{
+}
+
+//Inputs each graph op reads
+static int32 GetNodeArity(Enum_NoiseGraphOp Op)
+{
+	switch (Op)
+	{
+	case Enum_NoiseGraphOp::Constant:
+	case Enum_NoiseGraphOp::Noise:
+		return 0;
+	case Enum_NoiseGraphOp::Remap:
+	case Enum_NoiseGraphOp::Clamp:
+	case Enum_NoiseGraphOp::Abs:
+	case Enum_NoiseGraphOp::Negate:
+		return 1;
+	case Enum_NoiseGraphOp::Blend:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+//The same math as the built-in recipe, FMath::Lerp and FMath::Pow
+static FORCEINLINE float ApplyBinary(Enum_NoiseGraphOp Op, float A, float B)
+{
+	switch (Op)
+	{
+	case Enum_NoiseGraphOp::Add:
+		return A + B;
+	case Enum_NoiseGraphOp::Subtract:
+		return A - B;
+	case Enum_NoiseGraphOp::Multiply:
+		return A * B;
+	case Enum_NoiseGraphOp::Divide:
+		return A / B;
+	case Enum_NoiseGraphOp::Min:
+		return FMath::Min(A, B);
+	case Enum_NoiseGraphOp::Max:
+		return FMath::Max(A, B);
+	default:
+		return FMath::Pow(A, B);
+	}
+}
+
+bool TerrainNoiseProgram::Compile(const UTerrainNoiseGraph& Graph, int32 SeedOffset, float InRowRatio, float InColumnRatio,
+	FString& Out_Error)
+{
+	using EGraphOp = Enum_NoiseGraphOp;
+	Reset();
+	RowRatio = InRowRatio;
+	ColumnRatio = InColumnRatio;
+
+	const TArray<FStructNoiseGraphNode>& Nodes = Graph.Nodes;
+	int32 NodeNum = Nodes.Num();
+	int32 OutputNode = Graph.OutputNode < 0 ? NodeNum - 1 : Graph.OutputNode;
+	if (!Nodes.IsValidIndex(OutputNode)) {
+		Out_Error = FString::Printf(TEXT("Output node %d of %d nodes."), OutputNode, NodeNum);
+		return false;
+	}
+	for (int32 i = 0; i < NodeNum; i++)
+	{
+		const FStructNoiseGraphNode& Node = Nodes[i];
+		if (Node.Inputs.Num() != GetNodeArity(Node.Op)) {
+			Out_Error = FString::Printf(TEXT("Node %d %s reads %d inputs, not %d."), i,
+				*StaticEnum<EGraphOp>()->GetNameStringByValue((int64)Node.Op), Node.Inputs.Num(), GetNodeArity(Node.Op));
+			return false;
+		}
+		for (int32 Input : Node.Inputs)
+		{
+			if (Input < 0 || Input >= i) {
+				Out_Error = FString::Printf(TEXT("Node %d reads node %d, only earlier nodes can be read."), i, Input);
+				return false;
+			}
+		}
+		if (Node.Op == EGraphOp::Remap) {
+			FStructHeightMapping Mapping;
+			TerrainNoise::MappingByLevel(Node.Level, Node.Mapping, Mapping);
+			if (Mapping.RangeMax <= Mapping.RangeMin) {
+				Out_Error = FString::Printf(TEXT("Node %d maps an empty range %g to %g."), i, Mapping.RangeMin, Mapping.RangeMax);
+				return false;
+			}
+		}
+	}
+
+	//Fold in node order, inputs are always folded before their readers
+	TArray<bool> IsConstant;
+	TArray<float> Constants;
+	IsConstant.Init(false, NodeNum);
+	Constants.Init(0.0, NodeNum);
+	for (int32 i = 0; i < NodeNum; i++)
+	{
+		const FStructNoiseGraphNode& Node = Nodes[i];
+		if (Node.Op == EGraphOp::Constant) {
+			IsConstant[i] = true;
+			Constants[i] = Node.Value;
+			continue;
+		}
+		if (Node.Op == EGraphOp::Noise) {
+			continue;
+		}
+		bool AllConstant = true;
+		for (int32 Input : Node.Inputs)
+		{
+			AllConstant &= IsConstant[Input];
+		}
+		if (!AllConstant) {
+			continue;
+		}
+		float A = Constants[Node.Inputs[0]];
+		float Value;
+		switch (Node.Op)
+		{
+		case EGraphOp::Remap: {
+			FStructHeightMapping Mapping;
+			TerrainNoise::MappingByLevel(Node.Level, Node.Mapping, Mapping);
+			float Alpha = (Mapping.RangeMax - FMath::Clamp<float>(A, Mapping.RangeMin, Mapping.RangeMax)) / (Mapping.RangeMax - Mapping.RangeMin);
+			Value = FMath::Lerp<float>(Mapping.MappingMax, Mapping.MappingMin, Alpha);
+			break;
+		}
+		case EGraphOp::Blend:
+			Value = FMath::Lerp<float>(A, Constants[Node.Inputs[1]], Constants[Node.Inputs[2]]);
+			break;
+		case EGraphOp::Clamp:
+			Value = FMath::Clamp<float>(A, Node.ClampMin, Node.ClampMax);
+			break;
+		case EGraphOp::Abs:
+			Value = FMath::Abs(A);
+			break;
+		case EGraphOp::Negate:
+			Value = -A;
+			break;
+		default:
+			Value = ApplyBinary(Node.Op, A, Constants[Node.Inputs[1]]);
+			break;
+		}
+		IsConstant[i] = true;
+		Constants[i] = Value;
+	}
+
+	//Emitted, the output and whatever a non constant emitted node reads, folded inputs become fills
+	TArray<bool> Emitted;
+	TArray<int32> LastReader;
+	Emitted.Init(false, NodeNum);
+	LastReader.Init(INDEX_NONE, NodeNum);
+	Emitted[OutputNode] = true;
+	LastReader[OutputNode] = NodeNum;
+	for (int32 i = OutputNode; i >= 0; i--)
+	{
+		if (!Emitted[i] || IsConstant[i]) {
+			continue;
+		}
+		for (int32 Input : Nodes[i].Inputs)
+		{
+			Emitted[Input] = true;
+			LastReader[Input] = FMath::Max(LastReader[Input], i);
+		}
+	}
+
+	//Registers of a node are free again once its last reader is emitted, the reader may write to them
+	TArray<int32> Registers;
+	TArray<uint8> FreeRegisters;
+	Registers.Init(INDEX_NONE, NodeNum);
+	int32 RegisterNum = 0;
+	for (int32 i = 0; i <= OutputNode; i++)
+	{
+		if (!Emitted[i]) {
+			continue;
+		}
+		const FStructNoiseGraphNode& Node = Nodes[i];
+		FInstruction& Instruction = Instructions.AddDefaulted_GetRef();
+		if (IsConstant[i]) {
+			Instruction.Op = EOp::Fill;
+			Instruction.Params[0] = Constants[i];
+		}
+		else {
+			uint8* Operands[3] = { &Instruction.A, &Instruction.B, &Instruction.C };
+			for (int32 j = 0; j < Node.Inputs.Num(); j++)
+			{
+				*Operands[j] = (uint8)Registers[Node.Inputs[j]];
+			}
+			for (int32 j = 0; j < Node.Inputs.Num(); j++)
+			{
+				int32 Input = Node.Inputs[j];
+				if (LastReader[Input] == i && Registers[Input] != INDEX_NONE) {
+					FreeRegisters.Add((uint8)Registers[Input]);
+					Registers[Input] = INDEX_NONE;
+				}
+			}
+			switch (Node.Op)
+			{
+			case EGraphOp::Noise: {
+				TerrainNoiseLayer::FSettings Settings;
+				Settings.NoiseType = Node.NoiseType;
+				Settings.Seed = Node.NoiseSeed + SeedOffset;
+				Settings.Frequency = Node.NoiseFrequency;
+				Settings.Interp = Node.Interp;
+				Settings.FractalType = Node.FractalType;
+				Settings.Octaves = Node.Octaves;
+				Settings.Lacunarity = Node.Lacunarity;
+				Settings.Gain = Node.Gain;
+				Settings.CellularJitter = Node.CellularJitter;
+				Settings.CDF = Node.CDF;
+				Settings.CRT = Node.CRT;
+				Instruction.Op = EOp::Noise;
+				Instruction.Layer = Layers.AddDefaulted();
+				Layers[Instruction.Layer].Setup(Settings);
+				Instruction.bScaled = Node.bScaleByTileRatio;
+				break;
+			}
+			case EGraphOp::Remap: {
+				//Lerp(MappingMax, MappingMin, (RangeMax - v) / (RangeMax - RangeMin)) as Offset + v * Scale
+				FStructHeightMapping Mapping;
+				TerrainNoise::MappingByLevel(Node.Level, Node.Mapping, Mapping);
+				float K = (Mapping.MappingMin - Mapping.MappingMax) / (Mapping.RangeMax - Mapping.RangeMin);
+				Instruction.Op = EOp::Remap;
+				Instruction.Params[0] = Mapping.RangeMin;
+				Instruction.Params[1] = Mapping.RangeMax;
+				Instruction.Params[2] = Mapping.MappingMax + Mapping.RangeMax * K;
+				Instruction.Params[3] = -K;
+				break;
+			}
+			case EGraphOp::Clamp:
+				Instruction.Op = EOp::Clamp;
+				Instruction.Params[0] = Node.ClampMin;
+				Instruction.Params[1] = Node.ClampMax;
+				break;
+			case EGraphOp::Add:
+				Instruction.Op = EOp::Add;
+				break;
+			case EGraphOp::Subtract:
+				Instruction.Op = EOp::Subtract;
+				break;
+			case EGraphOp::Multiply:
+				Instruction.Op = EOp::Multiply;
+				break;
+			case EGraphOp::Divide:
+				Instruction.Op = EOp::Divide;
+				break;
+			case EGraphOp::Min:
+				Instruction.Op = EOp::Min;
+				break;
+			case EGraphOp::Max:
+				Instruction.Op = EOp::Max;
+				break;
+			case EGraphOp::Blend:
+				Instruction.Op = EOp::Blend;
+				break;
+			case EGraphOp::Abs:
+				Instruction.Op = EOp::Abs;
+				break;
+			case EGraphOp::Negate:
+				Instruction.Op = EOp::Negate;
+				break;
+			default:
+				Instruction.Op = EOp::Pow;
+				break;
+			}
+		}
+
+		if (FreeRegisters.Num() > 0) {
+			Registers[i] = FreeRegisters.Pop(EAllowShrinking::No);
+		}
+		else {
+			Registers[i] = RegisterNum++;
+		}
+		if (RegisterNum > MaxRegisters) {
+			Out_Error = FString::Printf(TEXT("Graph needs more than %d live values at once."), MaxRegisters);
+			Reset();
+			return false;
+		}
+		Instruction.Dest = (uint8)Registers[i];
+	}
+	OutputRegister = Registers[OutputNode];
+	return true;
+}
+
+void TerrainNoiseProgram::Reset()
+{
+	Instructions.Reset();
+	Layers.Reset();
+	OutputRegister = INDEX_NONE;
+}
+
+void TerrainNoiseProgram::Evaluate(const float* X, const float* Y, int32 Num, float* Out_Values) const
+{
+	check(IsValid());
+	float Registers[MaxRegisters][BlockSize];
+	float SX[BlockSize];
+	float SY[BlockSize];
+	for (int32 Begin = 0; Begin < Num; Begin += BlockSize)
+	{
+		int32 Count = FMath::Min(BlockSize, Num - Begin);
+		for (int32 i = 0; i < Count; i++)
+		{
+			SX[i] = X[Begin + i] * RowRatio;
+			SY[i] = Y[Begin + i] * ColumnRatio;
+		}
+		for (const FInstruction& Instruction : Instructions)
+		{
+			float* D = Registers[Instruction.Dest];
+			const float* A = Registers[Instruction.A];
+			const float* B = Registers[Instruction.B];
+			const float* C = Registers[Instruction.C];
+			const float* P = Instruction.Params;
+			switch (Instruction.Op)
+			{
+			case EOp::Fill:
+				for (int32 i = 0; i < Count; i++) D[i] = P[0];
+				break;
+			case EOp::Noise:
+				if (Instruction.bScaled) {
+					Layers[Instruction.Layer].GetBatch(SX, SY, Count, D);
+				}
+				else {
+					Layers[Instruction.Layer].GetBatch(X + Begin, Y + Begin, Count, D);
+				}
+				break;
+			case EOp::Remap:
+				for (int32 i = 0; i < Count; i++) D[i] = P[2] + FMath::Clamp<float>(A[i], P[0], P[1]) * P[3];
+				break;
+			case EOp::Add:
+				for (int32 i = 0; i < Count; i++) D[i] = A[i] + B[i];
+				break;
+			case EOp::Subtract:
+				for (int32 i = 0; i < Count; i++) D[i] = A[i] - B[i];
+				break;
+			case EOp::Multiply:
+				for (int32 i = 0; i < Count; i++) D[i] = A[i] * B[i];
+				break;
+			case EOp::Divide:
+				for (int32 i = 0; i < Count; i++) D[i] = A[i] / B[i];
+				break;
+			case EOp::Min:
+				for (int32 i = 0; i < Count; i++) D[i] = FMath::Min(A[i], B[i]);
+				break;
+			case EOp::Max:
+				for (int32 i = 0; i < Count; i++) D[i] = FMath::Max(A[i], B[i]);
+				break;
+			case EOp::Blend:
+				for (int32 i = 0; i < Count; i++) D[i] = FMath::Lerp<float>(A[i], B[i], C[i]);
+				break;
+			case EOp::Clamp:
+				for (int32 i = 0; i < Count; i++) D[i] = FMath::Clamp<float>(A[i], P[0], P[1]);
+				break;
+			case EOp::Abs:
+				for (int32 i = 0; i < Count; i++) D[i] = FMath::Abs(A[i]);
+				break;
+			case EOp::Negate:
+				for (int32 i = 0; i < Count; i++) D[i] = -A[i];
+				break;
+			case EOp::Pow:
+				for (int32 i = 0; i < Count; i++) D[i] = FMath::Pow(A[i], B[i]);
+				break;
+			}
+		}
+		FMemory::Memcpy(Out_Values + Begin, Registers[OutputRegister], Count * sizeof(float));
+	}
+}
+
+float TerrainNoiseProgram::Evaluate(float X, float Y) const
+{
+	float Value;
+	Evaluate(&X, &Y, 1, &Value);
+	return Value;
+}
+
+void TerrainNoiseProgram::Hash(FXxHash64Builder& Builder) const
+{
+	HexGridBakedCache::HashValue(Builder, RowRatio);
+	HexGridBakedCache::HashValue(Builder, ColumnRatio);
+	HexGridBakedCache::HashValue(Builder, OutputRegister);
+	HexGridBakedCache::HashValue(Builder, Instructions.Num());
+	for (const FInstruction& Instruction : Instructions)
+	{
+		HexGridBakedCache::HashValue(Builder, Instruction.Op);
+		HexGridBakedCache::HashValue(Builder, Instruction.Dest);
+		HexGridBakedCache::HashValue(Builder, Instruction.A);
+		HexGridBakedCache::HashValue(Builder, Instruction.B);
+		HexGridBakedCache::HashValue(Builder, Instruction.C);
+		HexGridBakedCache::HashValue(Builder, Instruction.Params);
+		HexGridBakedCache::HashValue(Builder, Instruction.bScaled);
+		if (Instruction.Op != EOp::Noise) {
+			continue;
+		}
+		const TerrainNoiseLayer::FSettings& Settings = Layers[Instruction.Layer].GetSettings();
+		HexGridBakedCache::HashValue(Builder, Settings.NoiseType);
+		HexGridBakedCache::HashValue(Builder, Settings.Seed);
+		HexGridBakedCache::HashValue(Builder, Settings.Frequency);
+		HexGridBakedCache::HashValue(Builder, Settings.Interp);
+		HexGridBakedCache::HashValue(Builder, Settings.FractalType);
+		HexGridBakedCache::HashValue(Builder, Settings.Octaves);
+		HexGridBakedCache::HashValue(Builder, Settings.Lacunarity);
+		HexGridBakedCache::HashValue(Builder, Settings.Gain);
+		HexGridBakedCache::HashValue(Builder, Settings.CellularJitter);
+		HexGridBakedCache::HashValue(Builder, Settings.CDF);
+		HexGridBakedCache::HashValue(Builder, Settings.CRT);
+	}
+}
@@ -0,0 +1,95 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "TerrainNoiseLayer.h"
+
+#include "CoreMinimal.h"
+
+class UTerrainNoiseGraph;
+struct FXxHash64Builder;
+
+/**
+ * A UTerrainNoiseGraph compiled to a flat list of instructions over a small register file.
+ * Compile keeps the nodes the output reads, folds nodes of constant inputs, shifts and precomputes every
+ * remap to a clamp and a multiply add, and gives a register back once its last reader ran.
+ * Evaluate runs the whole list block by block, every instruction a plain loop over the block.
+ * Read only after Compile, safe from any number of threads.
+ */
+class MAPTESTCPP_API TerrainNoiseProgram
+{
+public:
+	//Samples per block, the register file of a block lives on the stack
+	static constexpr int32 BlockSize = 64;
+	static constexpr int32 MaxRegisters = 32;
+
+private:
+	enum class EOp : uint8
+	{
+		Fill,
+		Noise,
+		//Clamp to Params 0 and 1, then Params 2 + value * Params 3
+		Remap,
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		Min,
+		Max,
+		Blend,
+		Clamp,
+		Abs,
+		Negate,
+		Pow
+	};
+
+	struct FInstruction
+	{
+		EOp Op = EOp::Fill;
+		uint8 Dest = 0;
+		uint8 A = 0;
+		uint8 B = 0;
+		uint8 C = 0;
+		float Params[4] = { 0.0, 0.0, 0.0, 0.0 };
+		//Noise
+		int32 Layer = INDEX_NONE;
+		bool bScaled = false;
+	};
+
+	TArray<FInstruction> Instructions;
+	TArray<TerrainNoiseLayer> Layers;
+	int32 OutputRegister = INDEX_NONE;
+	float RowRatio = 1.0;
+	float ColumnRatio = 1.0;
+
+public:
+	TerrainNoiseProgram();
+	~TerrainNoiseProgram();
+	TerrainNoiseProgram(const TerrainNoiseProgram&) = default;
+	TerrainNoiseProgram(TerrainNoiseProgram&&) = default;
+	TerrainNoiseProgram& operator=(const TerrainNoiseProgram&) = default;
+	TerrainNoiseProgram& operator=(TerrainNoiseProgram&&) = default;
+
+	//Game thread, SeedOffset is added to every noise seed, the ratios scale the positions of scaled noise nodes.
+	//False with the reason when the graph is malformed, the program is then left empty.
+	bool Compile(const UTerrainNoiseGraph& Graph, int32 SeedOffset, float InRowRatio, float InColumnRatio, FString& Out_Error);
+	void Reset();
+
+	//Output of the graph, X and Y are vertex coordinates in tiles from the terrain center
+	void Evaluate(const float* X, const float* Y, int32 Num, float* Out_Values) const;
+	float Evaluate(float X, float Y) const;
+
+	//Everything the output depends on
+	void Hash(FXxHash64Builder& Builder) const;
+
+	FORCEINLINE bool IsValid() const
+	{
+		return OutputRegister != INDEX_NONE;
+	}
+
+	FORCEINLINE int32 GetInstructionNum() const
+	{
+		return Instructions.Num();
+	}
+
+};
@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WorkflowGraph.h"
+#include "FlowControlUtility.h"
+
+#include <Async/TaskGraphInterfaces.h>
+
+WorkflowGraph::WorkflowGraph()
+{
+}
+
+WorkflowGraph::~WorkflowGraph()
+{
+}
+
+int32 WorkflowGraph::AddStage(const TCHAR* Name, const TArray<int32>& Dependencies, TFunction<void()> Work, bool bGameThread)
+{
+	FStage& Stage = Stages.AddDefaulted_GetRef();
+	Stage.Name = Name;
+	Stage.bGameThread = bGameThread;
+	Stage.Dependencies = Dependencies;
+	Stage.Work = MoveTemp(Work);
+	return Stages.Num() - 1;
+}
+
+void WorkflowGraph::AddPrerequisite(int32 Stage, const UE::Tasks::FTask& Task)
+{
+	if (Stages.IsValidIndex(Stage) && Task.IsValid()) {
+		Stages[Stage].Prerequisites.Add(Task);
+	}
+}
+
+void WorkflowGraph::Launch(const FTimerDynamicDelegate& InWorkflowDelegate, TFunction<void()> OnCompleted)
+{
+	bCancelled = false;
+	WorkflowDelegate = InWorkflowDelegate;
+
+	TArray<UE::Tasks::FTask> AllTasks;
+	for (int32 i = 0; i < Stages.Num(); i++)
+	{
+		FStage& Stage = Stages[i];
+		TArray<UE::Tasks::FTask> Prerequisites = Stage.Prerequisites;
+		for (int32 Dependency : Stage.Dependencies)
+		{
+			//Stages are declared after what they read, so the graph can not have a cycle
+			check(Dependency >= 0 && Dependency < i);
+			Prerequisites.Add(Stages[Dependency].Task);
+		}
+
+		Stage.Task = UE::Tasks::Launch(Stage.Name, [this, i]() {
+			if (bCancelled) {
+				return;
+			}
+			FlowControlUtility::FUnslicedScope UnslicedScope(WorkflowDelegate);
+			Stages[i].Work();
+		}, Prerequisites, UE::Tasks::ETaskPriority::Normal,
+			Stage.bGameThread ? UE::Tasks::EExtendedTaskPriority::GameThreadNormalPri : UE::Tasks::EExtendedTaskPriority::None);
+		AllTasks.Add(Stage.Task);
+	}
+
+	CompletedTask = UE::Tasks::Launch(TEXT("WorkflowGraphCompleted"), [this, OnCompleted]() {
+		if (!bCancelled && OnCompleted) {
+			OnCompleted();
+		}
+	}, AllTasks, UE::Tasks::ETaskPriority::Normal, UE::Tasks::EExtendedTaskPriority::GameThreadNormalPri);
+}
+
+bool WorkflowGraph::IsRunning() const
+{
+	return CompletedTask.IsValid() && !CompletedTask.IsCompleted();
+}
+
+void WorkflowGraph::CancelAndWait()
+{
+	check(IsInGameThread());
+	bCancelled = true;
+	WaitGameThread(CompletedTask);
+}
+
+void WorkflowGraph::Reset()
+{
+	check(!IsRunning());
+	Stages.Empty();
+	CompletedTask = UE::Tasks::FTask();
+}
+
+void WorkflowGraph::WaitGameThread(const UE::Tasks::FTask& Task)
+{
+	//Game thread stages still queued only run while the game thread pumps its tasks
+	while (Task.IsValid() && !Task.IsCompleted())
+	{
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		FPlatformProcess::Yield();
+	}
+}
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+#include <Engine/EngineTypes.h>
+
+#include <atomic>
+
+/**
+ * Workflow stages declared with the stages whose results they read, run on the task system once those are done.
+ * Stages with no dependency path between them overlap on worker threads, game thread stages run between frames.
+ * Loops inside a stage are not sliced and a stage never schedules its workflow delegate, see FlowControlUtility.
+ */
+class MAPTESTCPP_API WorkflowGraph
+{
+private:
+	struct FStage
+	{
+		const TCHAR* Name = nullptr;
+		bool bGameThread = false;
+		TArray<int32> Dependencies;
+		TArray<UE::Tasks::FTask> Prerequisites;
+		TFunction<void()> Work;
+		UE::Tasks::FTask Task;
+	};
+
+	TArray<FStage> Stages;
+	FTimerDynamicDelegate WorkflowDelegate;
+	UE::Tasks::FTask CompletedTask;
+	std::atomic<bool> bCancelled = false;
+
+public:
+	WorkflowGraph();
+	~WorkflowGraph();
+	WorkflowGraph(const WorkflowGraph&) = delete;
+	WorkflowGraph& operator=(const WorkflowGraph&) = delete;
+
+	//Dependencies are indices returned by earlier AddStage calls
+	int32 AddStage(const TCHAR* Name, const TArray<int32>& Dependencies, TFunction<void()> Work, bool bGameThread = false);
+
+	//Work outside the graph the stage waits for
+	void AddPrerequisite(int32 Stage, const UE::Tasks::FTask& Task);
+
+	//Stages run unsliced for InWorkflowDelegate, OnCompleted runs on the game thread after every stage and outside that
+	void Launch(const FTimerDynamicDelegate& InWorkflowDelegate, TFunction<void()> OnCompleted);
+
+	bool IsRunning() const;
+
+	//Skip the stages not started yet and wait for the running ones, game thread only
+	void CancelAndWait();
+
+	//Drop the stages of a finished graph
+	void Reset();
+
+private:
+	void WaitGameThread(const UE::Tasks::FTask& Task);
+
+};
@@ -0,0 +1,223 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WorkflowProfiler.h"
+
+#include <HAL/IConsoleManager.h>
+#include <HAL/PlatformMemory.h>
+#include <Misc/FileHelper.h>
+#include <Misc/Paths.h>
+#include <Policies/PrettyJsonPrintPolicy.h>
+#include <Serialization/JsonWriter.h>
+
+DEFINE_LOG_CATEGORY(WorkflowReport);
+
+DECLARE_STATS_GROUP(TEXT("MapTest"), STATGROUP_MapTest, STATCAT_Advanced);
+
+static TAutoConsoleVariable<int32> CVarWorkflowReportAtDone(
+	TEXT("MapTest.WorkflowReportAtDone"),
+	1,
+	TEXT("1 logs the stage report of a workflow at Done, 2 also writes it as CSV and JSON under Saved/Profiling/MapTest."));
+
+static FAutoConsoleCommand WorkflowReportCommand(
+	TEXT("MapTest.WorkflowReport"),
+	TEXT("Log the stage report of every terrain and hex grid workflow, \"write\" also writes CSV and JSON."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args) {
+		WorkflowProfiler::LogAll();
+		if (Args.Contains(TEXT("write"))) {
+			WorkflowProfiler::WriteAll();
+		}
+	}));
+
+//Profilers after Init, game thread only
+static TArray<WorkflowProfiler*> LiveProfilers;
+
+//Innermost slice on this thread
+static thread_local WorkflowProfiler::FSliceScope* CurrentSlice = nullptr;
+
+static uint64 GetUsedMemory()
+{
+	return FPlatformMemory::GetStats().UsedPhysical;
+}
+
+WorkflowProfiler::FSliceScope::FSliceScope(WorkflowProfiler& InProfiler, int32 InStage)
+	: Profiler(InProfiler)
+	, Stage(InStage)
+	, StartTime(FPlatformTime::Seconds())
+	, StartMemory(InProfiler.Stages.IsValidIndex(InStage) ? GetUsedMemory() : 0)
+	, Items(0)
+	, Previous(CurrentSlice)
+#if STATS
+	, CycleCounter(InProfiler.StatIds.IsValidIndex(InStage) ? InProfiler.StatIds[InStage] : TStatId())
+#endif
+{
+	CurrentSlice = this;
+}
+
+WorkflowProfiler::FSliceScope::~FSliceScope()
+{
+	CurrentSlice = Previous;
+	if (Profiler.Stages.IsValidIndex(Stage)) {
+		Profiler.AddSlice(*this, FPlatformTime::Seconds(), GetUsedMemory());
+	}
+}
+
+WorkflowProfiler::WorkflowProfiler()
+{
+}
+
+WorkflowProfiler::~WorkflowProfiler()
+{
+	if (!OwnerName.IsEmpty()) {
+		LiveProfilers.Remove(this);
+	}
+}
+
+void WorkflowProfiler::Init(const FString& InOwnerName, const UEnum* StageEnum)
+{
+	check(IsInGameThread());
+	OwnerName = InOwnerName;
+	Stages.Empty();
+#if STATS
+	StatIds.Empty();
+#endif
+	//The last enum entry is the generated _MAX
+	for (int32 i = 0; i < StageEnum->NumEnums() - 1; i++)
+	{
+		FStageStats& Stats = Stages.AddDefaulted_GetRef();
+		Stats.Name = StageEnum->GetNameStringByIndex(i);
+#if STATS
+		StatIds.Add(FDynamicStats::CreateStatId<FStatGroup_STATGROUP_MapTest>(
+			FString::Printf(TEXT("%s %s"), *StageEnum->GetName(), *Stats.Name)));
+#endif
+	}
+	LiveProfilers.AddUnique(this);
+}
+
+void WorkflowProfiler::CountItems(int64 Num)
+{
+	if (CurrentSlice != nullptr) {
+		CurrentSlice->Items += Num;
+	}
+}
+
+void WorkflowProfiler::AddSlice(const FSliceScope& Slice, double EndTime, uint64 EndMemory)
+{
+	FScopeLock ScopeLock(&Lock);
+	FStageStats& Stats = Stages[Slice.Stage];
+	if (Stats.Slices == 0) {
+		Stats.FirstStart = Slice.StartTime;
+	}
+	Stats.LastEnd = FMath::Max(Stats.LastEnd, EndTime);
+	Stats.ActiveSeconds += EndTime - Slice.StartTime;
+	Stats.Slices++;
+	Stats.Items += Slice.Items;
+	Stats.EndMemoryDelta = FMath::Max(Stats.EndMemoryDelta, int64(EndMemory) - int64(Slice.StartMemory));
+}
+
+void WorkflowProfiler::CopyStages(TArray<FStageStats>& Out_Stages) const
+{
+	FScopeLock ScopeLock(&Lock);
+	Out_Stages = Stages;
+}
+
+void WorkflowProfiler::LogReport() const
+{
+	TArray<FStageStats> Copy;
+	CopyStages(Copy);
+
+	double First = MAX_dbl;
+	double Last = 0.0;
+	UE_LOG(WorkflowReport, Log, TEXT("%s workflow:"), *OwnerName);
+	UE_LOG(WorkflowReport, Log, TEXT("  %-36s %10s %10s %7s %10s %10s"), TEXT("Stage"), TEXT("Wall ms"), TEXT("Active ms"),
+		TEXT("Slices"), TEXT("Items"), TEXT("End mem MB"));
+	for (const FStageStats& Stats : Copy)
+	{
+		if (Stats.Slices == 0) {
+			continue;
+		}
+		First = FMath::Min(First, Stats.FirstStart);
+		Last = FMath::Max(Last, Stats.LastEnd);
+		UE_LOG(WorkflowReport, Log, TEXT("  %-36s %10.2f %10.2f %7d %10lld %10.2f"), *Stats.Name,
+			(Stats.LastEnd - Stats.FirstStart) * 1000.0, Stats.ActiveSeconds * 1000.0, Stats.Slices, Stats.Items,
+			Stats.EndMemoryDelta / (1024.0 * 1024.0));
+	}
+	if (Last > 0.0) {
+		UE_LOG(WorkflowReport, Log, TEXT("  Total wall %.2f ms"), (Last - First) * 1000.0);
+	}
+}
+
+bool WorkflowProfiler::WriteReport() const
+{
+	TArray<FStageStats> Copy;
+	CopyStages(Copy);
+
+	FString Csv = TEXT("Stage,WallMs,ActiveMs,Slices,Items,EndMemoryDeltaBytes\n");
+	FString Json;
+	TSharedRef<TJsonWriter<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>> Writer =
+		TJsonWriterFactory<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>::Create(&Json);
+	Writer->WriteObjectStart();
+	Writer->WriteValue(TEXT("Workflow"), OwnerName);
+	Writer->WriteArrayStart(TEXT("Stages"));
+	for (const FStageStats& Stats : Copy)
+	{
+		if (Stats.Slices == 0) {
+			continue;
+		}
+		double WallMs = (Stats.LastEnd - Stats.FirstStart) * 1000.0;
+		double ActiveMs = Stats.ActiveSeconds * 1000.0;
+		Csv += FString::Printf(TEXT("%s,%.3f,%.3f,%d,%lld,%lld\n"), *Stats.Name, WallMs, ActiveMs, Stats.Slices,
+			Stats.Items, Stats.EndMemoryDelta);
+
+		Writer->WriteObjectStart();
+		Writer->WriteValue(TEXT("Stage"), Stats.Name);
+		Writer->WriteValue(TEXT("WallMs"), WallMs);
+		Writer->WriteValue(TEXT("ActiveMs"), ActiveMs);
+		Writer->WriteValue(TEXT("Slices"), Stats.Slices);
+		Writer->WriteValue(TEXT("Items"), Stats.Items);
+		Writer->WriteValue(TEXT("EndMemoryDeltaBytes"), Stats.EndMemoryDelta);
+		Writer->WriteObjectEnd();
+	}
+	Writer->WriteArrayEnd();
+	Writer->WriteObjectEnd();
+	Writer->Close();
+
+	FString BasePath = FPaths::ProfilingDir() / TEXT("MapTest") /
+		FString::Printf(TEXT("%s_%s"), *OwnerName, *FDateTime::Now().ToString());
+	bool Success = FFileHelper::SaveStringToFile(Csv, *(BasePath + TEXT(".csv")));
+	Success = FFileHelper::SaveStringToFile(Json, *(BasePath + TEXT(".json"))) && Success;
+	if (Success) {
+		UE_LOG(WorkflowReport, Log, TEXT("Report written to %s.csv/.json"), *BasePath);
+	}
+	else {
+		UE_LOG(WorkflowReport, Warning, TEXT("Report can not be written to %s"), *BasePath);
+	}
+	return Success;
+}
+
+void WorkflowProfiler::Finish() const
+{
+	int32 Mode = CVarWorkflowReportAtDone.GetValueOnGameThread();
+	if (Mode >= 1) {
+		LogReport();
+	}
+	if (Mode >= 2) {
+		WriteReport();
+	}
+}
+
+void WorkflowProfiler::LogAll()
+{
+	for (const WorkflowProfiler* Profiler : LiveProfilers)
+	{
+		Profiler->LogReport();
+	}
+}
+
+void WorkflowProfiler::WriteAll()
+{
+	for (const WorkflowProfiler* Profiler : LiveProfilers)
+	{
+		Profiler->WriteReport();
+	}
+}
@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(WorkflowReport, Log, All);
+
+/**
+ * Per stage timings of one actor workflow, stages are the values of its workflow state enum.
+ * A slice is one run of a stage, a timer hop of a sliced loop or a whole stage of a WorkflowGraph.
+ * Wall time spans the first slice start to the last slice end, active time sums the slices.
+ * Items count the iterations of the FlowControlUtility loops in the slices.
+ * Memory is the largest growth of process used physical memory from the start to the end of one slice.
+ * It is not a peak, memory freed inside the slice is missed, and stages running at once on the graph see each other.
+ * Slices show in "stat MapTest", MapTest.WorkflowReport logs every live workflow.
+ */
+class MAPTESTCPP_API WorkflowProfiler
+{
+public:
+	struct FStageStats
+	{
+		FString Name;
+		double FirstStart = 0.0;
+		double LastEnd = 0.0;
+		double ActiveSeconds = 0.0;
+		int32 Slices = 0;
+		int64 Items = 0;
+		int64 EndMemoryDelta = 0;
+	};
+
+	//Any thread, records into the stage when it goes out of scope
+	struct FSliceScope
+	{
+		FSliceScope(WorkflowProfiler& InProfiler, int32 InStage);
+		~FSliceScope();
+		FSliceScope(const FSliceScope&) = delete;
+		FSliceScope& operator=(const FSliceScope&) = delete;
+
+	private:
+		friend class WorkflowProfiler;
+
+		WorkflowProfiler& Profiler;
+		int32 Stage;
+		double StartTime;
+		uint64 StartMemory;
+		int64 Items;
+		FSliceScope* Previous;
+#if STATS
+		FScopeCycleCounter CycleCounter;
+#endif
+	};
+
+private:
+	FString OwnerName;
+	TArray<FStageStats> Stages;
+#if STATS
+	TArray<TStatId> StatIds;
+#endif
+	mutable FCriticalSection Lock;
+
+public:
+	WorkflowProfiler();
+	~WorkflowProfiler();
+	WorkflowProfiler(const WorkflowProfiler&) = delete;
+	WorkflowProfiler& operator=(const WorkflowProfiler&) = delete;
+
+	//Game thread, stage names from StageEnum, clears earlier stats
+	void Init(const FString& InOwnerName, const UEnum* StageEnum);
+
+	template<typename FuncType>
+	void Run(int32 Stage, FuncType&& Func)
+	{
+		FSliceScope Slice(*this, Stage);
+		Func();
+	}
+
+	//Iterations of a loop in the innermost slice of this thread
+	static void CountItems(int64 Num);
+
+	void LogReport() const;
+	//CSV and JSON under Saved/Profiling/MapTest
+	bool WriteReport() const;
+	//At Done, log and write when MapTest.WorkflowReportAtDone
+	void Finish() const;
+
+	//Snapshot by stage index, any thread
+	void CopyStages(TArray<FStageStats>& Out_Stages) const;
+
+	static void LogAll();
+	static void WriteAll();
+
+private:
+	void AddSlice(const FSliceScope& Slice, double EndTime, uint64 EndMemory);
+
+};